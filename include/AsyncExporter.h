@@ -0,0 +1,188 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef ASYNCEXPORTER_H
+#define ASYNCEXPORTER_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+#include "VTUWriter.h"
+
+/*! \brief Writes meshes on a background thread.
+ *
+ * export_vtu takes a snapshot of the mesh arrays on the calling thread
+ * and queues it. A single I/O thread compresses and writes the queued
+ * snapshots in order, so the caller can carry on adapting the mesh.
+ * At most max_pending snapshots are in flight; export_vtu blocks until
+ * one of them has been written if the limit is reached. Every export
+ * returns a handle which can be passed to test or wait. All MPI calls
+ * are made on the calling thread.
+ */
+template<typename real_t> class AsyncExporter
+{
+public:
+    /*! Start the I/O thread.
+     * @param max_pending maximum number of snapshots queued or being written.
+     */
+    AsyncExporter(int max_pending=2)
+    {
+        this->max_pending = std::max(max_pending, 1);
+        submitted = 0;
+        completed = 0;
+        finished = false;
+        worker = std::thread(&AsyncExporter<real_t>::run, this);
+    }
+
+    /// Write all outstanding snapshots and stop the I/O thread.
+    ~AsyncExporter()
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            finished = true;
+        }
+        queue_changed.notify_all();
+        worker.join();
+    }
+
+    /*! Queue the mesh to be written, see VTUWriter::export_vtu.
+     * @param basename name of the output without extension.
+     * @param mesh mesh to be written. It may be modified once this returns.
+     * @param psi optional vertex field, written as "psi".
+     * @param compress compress arrays with zlib, if available.
+     * @return handle of the export.
+     */
+    int export_vtu(const char *basename, const Mesh<real_t> *mesh, const real_t *psi=NULL, bool compress=false)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while(submitted-completed>=max_pending)
+                queue_changed.wait(guard);
+        }
+
+        typename VTUWriter<real_t>::snapshot *piece = new typename VTUWriter<real_t>::snapshot;
+        VTUWriter<real_t>::take_snapshot(basename, mesh, psi, compress, *piece);
+
+        int handle;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            queue.push_back(piece);
+            handle = submitted++;
+        }
+        queue_changed.notify_all();
+
+        return handle;
+    }
+
+    /// Return true if handle was returned by export_vtu.
+    bool is_handle(int handle)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return handle>=0 && handle<submitted;
+    }
+
+    /// Return true if the export has been written.
+    bool test(int handle)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        return handle<completed;
+    }
+
+    /// Block until the export has been written. Returns at once for unknown handles.
+    void wait(int handle)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while(handle>=completed && handle<submitted)
+            queue_changed.wait(guard);
+    }
+
+    /// Block until all exports have been written.
+    void wait_all()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while(completed<submitted)
+            queue_changed.wait(guard);
+    }
+
+private:
+    void run()
+    {
+#ifdef HAVE_OPENMP
+        // Compress serially rather than compete with the caller's threads.
+        omp_set_num_threads(1);
+#endif
+
+        for(;;) {
+            typename VTUWriter<real_t>::snapshot *piece;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                while(queue.empty() && !finished)
+                    queue_changed.wait(guard);
+                if(queue.empty())
+                    return;
+                piece = queue.front();
+            }
+
+            VTUWriter<real_t>::write(*piece);
+            delete piece;
+
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                queue.pop_front();
+                completed++;
+            }
+            queue_changed.notify_all();
+        }
+    }
+
+    int max_pending, submitted, completed;
+    bool finished;
+    std::deque<typename VTUWriter<real_t>::snapshot *> queue;
+    std::mutex lock;
+    std::condition_variable queue_changed;
+    std::thread worker;
+};
+
+#endif
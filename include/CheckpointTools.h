@@ -0,0 +1,432 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef CHECKPOINTTOOLS_H
+#define CHECKPOINTTOOLS_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#include "Mesh.h"
+#include "MetricField.h"
+
+/*! \brief Native binary checkpoints of a mesh.
+ *
+ * Each process writes its partition to basename_<rank>.pcp and rank 0
+ * writes a small index file, basename.pcp, listing the pieces. A piece
+ * is a fixed size header of section offsets and sizes followed by the
+ * raw arrays of the mesh (coordinates, element-node list, boundary,
+ * metric, quality, CSR adjacency, ownership, halo lists and attached
+ * fields), each aligned to a cache line. A piece is read back by
+ * mapping it into memory, so restarting does not parse anything and
+ * does not recompute adjacency, boundary, quality or halos.
+ */
+template<typename real_t> class CheckpointTools
+{
+public:
+
+    /*! Write a checkpoint of the mesh. Collective over the mesh's communicator.
+     * @param basename name of the checkpoint without extension.
+     * @param mesh mesh to be saved.
+     */
+    static void export_checkpoint(const char *basename, const Mesh<real_t> *mesh)
+    {
+        int rank=0, nparts=1;
+#ifdef HAVE_MPI
+        MPI_Comm comm = mesh->get_mpi_comm();
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &nparts);
+#endif
+
+        size_t NNodes = mesh->NNodes;
+        size_t NElements = mesh->NElements;
+        size_t nloc = mesh->nloc;
+
+        // Flatten the adjacency lists.
+        std::vector<index_t> NNList_ptr, NNList, NEList_ptr, NEList;
+        flatten(mesh->NNList, NNodes, NNList_ptr, NNList);
+        flatten(mesh->NEList, NNodes, NEList_ptr, NEList);
+
+        // Flatten the halo.
+        std::vector<index_t> send_ptr, send, recv_ptr, recv;
+        flatten(mesh->send, mesh->send.size(), send_ptr, send);
+        flatten(mesh->recv, mesh->recv.size(), recv_ptr, recv);
+
+        checkpoint_header header;
+        memset(&header, 0, sizeof(checkpoint_header));
+        memcpy(header.magic, "PRAGCKPT", 8);
+        header.version = CHECKPOINT_VERSION;
+        header.byte_order = 0x01020304;
+        header.real_size = sizeof(real_t);
+        header.index_size = sizeof(index_t);
+        header.ndims = mesh->ndims;
+        header.nloc = nloc;
+        header.msize = mesh->msize;
+        header.nfields = mesh->nfields;
+        header.rank = rank;
+        header.nparts = nparts;
+        header.NNodes = NNodes;
+        header.NElements = NElements;
+        header.gnn_offset = mesh->gnn_offset;
+
+        const void *data[NSECTIONS];
+        data[COORDS] = mesh->_coords.data();
+        header.size[COORDS] = NNodes*mesh->ndims*sizeof(real_t);
+        data[ENLIST] = mesh->_ENList.data();
+        header.size[ENLIST] = NElements*nloc*sizeof(index_t);
+        data[BOUNDARY] = mesh->boundary.data();
+        header.size[BOUNDARY] = mesh->boundary.empty()?0:NElements*nloc*sizeof(int);
+        data[METRIC] = mesh->metric.data();
+        header.size[METRIC] = NNodes*mesh->msize*sizeof(double);
+        data[QUALITY] = mesh->quality.data();
+        header.size[QUALITY] = NElements*sizeof(double);
+        data[NNLIST_PTR] = NNList_ptr.data();
+        header.size[NNLIST_PTR] = NNList_ptr.size()*sizeof(index_t);
+        data[NNLIST] = NNList.data();
+        header.size[NNLIST] = NNList.size()*sizeof(index_t);
+        data[NELIST_PTR] = NEList_ptr.data();
+        header.size[NELIST_PTR] = NEList_ptr.size()*sizeof(index_t);
+        data[NELIST] = NEList.data();
+        header.size[NELIST] = NEList.size()*sizeof(index_t);
+        data[NODE_OWNER] = mesh->node_owner.data();
+        header.size[NODE_OWNER] = NNodes*sizeof(int);
+        data[LNN2GNN] = mesh->lnn2gnn.data();
+        header.size[LNN2GNN] = NNodes*sizeof(index_t);
+        data[SEND_PTR] = send_ptr.data();
+        header.size[SEND_PTR] = send_ptr.size()*sizeof(index_t);
+        data[SEND] = send.data();
+        header.size[SEND] = send.size()*sizeof(index_t);
+        data[RECV_PTR] = recv_ptr.data();
+        header.size[RECV_PTR] = recv_ptr.size()*sizeof(index_t);
+        data[RECV] = recv.data();
+        header.size[RECV] = recv.size()*sizeof(index_t);
+        data[FIELDS] = mesh->fields.data();
+        header.size[FIELDS] = NNodes*mesh->nfields*sizeof(real_t);
+
+        uint64_t offset = align(sizeof(checkpoint_header));
+        for(int i=0; i<NSECTIONS; i++) {
+            header.offset[i] = offset;
+            offset = align(offset+header.size[i]);
+        }
+
+        std::string filename = piece_name(basename, rank);
+        int fd = open(filename.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if(fd<0 || ftruncate(fd, offset)!=0) {
+            fprintf(stderr, "####  ERROR  Cannot write checkpoint %s\n", filename.c_str());
+            exit(1);
+        }
+
+        // Sections are independent, so they are written concurrently.
+        bool ok = write_all(fd, &header, sizeof(checkpoint_header), 0);
+        #pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+        for(int i=0; i<NSECTIONS; i++) {
+            ok = write_all(fd, data[i], header.size[i], header.offset[i]) && ok;
+        }
+        ok = (close(fd)==0) && ok;
+        if(!ok) {
+            fprintf(stderr, "####  ERROR  Cannot write checkpoint %s\n", filename.c_str());
+            exit(1);
+        }
+
+        // Index of the pieces.
+        std::vector<uint64_t> sizes(2*nparts);
+        sizes[2*rank] = NNodes;
+        sizes[2*rank+1] = NElements;
+#ifdef HAVE_MPI
+        if(nparts>1)
+            MPI_Allgather(MPI_IN_PLACE, 2, MPI_UINT64_T, sizes.data(), 2, MPI_UINT64_T, comm);
+#endif
+        if(rank==0) {
+            std::ofstream index((std::string(basename)+".pcp").c_str());
+            index<<"PRAGCKPT "<<CHECKPOINT_VERSION<<" "<<nparts<<std::endl;
+            for(int p=0; p<nparts; p++) {
+                std::string piece = piece_name(basename, p);
+                size_t slash = piece.find_last_of('/');
+                if(slash!=std::string::npos)
+                    piece = piece.substr(slash+1);
+                index<<piece<<" "<<sizes[2*p]<<" "<<sizes[2*p+1]<<std::endl;
+            }
+        }
+#ifdef HAVE_MPI
+        // The checkpoint is complete only once the index has been written.
+        MPI_Barrier(comm);
+#endif
+    }
+
+    /*! Read a checkpoint written by export_checkpoint. Collective over
+     * MPI_COMM_WORLD, which must have as many processes as the checkpoint
+     * has pieces.
+     * @param basename name of the checkpoint without extension.
+     */
+    static Mesh<real_t>* import_checkpoint(const char *basename)
+    {
+        int rank=0, nparts=1;
+#ifdef HAVE_MPI
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &nparts);
+#endif
+
+        {
+            std::ifstream index((std::string(basename)+".pcp").c_str());
+            std::string magic;
+            int version=0, npieces=0;
+            index>>magic>>version>>npieces;
+            if(magic!="PRAGCKPT" || version!=CHECKPOINT_VERSION || npieces!=nparts) {
+                fprintf(stderr, "####  ERROR  %s.pcp is not a checkpoint for %d processes\n", basename, nparts);
+                exit(1);
+            }
+        }
+
+        std::string filename = piece_name(basename, rank);
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat sb;
+        if(fd<0 || fstat(fd, &sb)!=0 || (size_t)sb.st_size<sizeof(checkpoint_header)) {
+            fprintf(stderr, "####  ERROR  Checkpoint %s not found\n", filename.c_str());
+            exit(1);
+        }
+
+        void *addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(addr==MAP_FAILED) {
+            fprintf(stderr, "####  ERROR  Cannot map checkpoint %s\n", filename.c_str());
+            exit(1);
+        }
+        const char *base = (const char *)addr;
+        const checkpoint_header *header = (const checkpoint_header *)base;
+
+        if(memcmp(header->magic, "PRAGCKPT", 8)!=0 || header->version!=CHECKPOINT_VERSION ||
+                header->byte_order!=0x01020304 || header->real_size!=sizeof(real_t) ||
+                header->index_size!=sizeof(index_t) || header->rank!=rank || header->nparts!=nparts ||
+                header->offset[NSECTIONS-1]+header->size[NSECTIONS-1]>(uint64_t)sb.st_size) {
+            fprintf(stderr, "####  ERROR  Checkpoint %s is incompatible with this build\n", filename.c_str());
+            exit(1);
+        }
+
+        Mesh<real_t> *mesh = new Mesh<real_t>();
+#ifdef HAVE_MPI
+        mesh->_mpi_comm = MPI_COMM_WORLD;
+        mpi_type_wrapper<index_t> mpi_index_t_wrapper;
+        mesh->MPI_INDEX_T = mpi_index_t_wrapper.mpi_type;
+        mpi_type_wrapper<real_t> mpi_real_t_wrapper;
+        mesh->MPI_REAL_T = mpi_real_t_wrapper.mpi_type;
+#endif
+        mesh->rank = rank;
+        mesh->num_processes = nparts;
+        mesh->nthreads = pragmatic_nthreads();
+        mesh->topology_version = 0;
+
+        mesh->ndims = header->ndims;
+        mesh->nloc = header->nloc;
+        mesh->msize = header->msize;
+        mesh->nfields = header->nfields;
+        mesh->NNodes = header->NNodes;
+        mesh->NElements = header->NElements;
+        mesh->gnn_offset = header->gnn_offset;
+
+        load(base, header, COORDS, mesh->_coords);
+        load(base, header, ENLIST, mesh->_ENList);
+        load(base, header, BOUNDARY, mesh->boundary);
+        load(base, header, METRIC, mesh->metric);
+        load(base, header, QUALITY, mesh->quality);
+        load(base, header, NODE_OWNER, mesh->node_owner);
+        load(base, header, LNN2GNN, mesh->lnn2gnn);
+        load(base, header, FIELDS, mesh->fields);
+
+        const index_t *NNList_ptr = (const index_t *)(base+header->offset[NNLIST_PTR]);
+        const index_t *NNList = (const index_t *)(base+header->offset[NNLIST]);
+        const index_t *NEList_ptr = (const index_t *)(base+header->offset[NELIST_PTR]);
+        const index_t *NEList = (const index_t *)(base+header->offset[NELIST]);
+        int NNodes = mesh->NNodes;
+        mesh->NNList.resize(NNodes);
+        mesh->NEList.resize(NNodes);
+        #pragma omp parallel for schedule(static)
+        for(int i=0; i<NNodes; i++) {
+            mesh->NNList[i].assign(NNList+NNList_ptr[i], NNList+NNList_ptr[i+1]);
+            mesh->NEList[i].insert(NEList+NEList_ptr[i], NEList+NEList_ptr[i+1]);
+        }
+
+        // Halo lists and the maps and sets derived from them.
+        const index_t *send_ptr = (const index_t *)(base+header->offset[SEND_PTR]);
+        const index_t *send = (const index_t *)(base+header->offset[SEND]);
+        const index_t *recv_ptr = (const index_t *)(base+header->offset[RECV_PTR]);
+        const index_t *recv = (const index_t *)(base+header->offset[RECV]);
+        size_t nhalo = header->size[SEND_PTR]/sizeof(index_t);
+        nhalo = nhalo>0?nhalo-1:0;
+        mesh->send.resize(nhalo);
+        mesh->recv.resize(nhalo);
+        mesh->send_map.resize(nhalo);
+        mesh->recv_map.resize(nhalo);
+        for(size_t p=0; p<nhalo; p++) {
+            mesh->send[p].assign(send+send_ptr[p], send+send_ptr[p+1]);
+            mesh->recv[p].assign(recv+recv_ptr[p], recv+recv_ptr[p+1]);
+            for(size_t k=0; k<mesh->send[p].size(); k++) {
+                index_t lnn = mesh->send[p][k];
+                mesh->send_map[p][mesh->lnn2gnn[lnn]] = lnn;
+                mesh->send_halo.insert(lnn);
+            }
+            for(size_t k=0; k<mesh->recv[p].size(); k++) {
+                index_t lnn = mesh->recv[p][k];
+                mesh->recv_map[p][mesh->lnn2gnn[lnn]] = lnn;
+                mesh->recv_halo.insert(lnn);
+            }
+        }
+
+        munmap(addr, sb.st_size);
+
+        // Elements were oriented positively when the mesh was created,
+        // so the first live element gives back the same orientation.
+        mesh->property = NULL;
+        for(index_t i=0; i<mesh->NElements; i++) {
+            const index_t *n = mesh->get_element(i);
+            if(n[0]<0)
+                continue;
+
+            if(mesh->ndims==2)
+                mesh->property = new ElementProperty<real_t>(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]));
+            else
+                mesh->property = new ElementProperty<real_t>(mesh->get_coords(n[0]), mesh->get_coords(n[1]),
+                        mesh->get_coords(n[2]), mesh->get_coords(n[3]));
+            break;
+        }
+
+        return mesh;
+    }
+
+    /*! Create a metric field from the metric stored in a restored mesh.
+     * @param mesh mesh returned by import_checkpoint.
+     */
+    template<int dim>
+    static MetricField<real_t, dim>* import_checkpoint_metric(Mesh<real_t> &mesh)
+    {
+        MetricField<real_t, dim> *metric = new MetricField<real_t, dim>(mesh);
+        metric->alloc_metric();
+
+        const int msize = dim==2?3:6;
+        int NNodes = mesh.get_number_nodes();
+        for(int i=0; i<NNodes; i++) {
+            real_t m[msize];
+            for(int j=0; j<msize; j++)
+                m[j] = mesh.metric[i*msize+j];
+            metric->set_metric(m, i);
+        }
+
+        return metric;
+    }
+
+private:
+    enum section {COORDS, ENLIST, BOUNDARY, METRIC, QUALITY, NNLIST_PTR, NNLIST, NELIST_PTR, NELIST,
+                  NODE_OWNER, LNN2GNN, SEND_PTR, SEND, RECV_PTR, RECV, FIELDS, NSECTIONS
+                 };
+
+    static const uint32_t CHECKPOINT_VERSION = 1;
+
+    // Fixed width so that a piece can be mapped directly.
+    struct checkpoint_header {
+        char magic[8];
+        uint32_t version, byte_order, real_size, index_size;
+        uint32_t ndims, nloc, msize, nfields;
+        int32_t rank, nparts;
+        uint64_t NNodes, NElements;
+        int64_t gnn_offset;
+        uint64_t offset[NSECTIONS], size[NSECTIONS];
+    };
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset+63)&~((uint64_t)63);
+    }
+
+    static std::string piece_name(const char *basename, int rank)
+    {
+        std::stringstream name;
+        name<<basename<<"_"<<rank<<".pcp";
+        return name.str();
+    }
+
+    /// Compressed sparse row form of a list of lists.
+    template<class list_t>
+    static void flatten(const std::vector<list_t> &lists, size_t n, std::vector<index_t> &ptr, std::vector<index_t> &values)
+    {
+        ptr.resize(n+1);
+        ptr[0] = 0;
+        for(size_t i=0; i<n; i++)
+            ptr[i+1] = ptr[i]+lists[i].size();
+
+        values.resize(ptr[n]);
+        #pragma omp parallel for schedule(static)
+        for(int i=0; i<(int)n; i++)
+            std::copy(lists[i].begin(), lists[i].end(), values.begin()+ptr[i]);
+    }
+
+    template<typename T>
+    static void load(const char *base, const checkpoint_header *header, int s, std::vector<T> &array)
+    {
+        const T *begin = (const T *)(base+header->offset[s]);
+        array.assign(begin, begin+header->size[s]/sizeof(T));
+    }
+
+    static bool write_all(int fd, const void *data, size_t size, uint64_t offset)
+    {
+        const char *ptr = (const char *)data;
+        while(size>0) {
+            ssize_t written = pwrite(fd, ptr, size, offset);
+            if(written<=0)
+                return false;
+            ptr += written;
+            offset += written;
+            size -= written;
+        }
+        return true;
+    }
+};
+
+#endif
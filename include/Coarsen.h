@@ -106,6 +106,8 @@ public:
                  bool enable_quality_constrained=false)
     {
 
+        _mesh->topology_version++;
+
         surface_coarsening = enable_surface_coarsening;
         delete_slivers = enable_delete_slivers;
         quality_constrained = enable_quality_constrained;
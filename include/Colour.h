@@ -0,0 +1,160 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef COLOUR_H
+#define COLOUR_H
+
+#include <algorithm>
+#include <vector>
+
+#include <stdint.h>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+/*! \brief Vertex colouring of the node-node graph.
+ *
+ * Produces a distance-1 colouring, i.e. no two adjacent vertices
+ * share a colour, so that all vertices of one colour form an
+ * independent set and can be updated concurrently without locks. The
+ * colouring only depends on the graph and not on the number of
+ * threads used to compute it.
+ */
+template<typename index_t>
+class Colour
+{
+public:
+    /*! Colour the subgraph induced by the vertices flagged in active
+     * using the Jones-Plassmann algorithm. Vertex priorities are a hash
+     * of the vertex id so that the result is deterministic.
+     * @param NNodes number of vertices.
+     * @param NNList node-node adjacency list.
+     * @param active vertices to be coloured, all others are ignored.
+     * @param colour returns the colour of each vertex, -1 if not active.
+     * @return number of colours used.
+     */
+    static int jones_plassmann(size_t NNodes, const std::vector< std::vector<index_t> > &NNList,
+                               const std::vector<char> &active, std::vector<int> &colour)
+    {
+        colour.assign(NNodes, -1);
+
+        std::vector<index_t> uncoloured, next_uncoloured;
+        for(size_t i=0; i<NNodes; i++) {
+            if(active[i])
+                uncoloured.push_back(i);
+        }
+
+        std::vector<char> selected;
+        int ncolours = 0;
+        while(!uncoloured.empty()) {
+            int nuncoloured = uncoloured.size();
+            selected.resize(nuncoloured);
+
+            #pragma omp parallel
+            {
+                // Select the vertices that have the highest priority among
+                // their uncoloured neighbours. This is an independent set.
+                #pragma omp for schedule(guided)
+                for(int k=0; k<nuncoloured; k++) {
+                    index_t v = uncoloured[k];
+                    selected[k] = 1;
+                    for(const auto& u : NNList[v]) {
+                        if(active[u] && colour[u]<0 && higher_priority(u, v)) {
+                            selected[k] = 0;
+                            break;
+                        }
+                    }
+                }
+
+                // Give each selected vertex the smallest colour not already
+                // used by a neighbour.
+                std::vector<char> used;
+                #pragma omp for schedule(guided) reduction(max:ncolours)
+                for(int k=0; k<nuncoloured; k++) {
+                    if(!selected[k])
+                        continue;
+
+                    index_t v = uncoloured[k];
+                    used.assign(NNList[v].size()+1, 0);
+                    for(const auto& u : NNList[v]) {
+                        if(colour[u]>=0 && colour[u]<(int)used.size())
+                            used[colour[u]] = 1;
+                    }
+
+                    int c=0;
+                    while(used[c])
+                        c++;
+
+                    colour[v] = c;
+                    ncolours = std::max(ncolours, c+1);
+                }
+            }
+
+            next_uncoloured.clear();
+            for(int k=0; k<nuncoloured; k++) {
+                if(!selected[k])
+                    next_uncoloured.push_back(uncoloured[k]);
+            }
+            uncoloured.swap(next_uncoloured);
+        }
+
+        return ncolours;
+    }
+
+private:
+    /// Strict ordering of vertices by a hash of their id.
+    static inline bool higher_priority(index_t a, index_t b)
+    {
+        uint32_t ha = hash(a), hb = hash(b);
+        return (ha>hb) || (ha==hb && a>b);
+    }
+
+    /// Integer bit mixer (finalizer of MurmurHash3).
+    static inline uint32_t hash(index_t i)
+    {
+        uint32_t h = i;
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+};
+
+#endif
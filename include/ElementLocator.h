@@ -0,0 +1,490 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef ELEMENTLOCATOR_H
+#define ELEMENTLOCATOR_H
+
+#include <algorithm>
+#include <cfloat>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+
+/*! \brief Point location in the elements of a mesh.
+ *
+ * Elements are sorted along a Morton (Z-order) curve of their
+ * centroids and grouped into fixed size leaves of a bounding volume
+ * hierarchy. The hierarchy is stored as an implicit, complete binary
+ * tree so that it is built level by level in parallel and traversed
+ * without pointer chasing. Queries first walk through neighbouring
+ * elements starting from a guess, e.g. the previous hit, and only
+ * search the tree if the walk fails.
+ *
+ * The locator refers to the mesh so the mesh must not be modified
+ * while the locator is in use.
+ */
+template<typename real_t, int dim>
+class ElementLocator
+{
+public:
+    /// Build the search structures for mesh.
+    ElementLocator(const Mesh<real_t> &mesh):nloc(dim+1)
+    {
+        _mesh = &mesh;
+        build();
+    }
+
+    /// Default destructor.
+    ~ElementLocator()
+    {
+    }
+
+    /*! Find the element containing x.
+     * @param x position.
+     * @param l returns the barycentric coordinates of x in the element.
+     * @param guess element from which to start walking, e.g. the element
+     * returned by the previous query; -1 to search the tree directly.
+     * @return the element containing x. If x lies outside the mesh, the
+     * closest element examined is returned and l is clamped to it. -1 is
+     * only returned for an empty mesh.
+     */
+    int locate(const real_t *x, real_t *l, int guess=-1) const
+    {
+        int eid = -1;
+        if(guess>=0 && _mesh->get_element(guess)[0]>=0)
+            eid = walk(x, l, guess);
+
+        if(eid<0)
+            eid = search(x, l);
+
+        return eid;
+    }
+
+    /*! Linearly interpolate vertex fields of the mesh onto the vertices
+     * of another mesh, e.g. the adapted mesh.
+     * @param new_mesh mesh to interpolate onto.
+     * @param psi fields on this mesh, stored vertex by vertex.
+     * @param new_psi returns the fields on new_mesh; zero if this mesh
+     * has no elements.
+     * @param nfields number of fields.
+     */
+    void interpolate(const Mesh<real_t> &new_mesh, const real_t *psi, real_t *new_psi, int nfields=1) const
+    {
+        int NNodes = new_mesh.get_number_nodes();
+
+        if(sorted.empty()) {
+            std::fill(new_psi, new_psi+(size_t)NNodes*nfields, (real_t)0.0);
+            return;
+        }
+
+        #pragma omp parallel
+        {
+            // Consecutive vertices tend to be close, so each thread
+            // seeds the walk with its previous hit.
+            int guess = -1;
+
+            #pragma omp for schedule(static)
+            for(int i=0; i<NNodes; i++) {
+                real_t l[dim+1];
+                guess = locate(new_mesh.get_coords(i), l, guess);
+
+                const index_t *n=_mesh->get_element(guess);
+                for(int k=0; k<nfields; k++) {
+                    real_t f = 0;
+                    for(size_t j=0; j<nloc; j++)
+                        f += l[j]*psi[n[j]*nfields+k];
+                    new_psi[i*nfields+k] = f;
+                }
+            }
+        }
+    }
+
+    /*! Find the elements whose bounding box overlaps the box [lo, hi].
+     * @param lo lower corner of the box.
+     * @param hi upper corner of the box.
+     * @param eids returns the candidate elements.
+     */
+    void query(const real_t *lo, const real_t *hi, std::vector<index_t> &eids) const
+    {
+        eids.clear();
+
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while(top>0) {
+            int k = stack[--top];
+            const real_t *box = &(bbox[k*2*dim]);
+            bool overlap = true;
+            for(int j=0; j<dim; j++)
+                overlap = overlap && box[j]<=hi[j] && lo[j]<=box[dim+j];
+            if(!overlap)
+                continue;
+
+            if(k<(int)nleaves-1) {
+                stack[top++] = 2*k+2;
+                stack[top++] = 2*k+1;
+                continue;
+            }
+
+            size_t leaf = k-(nleaves-1);
+            size_t end = std::min((leaf+1)*leaf_size, sorted.size());
+            for(size_t i=leaf*leaf_size; i<end; i++) {
+                const index_t *n=_mesh->get_element(sorted[i]);
+                bool element_overlap = true;
+                for(int j=0; j<dim && element_overlap; j++) {
+                    real_t elo=DBL_MAX, ehi=-DBL_MAX;
+                    for(size_t v=0; v<nloc; v++) {
+                        real_t x = _mesh->get_coords(n[v])[j];
+                        elo = std::min(elo, x);
+                        ehi = std::max(ehi, x);
+                    }
+                    element_overlap = elo<=hi[j] && lo[j]<=ehi;
+                }
+                if(element_overlap)
+                    eids.push_back(sorted[i]);
+            }
+        }
+    }
+
+    /// Twice the signed area of the triangle x0, x1, x2.
+    inline static real_t orient(const real_t *x0, const real_t *x1, const real_t *x2)
+    {
+        return (x1[0]-x0[0])*(x2[1]-x0[1]) - (x1[1]-x0[1])*(x2[0]-x0[0]);
+    }
+
+    /// Six times the signed volume of the tetrahedron x0, x1, x2, x3.
+    inline static real_t orient(const real_t *x0, const real_t *x1, const real_t *x2, const real_t *x3)
+    {
+        real_t a[] = {x1[0]-x0[0], x1[1]-x0[1], x1[2]-x0[2]};
+        real_t b[] = {x2[0]-x0[0], x2[1]-x0[1], x2[2]-x0[2]};
+        real_t c[] = {x3[0]-x0[0], x3[1]-x0[1], x3[2]-x0[2]};
+
+        return a[0]*(b[1]*c[2]-b[2]*c[1]) - a[1]*(b[0]*c[2]-b[2]*c[0]) + a[2]*(b[0]*c[1]-b[1]*c[0]);
+    }
+
+private:
+    void build()
+    {
+        int NElements = _mesh->get_number_elements();
+
+        std::vector<real_t> centroid(NElements*dim);
+        real_t lo[dim], hi[dim];
+        for(int j=0; j<dim; j++) {
+            lo[j] = DBL_MAX;
+            hi[j] = -DBL_MAX;
+        }
+
+        EEList.resize(NElements*nloc);
+
+        #pragma omp parallel
+        {
+            real_t tlo[dim], thi[dim];
+            for(int j=0; j<dim; j++) {
+                tlo[j] = DBL_MAX;
+                thi[j] = -DBL_MAX;
+            }
+
+            #pragma omp for schedule(guided)
+            for(int e=0; e<NElements; e++) {
+                const index_t *n=_mesh->get_element(e);
+                if(n[0]<0)
+                    continue;
+
+                for(int j=0; j<dim; j++) {
+                    real_t c=0;
+                    for(size_t k=0; k<nloc; k++)
+                        c += _mesh->get_coords(n[k])[j];
+                    c /= nloc;
+                    centroid[e*dim+j] = c;
+                    tlo[j] = std::min(tlo[j], c);
+                    thi[j] = std::max(thi[j], c);
+                }
+
+                // Neighbour across the facet opposite each vertex.
+                for(size_t i=0; i<nloc; i++) {
+                    index_t n0 = n[(i+1)%nloc];
+                    index_t n1 = n[(i+2)%nloc];
+                    index_t n2 = (dim==2)?n1:n[(i+3)%nloc];
+                    index_t neigh = -1;
+                    for(const auto& ie : _mesh->NEList[n0]) {
+                        if(ie!=e && _mesh->NEList[n1].count(ie) && _mesh->NEList[n2].count(ie)) {
+                            neigh = ie;
+                            break;
+                        }
+                    }
+                    EEList[e*nloc+i] = neigh;
+                }
+            }
+
+            #pragma omp critical
+            {
+                for(int j=0; j<dim; j++) {
+                    lo[j] = std::min(lo[j], tlo[j]);
+                    hi[j] = std::max(hi[j], thi[j]);
+                }
+            }
+        }
+
+        // Sort the elements along a Morton curve of their centroids.
+        const int bits = (dim==2)?16:10;
+        std::vector< std::pair<uint64_t, index_t> > codes;
+        codes.reserve(NElements);
+        for(int e=0; e<NElements; e++) {
+            if(_mesh->get_element(e)[0]>=0)
+                codes.push_back(std::pair<uint64_t, index_t>(0, e));
+        }
+        int NActive = codes.size();
+
+        #pragma omp parallel for schedule(static)
+        for(int i=0; i<NActive; i++) {
+            index_t e = codes[i].second;
+            uint64_t q[dim];
+            for(int j=0; j<dim; j++) {
+                real_t extent = hi[j]-lo[j];
+                real_t s = (extent>0)?(centroid[e*dim+j]-lo[j])/extent:0;
+                q[j] = std::min((uint64_t)(s*(1<<bits)), (uint64_t)((1<<bits)-1));
+            }
+            uint64_t code = 0;
+            for(int b=bits-1; b>=0; b--)
+                for(int j=0; j<dim; j++)
+                    code = (code<<1) | ((q[j]>>b)&1);
+            codes[i].first = code;
+        }
+        std::sort(codes.begin(), codes.end());
+
+        sorted.resize(NActive);
+        for(int i=0; i<NActive; i++)
+            sorted[i] = codes[i].second;
+
+        // Implicit complete binary tree over the leaves. Node i has
+        // children 2i+1 and 2i+2, and the leaves are the last nleaves nodes.
+        nleaves = 1;
+        while(nleaves*leaf_size<(size_t)NActive)
+            nleaves *= 2;
+        bbox.resize((2*nleaves-1)*2*dim);
+
+        // Boxes are padded so that points on facets are found despite round-off.
+        real_t pad = 0;
+        for(int j=0; j<dim; j++)
+            pad = std::max(pad, hi[j]-lo[j]);
+        pad = pad*1.0e-10 + DBL_MIN;
+
+        #pragma omp parallel
+        {
+            #pragma omp for schedule(static)
+            for(int k=0; k<(int)nleaves; k++) {
+                real_t *box = &(bbox[(nleaves-1+k)*2*dim]);
+                for(int j=0; j<dim; j++) {
+                    box[j] = DBL_MAX;
+                    box[dim+j] = -DBL_MAX;
+                }
+                size_t end = std::min((k+1)*leaf_size, (size_t)NActive);
+                for(size_t i=k*leaf_size; i<end; i++) {
+                    const index_t *n=_mesh->get_element(sorted[i]);
+                    for(size_t v=0; v<nloc; v++) {
+                        const real_t *x = _mesh->get_coords(n[v]);
+                        for(int j=0; j<dim; j++) {
+                            box[j] = std::min(box[j], x[j]-pad);
+                            box[dim+j] = std::max(box[dim+j], x[j]+pad);
+                        }
+                    }
+                }
+            }
+
+            for(size_t width=nleaves/2; width>0; width/=2) {
+                #pragma omp for schedule(static)
+                for(int k=width-1; k<(int)(2*width-1); k++) {
+                    real_t *box = &(bbox[k*2*dim]);
+                    const real_t *left = &(bbox[(2*k+1)*2*dim]);
+                    const real_t *right = &(bbox[(2*k+2)*2*dim]);
+                    for(int j=0; j<dim; j++) {
+                        box[j] = std::min(left[j], right[j]);
+                        box[dim+j] = std::max(left[dim+j], right[dim+j]);
+                    }
+                }
+            }
+        }
+    }
+
+    /// Barycentric coordinates of x in element eid, returning the smallest.
+    inline real_t barycentric(index_t eid, const real_t *x, real_t *l) const
+    {
+        const index_t *n=_mesh->get_element(eid);
+        const real_t *x0 = _mesh->get_coords(n[0]);
+        const real_t *x1 = _mesh->get_coords(n[1]);
+        const real_t *x2 = _mesh->get_coords(n[2]);
+
+        if(dim==2) {
+            real_t A = orient(x0, x1, x2);
+            l[0] = orient(x, x1, x2)/A;
+            l[1] = orient(x0, x, x2)/A;
+            l[2] = 1.0-l[0]-l[1];
+
+            return std::min(l[0], std::min(l[1], l[2]));
+        } else {
+            const real_t *x3 = _mesh->get_coords(n[3]);
+            real_t V = orient(x0, x1, x2, x3);
+            l[0] = orient(x, x1, x2, x3)/V;
+            l[1] = orient(x0, x, x2, x3)/V;
+            l[2] = orient(x0, x1, x, x3)/V;
+            l[3] = 1.0-l[0]-l[1]-l[2];
+
+            return std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+        }
+    }
+
+    /* Walk from eid towards x, always crossing the facet opposite the
+     * most negative barycentric coordinate. Returns -1 if the walk
+     * leaves the mesh or does not arrive within max_walk steps.
+     */
+    int walk(const real_t *x, real_t *l, index_t eid) const
+    {
+        for(int step=0; step<max_walk; step++) {
+            if(barycentric(eid, x, l)>=-tol)
+                return eid;
+
+            size_t i = std::min_element(l, l+nloc)-l;
+            eid = EEList[eid*nloc+i];
+            if(eid<0)
+                break;
+        }
+
+        return -1;
+    }
+
+    /// Search the tree for x.
+    int search(const real_t *x, real_t *l) const
+    {
+        int best_e = -1;
+        real_t best_l = -DBL_MAX;
+        real_t ll[dim+1];
+
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while(top>0) {
+            int k = stack[--top];
+            const real_t *box = &(bbox[k*2*dim]);
+            bool inside = true;
+            for(int j=0; j<dim; j++)
+                inside = inside && box[j]<=x[j] && x[j]<=box[dim+j];
+            if(!inside)
+                continue;
+
+            if(k<(int)nleaves-1) {
+                stack[top++] = 2*k+2;
+                stack[top++] = 2*k+1;
+                continue;
+            }
+
+            size_t leaf = k-(nleaves-1);
+            size_t end = std::min((leaf+1)*leaf_size, sorted.size());
+            for(size_t i=leaf*leaf_size; i<end; i++) {
+                real_t min_l = barycentric(sorted[i], x, ll);
+                if(min_l>best_l) {
+                    best_l = min_l;
+                    best_e = sorted[i];
+                    for(size_t j=0; j<nloc; j++)
+                        l[j] = ll[j];
+                    if(best_l>=-tol)
+                        return best_e;
+                }
+            }
+        }
+
+        if(best_e<0) {
+            // x is outside every box, so fall back to the nearest centroid.
+            real_t best_d = DBL_MAX;
+            for(size_t i=0; i<sorted.size(); i++) {
+                const index_t *n=_mesh->get_element(sorted[i]);
+                real_t d = 0;
+                for(int j=0; j<dim; j++) {
+                    real_t c = 0;
+                    for(size_t v=0; v<nloc; v++)
+                        c += _mesh->get_coords(n[v])[j];
+                    c = c/nloc-x[j];
+                    d += c*c;
+                }
+                if(d<best_d) {
+                    best_d = d;
+                    best_e = sorted[i];
+                }
+            }
+            if(best_e<0)
+                return -1;
+            barycentric(best_e, x, l);
+        }
+
+        // Clamp to the element so that values are not extrapolated.
+        real_t sum = 0;
+        for(size_t j=0; j<nloc; j++) {
+            l[j] = std::max(l[j], (real_t)0.0);
+            sum += l[j];
+        }
+        for(size_t j=0; j<nloc; j++)
+            l[j] /= sum;
+
+        return best_e;
+    }
+
+    const Mesh<real_t> *_mesh;
+    const size_t nloc;
+
+    static const size_t leaf_size = 8;
+    static const int max_walk = 64;
+    static constexpr real_t tol = 1.0e-12;
+
+    // Active elements in Morton order.
+    std::vector<index_t> sorted;
+
+    // Bounding boxes (min then max corner) of the tree nodes.
+    std::vector<real_t> bbox;
+    size_t nleaves;
+
+    // Element-element adjacency; entry i is the neighbour opposite vertex i.
+    std::vector<index_t> EEList;
+};
+
+#endif
@@ -520,6 +520,264 @@ public:
         return;
     }
 
+    /*! Evaluates the 2D Lipnikov functional together with its analytic
+     * gradient and Hessian with respect to the position of the first
+     * vertex. The metric is held fixed.
+     *
+     * @param x0 pointer to 2D position for first point in triangle.
+     * @param x1 pointer to 2D position for second point in triangle.
+     * @param x2 pointer to 2D position for third point in triangle.
+     * @param m metric tensor averaged over the triangle.
+     * @param grad returns dq/dx0.
+     * @param hess returns d2q/dx0^2 (2x2, row major).
+     * @return quality of the triangle.
+     */
+    inline double lipnikov_hessian(const real_t *x0, const real_t *x1, const real_t *x2,
+                                   const double *m, double *grad, double *hess) const
+    {
+        // The area is linear in x0.
+        double a = orientation*inv2*((x0[1]-x2[1])*(x0[0]-x1[0]) - (x0[1]-x1[1])*(x0[0]-x2[0]));
+        double da[] = {orientation*inv2*(x1[1]-x2[1]), orientation*inv2*(x2[0]-x1[0])};
+
+        // Perimeter in metric space; only the two edges meeting at x0 vary.
+        double l = length2d(x1, x2, m);
+        double dl[] = {0, 0}, d2l[] = {0, 0, 0, 0};
+        const real_t *xe[] = {x1, x2};
+        for(int e=0; e<2; e++) {
+            double d[] = {x0[0]-xe[e][0], x0[1]-xe[e][1]};
+            double Md[] = {m[0]*d[0] + m[1]*d[1], m[1]*d[0] + m[2]*d[1]};
+            double L = sqrt(d[0]*Md[0] + d[1]*Md[1]);
+            l += L;
+
+            const double Mm[] = {m[0], m[1], m[1], m[2]};
+            for(int i=0; i<2; i++) {
+                dl[i] += Md[i]/L;
+                for(int j=0; j<2; j++)
+                    d2l[i*2+j] += (Mm[i*2+j] - Md[i]*Md[j]/(L*L))/L;
+            }
+        }
+
+        double dphi, d2phi;
+        double phi = lipnikov_phi(l, 3.0, 2, dphi, d2phi);
+        double w = lipnikov_const2d*sqrt(m[0]*m[2] - m[1]*m[1]);
+
+        for(int i=0; i<2; i++) {
+            grad[i] = w*(phi*da[i] + a*dphi*dl[i]);
+            for(int j=0; j<2; j++)
+                hess[i*2+j] = w*(dphi*(da[i]*dl[j] + dl[i]*da[j]) + a*d2phi*dl[i]*dl[j] + a*dphi*d2l[i*2+j]);
+        }
+
+        return w*a*phi;
+    }
+
+    /*! Evaluates the 3D Lipnikov functional together with its analytic
+     * gradient and Hessian with respect to the position of the first
+     * vertex. The metric is held fixed.
+     *
+     * @param x0 pointer to 3D position for first point in tetrahedron.
+     * @param x1 pointer to 3D position for second point in tetrahedron.
+     * @param x2 pointer to 3D position for third point in tetrahedron.
+     * @param x3 pointer to 3D position for forth point in tetrahedron.
+     * @param m metric tensor averaged over the tetrahedron.
+     * @param grad returns dq/dx0.
+     * @param hess returns d2q/dx0^2 (3x3, row major).
+     * @return quality of the tetrahedron.
+     */
+    inline double lipnikov_hessian(const real_t *x0, const real_t *x1, const real_t *x2, const real_t *x3,
+                                   const double *m, double *grad, double *hess) const
+    {
+        // The volume is linear in x0; its gradient is normal to the opposite face.
+        double v = volume(x0, x1, x2, x3);
+        double e1[] = {x2[0]-x1[0], x2[1]-x1[1], x2[2]-x1[2]};
+        double e2[] = {x3[0]-x1[0], x3[1]-x1[1], x3[2]-x1[2]};
+        double dv[] = {-orientation*inv6*(e1[1]*e2[2] - e1[2]*e2[1]),
+                       -orientation*inv6*(e1[2]*e2[0] - e1[0]*e2[2]),
+                       -orientation*inv6*(e1[0]*e2[1] - e1[1]*e2[0])
+                      };
+
+        // Sum of edge lengths in metric space; only the three edges meeting at x0 vary.
+        double l = length3d(x1, x2, m) + length3d(x1, x3, m) + length3d(x2, x3, m);
+        double dl[] = {0, 0, 0}, d2l[] = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+        const double Mm[] = {m[0], m[1], m[2],
+                             m[1], m[3], m[4],
+                             m[2], m[4], m[5]
+                            };
+        const real_t *xe[] = {x1, x2, x3};
+        for(int e=0; e<3; e++) {
+            double d[] = {x0[0]-xe[e][0], x0[1]-xe[e][1], x0[2]-xe[e][2]};
+            double Md[3];
+            for(int i=0; i<3; i++)
+                Md[i] = Mm[i*3]*d[0] + Mm[i*3+1]*d[1] + Mm[i*3+2]*d[2];
+            double L = sqrt(d[0]*Md[0] + d[1]*Md[1] + d[2]*Md[2]);
+            l += L;
+
+            for(int i=0; i<3; i++) {
+                dl[i] += Md[i]/L;
+                for(int j=0; j<3; j++)
+                    d2l[i*3+j] += (Mm[i*3+j] - Md[i]*Md[j]/(L*L))/L;
+            }
+        }
+
+        double dphi, d2phi;
+        double phi = lipnikov_phi(l, 6.0, 3, dphi, d2phi);
+        double w = lipnikov_const3d*sqrt(((m[3]*m[5] - m[4]*m[4])*m[0] - (m[1]*m[5] - m[2]*m[4])*m[1] + (m[1]*m[4] - m[2]*m[3])*m[2]));
+
+        for(int i=0; i<3; i++) {
+            grad[i] = w*(phi*dv[i] + v*dphi*dl[i]);
+            for(int j=0; j<3; j++)
+                hess[i*3+j] = w*(dphi*(dv[i]*dl[j] + dl[i]*dv[j]) + v*d2phi*dl[i]*dl[j] + v*dphi*d2l[i*3+j]);
+        }
+
+        return w*v*phi;
+    }
+
+    /// Maximum number of elements evaluated together by lipnikov_block2d/3d.
+    static const int lipnikov_block = 32;
+
+    /*! Store the metric averaged over a triangle in column e of m, the
+     * layout expected by lipnikov_block2d.
+     */
+    inline void lipnikov_block_metric(double m[][lipnikov_block], int e,
+                                      const double *m0, const double *m1, const double *m2) const
+    {
+        for(int k=0; k<3; k++)
+            m[k][e] = (m0[k] + m1[k] + m2[k])*inv3;
+    }
+
+    /*! Store the metric averaged over a tetrahedron in column e of m, the
+     * layout expected by lipnikov_block3d.
+     */
+    inline void lipnikov_block_metric(double m[][lipnikov_block], int e,
+                                      const double *m0, const double *m1, const double *m2, const double *m3) const
+    {
+        for(int k=0; k<6; k++)
+            m[k][e] = (m0[k] + m1[k] + m2[k] + m3[k])*inv4;
+    }
+
+    /*! Evaluates the 2D Lipnikov functional for a block of triangles
+     * stored as a structure of arrays, so that the loop over elements
+     * vectorises. Gives the same result as lipnikov() element by element.
+     *
+     * @param n number of triangles, at most lipnikov_block.
+     * @param x x[2*i+d][e] is coordinate d of vertex i of triangle e.
+     * @param m m[k][e] is component k of the metric averaged over triangle e.
+     * @param q returns the quality of each triangle.
+     * @return minimum quality of the block.
+     */
+    inline double lipnikov_block2d(int n, const double x[][lipnikov_block], const double m[][lipnikov_block],
+                                   double *q) const
+    {
+        #pragma omp simd
+        for(int e=0; e<n; e++) {
+            double m00 = m[0][e];
+            double m01 = m[1][e];
+            double m11 = m[2][e];
+
+            double x01 = x[0][e] - x[2][e];
+            double y01 = x[1][e] - x[3][e];
+            double x02 = x[0][e] - x[4][e];
+            double y02 = x[1][e] - x[5][e];
+            double x21 = x[4][e] - x[2][e];
+            double y21 = x[5][e] - x[3][e];
+
+            double l =
+                sqrt(y01*(y01*m11 + x01*m01) +
+                     x01*(y01*m01 + x01*m00))+
+                sqrt(y02*(y02*m11 + x02*m01) +
+                     x02*(y02*m01 + x02*m00))+
+                sqrt(y21*(y21*m11 + x21*m01) +
+                     x21*(y21*m01 + x21*m00));
+
+            double invl = 1.0/l;
+
+            double a=orientation*inv2*(y02*x01 - y01*x02);
+            double a_m = a*sqrt(m00*m11 - m01*m01);
+
+            double f = std::min(l*inv3, 3.0*invl);
+            double tf = f * (2.0 - f);
+            double F = tf*tf*tf;
+            q[e] = lipnikov_const2d*a_m*F*invl*invl;
+        }
+
+        double qmin = DBL_MAX;
+        for(int e=0; e<n; e++)
+            qmin = std::min(qmin, q[e]);
+
+        return qmin;
+    }
+
+    /*! Evaluates the 3D Lipnikov functional for a block of tetrahedra
+     * stored as a structure of arrays, so that the loop over elements
+     * vectorises. Gives the same result as lipnikov() element by element.
+     *
+     * @param n number of tetrahedra, at most lipnikov_block.
+     * @param x x[3*i+d][e] is coordinate d of vertex i of tetrahedron e.
+     * @param m m[k][e] is component k of the metric averaged over tetrahedron e.
+     * @param q returns the quality of each tetrahedron.
+     * @return minimum quality of the block.
+     */
+    inline double lipnikov_block3d(int n, const double x[][lipnikov_block], const double m[][lipnikov_block],
+                                   double *q) const
+    {
+        #pragma omp simd
+        for(int e=0; e<n; e++) {
+            double m00 = m[0][e];
+            double m01 = m[1][e];
+            double m02 = m[2][e];
+            double m11 = m[3][e];
+            double m12 = m[4][e];
+            double m22 = m[5][e];
+
+            double z01 = (x[2][e] - x[5][e]);
+            double y01 = (x[1][e] - x[4][e]);
+            double x01 = (x[0][e] - x[3][e]);
+
+            double z12 = (x[5][e] - x[8][e]);
+            double y12 = (x[4][e] - x[7][e]);
+            double x12 = (x[3][e] - x[6][e]);
+
+            double z02 = (x[2][e] - x[8][e]);
+            double y02 = (x[1][e] - x[7][e]);
+            double x02 = (x[0][e] - x[6][e]);
+
+            double z03 = (x[2][e] - x[11][e]);
+            double y03 = (x[1][e] - x[10][e]);
+            double x03 = (x[0][e] - x[9][e]);
+
+            double z13 = (x[5][e] - x[11][e]);
+            double y13 = (x[4][e] - x[10][e]);
+            double x13 = (x[3][e] - x[9][e]);
+
+            double z23 = (x[8][e] - x[11][e]);
+            double y23 = (x[7][e] - x[10][e]);
+            double x23 = (x[6][e] - x[9][e]);
+
+            double dl0 = (z01*(z01*m22 + y01*m12 + x01*m02) + y01*(z01*m12 + y01*m11 + x01*m01) + x01*(z01*m02 + y01*m01 + x01*m00));
+            double dl1 = (z12*(z12*m22 + y12*m12 + x12*m02) + y12*(z12*m12 + y12*m11 + x12*m01) + x12*(z12*m02 + y12*m01 + x12*m00));
+            double dl2 = (z02*(z02*m22 + y02*m12 + x02*m02) + y02*(z02*m12 + y02*m11 + x02*m01) + x02*(z02*m02 + y02*m01 + x02*m00));
+            double dl3 = (z03*(z03*m22 + y03*m12 + x03*m02) + y03*(z03*m12 + y03*m11 + x03*m01) + x03*(z03*m02 + y03*m01 + x03*m00));
+            double dl4 = (z13*(z13*m22 + y13*m12 + x13*m02) + y13*(z13*m12 + y13*m11 + x13*m01) + x13*(z13*m02 + y13*m01 + x13*m00));
+            double dl5 = (z23*(z23*m22 + y23*m12 + x23*m02) + y23*(z23*m12 + y23*m11 + x23*m01) + x23*(z23*m02 + y23*m01 + x23*m00));
+
+            double l = sqrt(dl0)+sqrt(dl1)+sqrt(dl2)+sqrt(dl3)+sqrt(dl4)+sqrt(dl5);
+            double invl = 1.0/l;
+
+            double v=orientation*inv6*(-x03*(z02*y01 - z01*y02) + x02*(z03*y01 - z01*y03) - x01*(z03*y02 - z02*y03));
+            double v_m = v*sqrt(((m11*m22 - m12*m12)*m00 - (m01*m22 - m02*m12)*m01 + (m01*m12 - m02*m11)*m02));
+
+            double f = std::min(l*inv6, 6*invl);
+            double tf = f * (2.0 - f);
+            double F = tf*tf*tf;
+            q[e] = lipnikov_const3d * v_m * F *invl*invl*invl;
+        }
+
+        double qmin = DBL_MAX;
+        for(int e=0; e<n; e++)
+            qmin = std::min(qmin, q[e]);
+
+        return qmin;
+    }
+
     /*! Evaluates the sliver functional. Taken from Computer Methods in
      * Applied Mechanics and Engineering Volume 194, Issues 48-49, 15
      * November 2005, Pages 4915-4950
@@ -757,6 +1015,41 @@ public:
     }
 
 private:
+    /* Length dependent factor of the Lipnikov functional,
+     * phi(l) = F(f)/l^k with f = min(l/c, c/l) and F(f) = (f(2-f))^3,
+     * and its first and second derivatives with respect to l.
+     */
+    inline double lipnikov_phi(double l, double c, int k, double &dphi, double &d2phi) const
+    {
+        double f, df, d2f;
+        if(l<c) {
+            f = l/c;
+            df = 1.0/c;
+            d2f = 0.0;
+        } else {
+            f = c/l;
+            df = -c/(l*l);
+            d2f = 2.0*c/(l*l*l);
+        }
+
+        double g = f*(2.0-f), dg = 2.0-2.0*f;
+        double F = g*g*g;
+        double dF = 3.0*g*g*dg;
+        double d2F = 6.0*g*dg*dg - 6.0*g*g;
+
+        double dpsi = dF*df;
+        double d2psi = d2F*df*df + dF*d2f;
+
+        double P = pow(l, -k);
+        double dP = -k*P/l;
+        double d2P = k*(k+1)*P/(l*l);
+
+        dphi = dpsi*P + F*dP;
+        d2phi = d2psi*P + 2.0*dpsi*dP + F*d2P;
+
+        return F*P;
+    }
+
     const double inv2;
     const double inv3;
     const double inv4;
@@ -161,9 +161,9 @@ public:
         printf("  %%%% %s opened\n",fileName);
 
         if (dim == 2)
-            export_gmf_mesh2d(meshIndex, mesh);
+            export_gmf_mesh2d(meshIndex, mesh, gmfVersion);
         else if (dim == 3)
-            export_gmf_mesh3d(meshIndex, mesh);
+            export_gmf_mesh3d(meshIndex, mesh, gmfVersion);
         else {
             exit(45);
         }
@@ -189,7 +189,7 @@ public:
         }
         printf("  %%%% %s opened\n",fileName);
 
-        export_gmf_metric2d(solIndex, metric, mesh);
+        export_gmf_metric2d(solIndex, metric, mesh, gmfVersion);
     }
 
 
@@ -212,7 +212,7 @@ public:
         }
         printf("  %%%% %s opened\n",fileName);
 
-        export_gmf_metric3d(solIndex, metric, mesh);
+        export_gmf_metric3d(solIndex, metric, mesh, gmfVersion);
     }
 
 
@@ -221,62 +221,32 @@ private:
 
     static Mesh<real_t>* import_gmf_mesh2d(long long meshIndex, int gmfVersion)
     {
-        int                  tag;
-        std::vector<real_t>  x, y;
-        std::vector<int>     ENList;
-        index_t              NNodes, NElements, NFacets, bufTri[3], bufFac[2];
+        std::vector<real_t>  x, y, z;
+        std::vector<index_t> ENList, tags;
         std::vector<index_t> facets, ids;
-        double               bufDbl[2];
-        float                bufFlt[2];
+        index_t              NNodes, NElements, NFacets;
         Mesh<real_t>         *mesh=NULL;
 
-
         NNodes    = GmfStatKwd(meshIndex, GmfVertices);
         NElements = GmfStatKwd(meshIndex, GmfTriangles);
         NFacets   = GmfStatKwd(meshIndex, GmfEdges);
-        x.reserve(NNodes);
-        y.reserve(NNodes);
-        ENList.reserve(3*NElements);
-        facets.reserve(2*NFacets);
-        ids.reserve(NFacets);
 
         if (NNodes <= 0 ) {
             fprintf(stderr, "####  ERROR  Number of vertices: %d <= 0\n", NNodes);
             exit(1);
         }
 
-        GmfGotoKwd(meshIndex, GmfVertices);
-        if (gmfVersion == GmfFloat) {
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(meshIndex, GmfVertices, &bufFlt[0], &bufFlt[1], &tag);
-                x.push_back((real_t)bufFlt[0]);
-                y.push_back((real_t)bufFlt[1]);
-            }
-        }
-        else if (gmfVersion == GmfFloat) {
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(meshIndex, GmfVertices, &bufDbl[0], &bufDbl[1], &tag);
-                x.push_back((real_t)bufDbl[0]);
-                y.push_back((real_t)bufDbl[1]);
-            }
-        }
-        else
-            exit(72);
-
-        GmfGotoKwd(meshIndex, GmfTriangles);
-        for (index_t i=0; i<NElements; i++) {
-            GmfGetLin(meshIndex, GmfTriangles, &bufTri[0], &bufTri[1], &bufTri[2], &tag);
-            for(int j=0; j<3; j++)
-                ENList.push_back(bufTri[j]-1);
+        if (gmfVersion == GmfFloat)
+            get_vertices<float>(meshIndex, 2, NNodes, GmfFloat, x, y, z);
+        else if (gmfVersion == GmfDouble)
+            get_vertices<double>(meshIndex, 2, NNodes, GmfDouble, x, y, z);
+        else {
+            fprintf(stderr, "Wrong GmfVersion: %d\n", gmfVersion);
+            exit(1);
         }
 
-        GmfGotoKwd(meshIndex, GmfEdges);
-        for (index_t i=0; i<NFacets; i++) {
-            GmfGetLin(meshIndex, GmfEdges, &bufFac[0], &bufFac[1], &tag);
-            facets.push_back(bufFac[0]-1);
-            facets.push_back(bufFac[1]-1);
-            ids.push_back(tag);
-        }
+        get_elements(meshIndex, GmfTriangles, 3, NElements, ENList, tags);
+        get_elements(meshIndex, GmfEdges, 2, NFacets, facets, ids);
 
         GmfCloseMesh(meshIndex);
 
@@ -290,68 +260,32 @@ private:
 
     static Mesh<real_t>* import_gmf_mesh3d(long long meshIndex, int gmfVersion)
     {
-        int                  tag;
         std::vector<real_t>  x, y, z;
-        std::vector<int>     ENList;
-        index_t              NNodes, NElements, NFacets, bufTet[4], bufFac[3];
+        std::vector<index_t> ENList, tags;
         std::vector<index_t> facets, ids;
-        double               bufDbl[3];
-        float                bufFlt[3];
+        index_t              NNodes, NElements, NFacets;
         Mesh<real_t>         *mesh=NULL;
 
-
         NNodes    = GmfStatKwd(meshIndex, GmfVertices);
         NElements = GmfStatKwd(meshIndex, GmfTetrahedra);
         NFacets   = GmfStatKwd(meshIndex, GmfTriangles);
-        x.reserve(NNodes);
-        y.reserve(NNodes);
-        z.reserve(NNodes);
-        ENList.reserve(3*NElements);
-        facets.reserve(3*NFacets);
-        ids.reserve(NFacets);
 
         if (NNodes <= 0 ) {
             fprintf(stderr, "####  ERROR  Number of vertices: %d <= 0\n", NNodes);
             exit(1);
         }
 
-        GmfGotoKwd(meshIndex, GmfVertices);
-        if (gmfVersion == GmfFloat) {
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(meshIndex, GmfVertices, &bufFlt[0], &bufFlt[1], &bufFlt[2], &tag);
-                x.push_back((real_t)bufFlt[0]);
-                y.push_back((real_t)bufFlt[1]);
-                z.push_back((real_t)bufFlt[2]);
-            }
-        }
-        else if (gmfVersion == GmfDouble) {
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(meshIndex, GmfVertices, &bufDbl[0], &bufDbl[1], &bufDbl[2], &tag);
-                x.push_back((real_t)bufDbl[0]);
-                y.push_back((real_t)bufDbl[1]);
-                z.push_back((real_t)bufDbl[2]);
-            }
-        }
+        if (gmfVersion == GmfFloat)
+            get_vertices<float>(meshIndex, 3, NNodes, GmfFloat, x, y, z);
+        else if (gmfVersion == GmfDouble)
+            get_vertices<double>(meshIndex, 3, NNodes, GmfDouble, x, y, z);
         else {
             fprintf(stderr, "Wrong GmfVersion: %d\n", gmfVersion);
             exit(1);
         }
 
-        GmfGotoKwd(meshIndex, GmfTetrahedra);
-        for (index_t i=0; i<NElements; i++) {
-            GmfGetLin(meshIndex, GmfTetrahedra,
-                      &bufTet[0], &bufTet[1], &bufTet[2], &bufTet[3], &tag);
-            for (int j=0; j<4; j++)
-                ENList.push_back(bufTet[j]-1);
-        }
-
-        GmfGotoKwd(meshIndex, GmfTriangles);
-        for (index_t i=0; i<NFacets; i++) {
-            GmfGetLin(meshIndex, GmfTriangles, &bufFac[0], &bufFac[1], &bufFac[2], &tag);
-            for (int j=0; j<3; ++j)
-                facets.push_back(bufFac[j]-1);
-            ids.push_back(tag);
-        }
+        get_elements(meshIndex, GmfTetrahedra, 4, NElements, ENList, tags);
+        get_elements(meshIndex, GmfTriangles, 3, NFacets, facets, ids);
 
         GmfCloseMesh(meshIndex);
 
@@ -364,15 +298,13 @@ private:
 
 
 
-    static MetricField<real_t,2>* import_gmf_metric2d(long long solIndex,
-                                                  Mesh<real_t> &mesh, int gmfVersion)
+    template<int dim>
+    static MetricField<real_t,dim>* import_gmf_metric(long long solIndex,
+                                                      Mesh<real_t> &mesh, int gmfVersion)
     {
         int numSolAtVerticesLines, numSolTypes, solSize, NNodes;
         int solTypesTable[GmfMaxTyp];
-        double bufDbl[3];
-        float  bufFlt[3];
-        real_t buf[3];
-        MetricField<real_t,2> *metric;
+        MetricField<real_t,dim> *metric;
 
         numSolAtVerticesLines = GmfStatKwd(solIndex, GmfSolAtVertices,
                                            &numSolTypes, &solSize, solTypesTable);
@@ -390,24 +322,13 @@ private:
             printf("####  ERROR  Solution field is not a metric. solType: %d\n",
                    solTypesTable[0]);
 
-        metric = new MetricField<real_t,2>(mesh);
+        metric = new MetricField<real_t,dim>(mesh);
         metric->alloc_metric();
 
-        GmfGotoKwd(solIndex, GmfSolAtVertices);
-        if (gmfVersion == GmfFloat){
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(solIndex, GmfSolAtVertices, bufFlt);
-                for (int j=0; j<3; ++j) buf[j] = (real_t)bufFlt[j];
-                metric->set_metric(buf, i);
-            }
-        }
-        else if (gmfVersion == GmfDouble) {
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(solIndex, GmfSolAtVertices, bufDbl);
-                for (int j=0; j<3; ++j) buf[j] = (real_t)bufDbl[j];
-                metric->set_metric(buf, i);
-            }
-        }
+        if (gmfVersion == GmfFloat)
+            get_metric<float>(solIndex, NNodes, solSize, GmfFloatVec, metric);
+        else if (gmfVersion == GmfDouble)
+            get_metric<double>(solIndex, NNodes, solSize, GmfDoubleVec, metric);
         else {
             fprintf(stderr, "Wrong GmfVersion: %d\n", gmfVersion);
             exit(1);
@@ -420,92 +341,39 @@ private:
 
 
 
-    static MetricField<real_t,3>* import_gmf_metric3d(long long solIndex,
+    static MetricField<real_t,2>* import_gmf_metric2d(long long solIndex,
                                                   Mesh<real_t> &mesh, int gmfVersion)
     {
-        int numSolAtVerticesLines, numSolTypes, solSize, NNodes;
-        int solTypesTable[GmfMaxTyp];
-        double bufDbl[6];
-        float  bufFlt[6];
-        real_t buf[6];
-        MetricField<real_t,3> *metric;
-
-        numSolAtVerticesLines = GmfStatKwd(solIndex, GmfSolAtVertices,
-                                           &numSolTypes, &solSize, solTypesTable);
-
-        NNodes = mesh.get_number_nodes();
-        if (numSolAtVerticesLines != NNodes) {
-            printf("####  ERROR  Number of solution lines != number of mesh vertices: %d != %d\n",
-                    numSolAtVerticesLines, NNodes);
-            exit(1);
-        }
-        if (numSolTypes > 1)
-            printf("####  Warning  Several sol. fields in file. Reading only the 1st one (type %d)\n",
-                   solTypesTable[0]);
-        if (solTypesTable[0] != 3)
-            printf("####  ERROR  Solution field is not a metric. solType: %d\n",
-                   solTypesTable[0]);
-
-        metric = new MetricField<real_t,3>(mesh);
-        metric->alloc_metric();
+        return import_gmf_metric<2>(solIndex, mesh, gmfVersion);
+    }
 
-        GmfGotoKwd(solIndex, GmfSolAtVertices);
-        if (gmfVersion == GmfFloat){
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(solIndex, GmfSolAtVertices, bufFlt);
-                for (int j=0; j<6; ++j) buf[j] = (real_t)bufFlt[j];
-                metric->set_metric(buf, i);
-            }
-        }
-        else if (gmfVersion == GmfDouble) {
-            for (index_t i=0; i<NNodes; i++) {
-                GmfGetLin(solIndex, GmfSolAtVertices, bufDbl);
-                for (int j=0; j<6; ++j) buf[j] = (real_t)bufDbl[j];
-                metric->set_metric(buf, i);
-            }
-        }
-        else {
-            fprintf(stderr, "Wrong GmfVersion: %d\n", gmfVersion);
-            exit(1);
-        }
 
-        GmfCloseMesh(solIndex);
 
-        return metric;
+    static MetricField<real_t,3>* import_gmf_metric3d(long long solIndex,
+                                                  Mesh<real_t> &mesh, int gmfVersion)
+    {
+        return import_gmf_metric<3>(solIndex, mesh, gmfVersion);
     }
 
 
 
-    static void export_gmf_mesh2d(long long meshIndex, Mesh<real_t> *mesh)
+    static void export_gmf_mesh2d(long long meshIndex, Mesh<real_t> *mesh, int gmfVersion)
     {
-        int             tag, NFacets;
-        index_t         NElements, NNodes;
-        const real_t    *coords;
-        const int       *tri, *fac, * facets, * ids;
+        int             NFacets;
+        index_t         NElements;
+        const int       *facets, *ids;
 
         NElements = mesh->get_number_elements();
-        NNodes = mesh->get_number_nodes();
 
-        GmfSetKwd(meshIndex, GmfVertices, NNodes);
-        tag = 0;
-        for (index_t i=0; i<NNodes; i++) {
-            coords = mesh->get_coords(i);
-            GmfSetLin(meshIndex, GmfVertices, coords[0], coords[1], tag);
-        }
+        if (gmfVersion == GmfFloat)
+            set_vertices<float>(meshIndex, mesh, GmfFloat);
+        else
+            set_vertices<double>(meshIndex, mesh, GmfDouble);
 
-        GmfSetKwd(meshIndex, GmfTriangles, NElements);
-        tag = 0;
-        for (index_t i=0; i<NElements; i++) {
-            tri = mesh->get_element(i);
-            GmfSetLin(meshIndex, GmfTriangles, tri[0]+1, tri[1]+1, tri[2]+1, tag);
-        }
+        set_elements(meshIndex, GmfTriangles, 3, NElements, mesh->get_element(0), NULL);
 
         mesh->get_boundary(&NFacets, &facets, &ids);
-        GmfSetKwd(meshIndex, GmfEdges, NFacets);
-        for (index_t i=0; i<NFacets; i++) {
-            fac = &facets[2*i];
-            tag = ids[i];
-        }
+        set_elements(meshIndex, GmfEdges, 2, NFacets, facets, ids);
 
         GmfCloseMesh(meshIndex);
 
@@ -515,77 +383,260 @@ private:
 
 
 
-    static void export_gmf_mesh3d(long long meshIndex, Mesh<real_t> *mesh)
+    static void export_gmf_mesh3d(long long meshIndex, Mesh<real_t> *mesh, int gmfVersion)
     {
-        int             tag, NFacets;
-        index_t         NElements, NNodes;
-        const real_t    *coords;
-        const int       *tet, *fac, * facets, * ids;
-
+        int             NFacets;
+        index_t         NElements;
+        const int       *facets, *ids;
 
         NElements = mesh->get_number_elements();
-        NNodes = mesh->get_number_nodes();
 
-        GmfSetKwd(meshIndex, GmfVertices, NNodes);
-        tag = 0;
-        for (index_t i=0; i<NNodes; i++) {
-            coords = mesh->get_coords(i);
-            GmfSetLin(meshIndex, GmfVertices, coords[0], coords[1], coords[2], tag);
-        }
+        if (gmfVersion == GmfFloat)
+            set_vertices<float>(meshIndex, mesh, GmfFloat);
+        else
+            set_vertices<double>(meshIndex, mesh, GmfDouble);
 
-        GmfSetKwd(meshIndex, GmfTetrahedra, NElements);
-        tag = 0;
-        for (index_t i=0; i<NElements; i++) {
-            tet = mesh->get_element(i);
-            GmfSetLin(meshIndex, GmfTetrahedra, tet[0]+1, tet[1]+1, tet[2]+1,
-                                                tet[3]+1, tag);
-        }
+        set_elements(meshIndex, GmfTetrahedra, 4, NElements, mesh->get_element(0), NULL);
 
         mesh->get_boundary(&NFacets, &facets, &ids);
-        GmfSetKwd(meshIndex, GmfTriangles, NFacets);
-        for (index_t i=0; i<NFacets; i++) {
-            fac = &facets[3*i];
-            tag = ids[i];
-            GmfSetLin(meshIndex, GmfTriangles, fac[0]+1, fac[1]+1, fac[2]+1, tag);
-        }
+        set_elements(meshIndex, GmfTriangles, 3, NFacets, facets, ids);
 
         GmfCloseMesh(meshIndex);
+
+        if (facets) free((int*)facets);
+        if (ids) free((int*)ids);
     }
 
 
 
-    static void export_gmf_metric2d(long long solIndex,
-                                            MetricField<real_t,2> *metric,
-                                            Mesh<real_t> *mesh)
+    template<int dim>
+    static void export_gmf_metric(long long solIndex,
+                                  MetricField<real_t,dim> *metric,
+                                  Mesh<real_t> *mesh, int gmfVersion)
     {
         index_t         NNodes;
         int             solTypes = 3;
-        const real_t    *met;
 
         NNodes = mesh->get_number_nodes();
         GmfSetKwd(solIndex, GmfSolAtVertices, NNodes, 1, &solTypes);
-        for (index_t i=0; i<NNodes; i++) {
-            met = metric->get_metric(i);
-            GmfSetLin(solIndex, GmfSolAtVertices, met);
-        }
+        if (gmfVersion == GmfFloat)
+            set_metric<float>(solIndex, NNodes, GmfFloatVec, metric);
+        else
+            set_metric<double>(solIndex, NNodes, GmfDoubleVec, metric);
         GmfCloseMesh(solIndex);
     }
 
+
+
+    static void export_gmf_metric2d(long long solIndex,
+                                            MetricField<real_t,2> *metric,
+                                            Mesh<real_t> *mesh, int gmfVersion)
+    {
+        export_gmf_metric<2>(solIndex, metric, mesh, gmfVersion);
+    }
+
     static void export_gmf_metric3d(long long solIndex,
                                             MetricField<real_t,3> *metric,
-                                            Mesh<real_t> *mesh)
+                                            Mesh<real_t> *mesh, int gmfVersion)
     {
-        index_t         NNodes;
-        int             solTypes = 3;
-        const real_t    *met;
+        export_gmf_metric<3>(solIndex, metric, mesh, gmfVersion);
+    }
 
-        NNodes = mesh->get_number_nodes();
-        GmfSetKwd(solIndex, GmfSolAtVertices, NNodes, 1, &solTypes);
+
+
+    /*! Read all the vertices with a single block access in the precision
+     * of the file, then convert them to real_t in parallel.
+     */
+    template<typename gmf_real_t>
+    static void get_vertices(long long meshIndex, int dim, index_t NNodes, int gmfType,
+                             std::vector<real_t> &x, std::vector<real_t> &y, std::vector<real_t> &z)
+    {
+        std::vector<gmf_real_t> buf(dim*NNodes);
+        std::vector<int>        tags(NNodes);
+        index_t                 last = NNodes-1;
+
+        if (dim == 2)
+            GmfGetBlock(meshIndex, GmfVertices, 1, NNodes, 0, NULL, NULL,
+                        gmfType, &buf[0], &buf[2*last],
+                        gmfType, &buf[1], &buf[2*last+1],
+                        GmfInt, &tags[0], &tags[last]);
+        else
+            GmfGetBlock(meshIndex, GmfVertices, 1, NNodes, 0, NULL, NULL,
+                        gmfType, &buf[0], &buf[3*last],
+                        gmfType, &buf[1], &buf[3*last+1],
+                        gmfType, &buf[2], &buf[3*last+2],
+                        GmfInt, &tags[0], &tags[last]);
+
+        x.resize(NNodes);
+        y.resize(NNodes);
+        if (dim == 3)
+            z.resize(NNodes);
+
+        #pragma omp parallel for schedule(static)
         for (index_t i=0; i<NNodes; i++) {
-            met = metric->get_metric(i);
-            GmfSetLin(solIndex, GmfSolAtVertices, met);
+            x[i] = (real_t)buf[dim*i];
+            y[i] = (real_t)buf[dim*i+1];
+            if (dim == 3)
+                z[i] = (real_t)buf[dim*i+2];
         }
-        GmfCloseMesh(solIndex);
+    }
+
+
+
+    /*! Read all the elements of a keyword with a single block access and
+     * shift them to 0-based numbering.
+     */
+    static void get_elements(long long meshIndex, int keyword, int nloc, index_t NElements,
+                             std::vector<index_t> &ENList, std::vector<index_t> &tags)
+    {
+        ENList.resize(nloc*NElements);
+        tags.resize(NElements);
+        if (NElements <= 0)
+            return;
+
+        index_t last = NElements-1;
+        if (nloc == 2)
+            GmfGetBlock(meshIndex, keyword, 1, NElements, 0, NULL, NULL,
+                        GmfInt, &ENList[0], &ENList[2*last],
+                        GmfInt, &ENList[1], &ENList[2*last+1],
+                        GmfInt, &tags[0], &tags[last]);
+        else if (nloc == 3)
+            GmfGetBlock(meshIndex, keyword, 1, NElements, 0, NULL, NULL,
+                        GmfInt, &ENList[0], &ENList[3*last],
+                        GmfInt, &ENList[1], &ENList[3*last+1],
+                        GmfInt, &ENList[2], &ENList[3*last+2],
+                        GmfInt, &tags[0], &tags[last]);
+        else
+            GmfGetBlock(meshIndex, keyword, 1, NElements, 0, NULL, NULL,
+                        GmfInt, &ENList[0], &ENList[4*last],
+                        GmfInt, &ENList[1], &ENList[4*last+1],
+                        GmfInt, &ENList[2], &ENList[4*last+2],
+                        GmfInt, &ENList[3], &ENList[4*last+3],
+                        GmfInt, &tags[0], &tags[last]);
+
+        #pragma omp parallel for schedule(static)
+        for (index_t i=0; i<nloc*NElements; i++)
+            ENList[i]--;
+    }
+
+
+
+    template<typename gmf_real_t, int dim>
+    static void get_metric(long long solIndex, index_t NNodes, int solSize, int gmfType,
+                           MetricField<real_t,dim> *metric)
+    {
+        const int msize = dim==2?3:6;
+        std::vector<gmf_real_t> buf(solSize*NNodes);
+
+        GmfGetBlock(solIndex, GmfSolAtVertices, 1, NNodes, 0, NULL, NULL,
+                    gmfType, solSize, &buf[0], &buf[solSize*(NNodes-1)]);
+
+        #pragma omp parallel for schedule(static)
+        for (index_t i=0; i<NNodes; i++) {
+            real_t m[msize];
+            for (int j=0; j<msize; ++j)
+                m[j] = (real_t)buf[solSize*i+j];
+            metric->set_metric(m, i);
+        }
+    }
+
+
+
+    /*! Convert the vertices to the precision of the file in parallel, then
+     * write them with a single block access.
+     */
+    template<typename gmf_real_t>
+    static void set_vertices(long long meshIndex, Mesh<real_t> *mesh, int gmfType)
+    {
+        int                     dim = mesh->get_number_dimensions();
+        index_t                 NNodes = mesh->get_number_nodes();
+        index_t                 last = NNodes-1;
+        std::vector<gmf_real_t> buf(dim*NNodes);
+        std::vector<int>        tags(NNodes, 0);
+
+        #pragma omp parallel for schedule(static)
+        for (index_t i=0; i<NNodes; i++) {
+            const real_t *coords = mesh->get_coords(i);
+            for (int j=0; j<dim; j++)
+                buf[dim*i+j] = (gmf_real_t)coords[j];
+        }
+
+        GmfSetKwd(meshIndex, GmfVertices, NNodes);
+        if (dim == 2)
+            GmfSetBlock(meshIndex, GmfVertices, 1, NNodes, 0, NULL, NULL,
+                        gmfType, &buf[0], &buf[2*last],
+                        gmfType, &buf[1], &buf[2*last+1],
+                        GmfInt, &tags[0], &tags[last]);
+        else
+            GmfSetBlock(meshIndex, GmfVertices, 1, NNodes, 0, NULL, NULL,
+                        gmfType, &buf[0], &buf[3*last],
+                        gmfType, &buf[1], &buf[3*last+1],
+                        gmfType, &buf[2], &buf[3*last+2],
+                        GmfInt, &tags[0], &tags[last]);
+    }
+
+
+
+    /*! Shift elements to 1-based numbering in parallel, then write them
+     * with a single block access. tags may be NULL.
+     */
+    static void set_elements(long long meshIndex, int keyword, int nloc, index_t NElements,
+                             const index_t *list, const int *tags)
+    {
+        GmfSetKwd(meshIndex, keyword, NElements);
+        if (NElements <= 0)
+            return;
+
+        index_t              last = NElements-1;
+        std::vector<index_t> buf(nloc*NElements);
+        std::vector<int>     refs(NElements, 0);
+
+        #pragma omp parallel for schedule(static)
+        for (index_t i=0; i<NElements; i++) {
+            for (int j=0; j<nloc; j++)
+                buf[nloc*i+j] = list[nloc*i+j]+1;
+            if (tags)
+                refs[i] = tags[i];
+        }
+
+        if (nloc == 2)
+            GmfSetBlock(meshIndex, keyword, 1, NElements, 0, NULL, NULL,
+                        GmfInt, &buf[0], &buf[2*last],
+                        GmfInt, &buf[1], &buf[2*last+1],
+                        GmfInt, &refs[0], &refs[last]);
+        else if (nloc == 3)
+            GmfSetBlock(meshIndex, keyword, 1, NElements, 0, NULL, NULL,
+                        GmfInt, &buf[0], &buf[3*last],
+                        GmfInt, &buf[1], &buf[3*last+1],
+                        GmfInt, &buf[2], &buf[3*last+2],
+                        GmfInt, &refs[0], &refs[last]);
+        else
+            GmfSetBlock(meshIndex, keyword, 1, NElements, 0, NULL, NULL,
+                        GmfInt, &buf[0], &buf[4*last],
+                        GmfInt, &buf[1], &buf[4*last+1],
+                        GmfInt, &buf[2], &buf[4*last+2],
+                        GmfInt, &buf[3], &buf[4*last+3],
+                        GmfInt, &refs[0], &refs[last]);
+    }
+
+
+
+    template<typename gmf_real_t, int dim>
+    static void set_metric(long long solIndex, index_t NNodes, int gmfType,
+                           MetricField<real_t,dim> *metric)
+    {
+        const int msize = dim==2?3:6;
+        std::vector<gmf_real_t> buf(msize*NNodes);
+
+        #pragma omp parallel for schedule(static)
+        for (index_t i=0; i<NNodes; i++) {
+            const real_t *met = metric->get_metric(i);
+            for (int j=0; j<msize; ++j)
+                buf[msize*i+j] = (gmf_real_t)met[j];
+        }
+
+        GmfSetBlock(solIndex, GmfSolAtVertices, 1, NNodes, 0, NULL, NULL,
+                    gmfType, msize, &buf[0], &buf[msize*(NNodes-1)]);
     }
 
 
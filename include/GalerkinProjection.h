@@ -0,0 +1,599 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef GALERKINPROJECTION_H
+#define GALERKINPROJECTION_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "ElementLocator.h"
+#include "Mesh.h"
+#include "PragmaticMinis.h"
+
+/*! \brief Conservative projection of fields between two meshes of the
+ * same domain, e.g. before and after adaptation.
+ *
+ * The supermesh of the two meshes, i.e. the intersections of every
+ * pair of overlapping elements, is computed locally: candidate pairs
+ * come from an ElementLocator over the old mesh, triangles are
+ * intersected by polygon clipping and tetrahedra by clipping against
+ * the half-spaces of the other tetrahedron. The volume and the mixed
+ * P1 mass matrix of each intersection are stored so that any number
+ * of fields can then be projected.
+ *
+ * P0 fields are projected by volume weighted averaging. P1 fields are
+ * projected by solving M u_new = M_mixed u_old with the mass matrix M
+ * of the new mesh, using Jacobi preconditioned conjugate gradients.
+ * Both conserve the integral of the field. Both meshes should have
+ * been defragmented.
+ */
+template<typename real_t, int dim>
+class GalerkinProjection
+{
+public:
+    /// Compute the supermesh of old_mesh and new_mesh.
+    GalerkinProjection(const Mesh<real_t> &old_mesh, const Mesh<real_t> &new_mesh):nloc(dim+1)
+    {
+        _old_mesh = &old_mesh;
+        _new_mesh = &new_mesh;
+
+        supermesh();
+        assemble_mass_matrix();
+    }
+
+    /// Default destructor.
+    ~GalerkinProjection()
+    {
+    }
+
+    /// Return the number of intersecting pairs of elements.
+    size_t get_number_intersections() const
+    {
+        return pair_old.size();
+    }
+
+    /// Return the total volume of the supermesh.
+    real_t get_supermesh_volume() const
+    {
+        real_t volume = 0;
+        for(size_t i=0; i<pair_volume.size(); i++)
+            volume += pair_volume[i];
+        return volume;
+    }
+
+    /*! Project element-wise constant fields.
+     * @param psi fields on the old mesh, stored element by element.
+     * @param new_psi returns the fields on the new mesh.
+     * @param nfields number of fields.
+     */
+    void project_p0(const real_t *psi, real_t *new_psi, int nfields=1) const
+    {
+        int NElements = _new_mesh->get_number_elements();
+
+        #pragma omp parallel for schedule(guided)
+        for(int e=0; e<NElements; e++) {
+            for(int k=0; k<nfields; k++)
+                new_psi[e*nfields+k] = 0;
+
+            if(_new_mesh->get_element(e)[0]<0)
+                continue;
+
+            for(index_t q=pair_ptr[e]; q<pair_ptr[e+1]; q++) {
+                for(int k=0; k<nfields; k++)
+                    new_psi[e*nfields+k] += pair_volume[q]*psi[pair_old[q]*nfields+k];
+            }
+
+            real_t volume = element_volume(_new_mesh, e);
+            for(int k=0; k<nfields; k++)
+                new_psi[e*nfields+k] /= volume;
+        }
+    }
+
+    /*! Project continuous piecewise linear fields.
+     * @param psi fields on the old mesh, stored vertex by vertex.
+     * @param new_psi returns the fields on the new mesh.
+     * @param nfields number of fields.
+     * @param rtol relative tolerance of the conjugate gradient solver.
+     * @param max_iterations maximum number of iterations.
+     * @return largest number of iterations needed for a field.
+     */
+    int project_p1(const real_t *psi, real_t *new_psi, int nfields=1,
+                   real_t rtol=1.0e-12, int max_iterations=1000) const
+    {
+        int NNodes = _new_mesh->get_number_nodes();
+
+        std::vector<real_t> b(NNodes), x(NNodes), r(NNodes), z(NNodes), p(NNodes), Ap(NNodes);
+
+        int max_its = 0;
+        for(int k=0; k<nfields; k++) {
+            // Right hand side is the mixed mass matrix applied to the old field.
+            #pragma omp parallel for schedule(guided)
+            for(int i=0; i<NNodes; i++) {
+                real_t bi = 0;
+                for(const auto& e : _new_mesh->NEList[i]) {
+                    const index_t *n=_new_mesh->get_element(e);
+                    size_t a = std::find(n, n+nloc, i)-n;
+                    for(index_t q=pair_ptr[e]; q<pair_ptr[e+1]; q++) {
+                        const index_t *m=_old_mesh->get_element(pair_old[q]);
+                        const real_t *M = &(pair_mass[q*nloc*nloc+a*nloc]);
+                        for(size_t c=0; c<nloc; c++)
+                            bi += M[c]*psi[m[c]*nfields+k];
+                    }
+                }
+                b[i] = bi;
+
+                // Start from the lumped mass solution.
+                x[i] = (lumped[i]>0)?bi/lumped[i]:0;
+            }
+
+            int its = cg(b, x, r, z, p, Ap, rtol, max_iterations);
+            max_its = std::max(max_its, its);
+
+            #pragma omp parallel for schedule(static)
+            for(int i=0; i<NNodes; i++)
+                new_psi[i*nfields+k] = x[i];
+        }
+
+        return max_its;
+    }
+
+private:
+    void supermesh()
+    {
+        ElementLocator<real_t, dim> locator(*_old_mesh);
+
+        int NElements = _new_mesh->get_number_elements();
+        pair_ptr.resize(NElements+1);
+        pair_ptr[0] = 0;
+
+        int nthreads = pragmatic_nthreads();
+        std::vector<int> first(nthreads, -1);
+        std::vector< std::vector<index_t> > t_old(nthreads);
+        std::vector< std::vector<real_t> > t_volume(nthreads), t_mass(nthreads);
+
+        #pragma omp parallel
+        {
+            int tid = pragmatic_thread_id();
+            std::vector<index_t> candidates;
+            std::vector<real_t> work[2];
+            real_t mass[16];
+
+            // A static schedule gives each thread one contiguous block of
+            // elements, so the thread buffers are concatenated in order below.
+            #pragma omp for schedule(static)
+            for(int e=0; e<NElements; e++) {
+                if(first[tid]<0)
+                    first[tid] = e;
+
+                index_t cnt = 0;
+                const index_t *n=_new_mesh->get_element(e);
+                if(n[0]>=0) {
+                    real_t lo[dim], hi[dim];
+                    for(int j=0; j<dim; j++) {
+                        lo[j] = DBL_MAX;
+                        hi[j] = -DBL_MAX;
+                        for(size_t v=0; v<nloc; v++) {
+                            lo[j] = std::min(lo[j], _new_mesh->get_coords(n[v])[j]);
+                            hi[j] = std::max(hi[j], _new_mesh->get_coords(n[v])[j]);
+                        }
+                    }
+                    locator.query(lo, hi, candidates);
+
+                    for(size_t c=0; c<candidates.size(); c++) {
+                        real_t volume = intersect(e, candidates[c], mass, work);
+                        if(volume>0) {
+                            t_old[tid].push_back(candidates[c]);
+                            t_volume[tid].push_back(volume);
+                            t_mass[tid].insert(t_mass[tid].end(), mass, mass+nloc*nloc);
+                            cnt++;
+                        }
+                    }
+                }
+                pair_ptr[e+1] = cnt;
+            }
+
+            #pragma omp single
+            {
+                for(int e=0; e<NElements; e++)
+                    pair_ptr[e+1] += pair_ptr[e];
+
+                pair_old.resize(pair_ptr[NElements]);
+                pair_volume.resize(pair_ptr[NElements]);
+                pair_mass.resize(pair_ptr[NElements]*nloc*nloc);
+            }
+
+            if(first[tid]>=0) {
+                size_t offset = pair_ptr[first[tid]];
+                std::copy(t_old[tid].begin(), t_old[tid].end(), pair_old.begin()+offset);
+                std::copy(t_volume[tid].begin(), t_volume[tid].end(), pair_volume.begin()+offset);
+                std::copy(t_mass[tid].begin(), t_mass[tid].end(), pair_mass.begin()+offset*nloc*nloc);
+            }
+        }
+    }
+
+    /* Intersect new element enew with old element eold. Returns the
+     * volume of the intersection and the mixed mass matrix,
+     * mass[a*nloc+b] = integral of phi_a phi_b over the intersection,
+     * where phi_a is a basis function of enew and phi_b one of eold.
+     */
+    real_t intersect(index_t enew, index_t eold, real_t *mass, std::vector<real_t> *work) const
+    {
+        const index_t *n=_new_mesh->get_element(enew);
+        const index_t *m=_old_mesh->get_element(eold);
+
+        const real_t *y[dim+1];
+        for(size_t v=0; v<nloc; v++)
+            y[v] = _old_mesh->get_coords(m[v]);
+
+        std::vector<real_t> &simplices = work[0];
+        std::vector<real_t> &clipped = work[1];
+
+        size_t nsimplices = 0;
+        simplices.clear();
+        if(dim==2) {
+            // Clip the new triangle by the edges of the old one.
+            real_t poly[2][2*9];
+            size_t np = 3;
+            for(size_t v=0; v<nloc; v++)
+                for(int j=0; j<dim; j++)
+                    poly[0][v*dim+j] = _new_mesh->get_coords(n[v])[j];
+
+            real_t s = (ElementLocator<real_t, dim>::orient(y[0], y[1], y[2])>0)?1.0:-1.0;
+            int in = 0;
+            for(size_t k=0; k<3 && np>=3; k++) {
+                const real_t *p0 = y[k], *p1 = y[(k+1)%3];
+                real_t d[9];
+                for(size_t v=0; v<np; v++)
+                    d[v] = s*ElementLocator<real_t, dim>::orient(p0, p1, &(poly[in][v*dim]));
+
+                size_t nclip = 0;
+                for(size_t v=0; v<np; v++) {
+                    size_t w = (v+1)%np;
+                    const real_t *xv = &(poly[in][v*dim]), *xw = &(poly[in][w*dim]);
+                    if(d[v]>=0) {
+                        poly[1-in][nclip*dim] = xv[0];
+                        poly[1-in][nclip*dim+1] = xv[1];
+                        nclip++;
+                    }
+                    if((d[v]>=0)!=(d[w]>=0)) {
+                        real_t t = d[v]/(d[v]-d[w]);
+                        poly[1-in][nclip*dim] = xv[0]+t*(xw[0]-xv[0]);
+                        poly[1-in][nclip*dim+1] = xv[1]+t*(xw[1]-xv[1]);
+                        nclip++;
+                    }
+                }
+                np = nclip;
+                in = 1-in;
+            }
+
+            // Triangulate the convex intersection as a fan.
+            for(size_t v=1; v+1<np; v++) {
+                const real_t *x[] = {&(poly[in][0]), &(poly[in][v*dim]), &(poly[in][(v+1)*dim])};
+                for(int i=0; i<3; i++)
+                    simplices.insert(simplices.end(), x[i], x[i]+dim);
+                nsimplices++;
+            }
+        } else {
+            for(size_t v=0; v<nloc; v++)
+                simplices.insert(simplices.end(), _new_mesh->get_coords(n[v]), _new_mesh->get_coords(n[v])+dim);
+            nsimplices = 1;
+
+            // Clip by the half-space of each facet of the old tetrahedron.
+            for(size_t k=0; k<nloc && nsimplices>0; k++) {
+                const real_t *f0 = y[(k+1)%4], *f1 = y[(k+2)%4], *f2 = y[(k+3)%4];
+                real_t s = (ElementLocator<real_t, dim>::orient(f0, f1, f2, y[k])>0)?1.0:-1.0;
+
+                clipped.clear();
+                for(size_t t=0; t<nsimplices; t++)
+                    clip_tetrahedron(&(simplices[t*12]), f0, f1, f2, s, clipped);
+                simplices.swap(clipped);
+                nsimplices = simplices.size()/12;
+            }
+        }
+
+        // Integrate over the simplices of the intersection.
+        for(size_t i=0; i<nloc*nloc; i++)
+            mass[i] = 0;
+
+        real_t volume = 0;
+        for(size_t t=0; t<nsimplices; t++) {
+            const real_t *x = &(simplices[t*nloc*dim]);
+            real_t v;
+            if(dim==2)
+                v = std::abs(ElementLocator<real_t, dim>::orient(x, x+2, x+4))/2;
+            else
+                v = std::abs(ElementLocator<real_t, dim>::orient(x, x+3, x+6, x+9))/6;
+            if(!(v>0))
+                continue;
+            volume += v;
+
+            // The product of two linear functions is integrated exactly:
+            // |T|/((d+1)(d+2)) (sum_k f_k g_k + sum_k f_k sum_k g_k).
+            real_t phi_new[dim+1][dim+1], phi_old[dim+1][dim+1];
+            real_t sum_new[dim+1], sum_old[dim+1];
+            for(size_t a=0; a<nloc; a++)
+                sum_new[a] = sum_old[a] = 0;
+            for(size_t k=0; k<nloc; k++) {
+                barycentric(_new_mesh, n, x+k*dim, phi_new[k]);
+                barycentric(_old_mesh, m, x+k*dim, phi_old[k]);
+                for(size_t a=0; a<nloc; a++) {
+                    sum_new[a] += phi_new[k][a];
+                    sum_old[a] += phi_old[k][a];
+                }
+            }
+
+            real_t c = v/((dim+1)*(dim+2));
+            for(size_t a=0; a<nloc; a++) {
+                for(size_t b=0; b<nloc; b++) {
+                    real_t f = sum_new[a]*sum_old[b];
+                    for(size_t k=0; k<nloc; k++)
+                        f += phi_new[k][a]*phi_old[k][b];
+                    mass[a*nloc+b] += c*f;
+                }
+            }
+        }
+
+        return volume;
+    }
+
+    /* Append to clipped the part of tetrahedron x on the positive side
+     * of the plane through f0, f1, f2, oriented by s, as up to three
+     * tetrahedra.
+     */
+    static void clip_tetrahedron(const real_t *x, const real_t *f0, const real_t *f1, const real_t *f2,
+                                 real_t s, std::vector<real_t> &clipped)
+    {
+        real_t d[4];
+        int in[4], out[4], nin=0, nout=0;
+        for(int v=0; v<4; v++) {
+            d[v] = s*ElementLocator<real_t, dim>::orient(f0, f1, f2, x+v*3);
+            if(d[v]>=0)
+                in[nin++] = v;
+            else
+                out[nout++] = v;
+        }
+
+        if(nin==0)
+            return;
+
+        if(nin==4) {
+            clipped.insert(clipped.end(), x, x+12);
+            return;
+        }
+
+        if(nin==1) {
+            real_t p[3][3];
+            for(int i=0; i<3; i++)
+                edge_point(x, d, in[0], out[i], p[i]);
+            const real_t *tet[] = {x+in[0]*3, p[0], p[1], p[2]};
+            append_tetrahedron(tet, clipped);
+        } else if(nin==2) {
+            // Prism with triangles (a, ac, ae) and (b, bc, be).
+            real_t pa[2][3], pb[2][3];
+            for(int i=0; i<2; i++) {
+                edge_point(x, d, in[0], out[i], pa[i]);
+                edge_point(x, d, in[1], out[i], pb[i]);
+            }
+            const real_t *bottom[] = {x+in[0]*3, pa[0], pa[1]};
+            const real_t *top[] = {x+in[1]*3, pb[0], pb[1]};
+            append_prism(bottom, top, clipped);
+        } else {
+            // Prism with triangles (a, b, c) and their intersections with edges to e.
+            real_t p[3][3];
+            for(int i=0; i<3; i++)
+                edge_point(x, d, in[i], out[0], p[i]);
+            const real_t *bottom[] = {x+in[0]*3, x+in[1]*3, x+in[2]*3};
+            const real_t *top[] = {p[0], p[1], p[2]};
+            append_prism(bottom, top, clipped);
+        }
+    }
+
+    /// Intersection of edge (a, b) of tetrahedron x with the clipping plane.
+    static void edge_point(const real_t *x, const real_t *d, int a, int b, real_t *p)
+    {
+        real_t t = d[a]/(d[a]-d[b]);
+        for(int j=0; j<3; j++)
+            p[j] = x[a*3+j]+t*(x[b*3+j]-x[a*3+j]);
+    }
+
+    static void append_tetrahedron(const real_t **tet, std::vector<real_t> &clipped)
+    {
+        for(int v=0; v<4; v++)
+            clipped.insert(clipped.end(), tet[v], tet[v]+3);
+    }
+
+    /// Split the prism with corresponding triangles bottom and top into three tetrahedra.
+    static void append_prism(const real_t **bottom, const real_t **top, std::vector<real_t> &clipped)
+    {
+        const real_t *tet0[] = {bottom[0], bottom[1], bottom[2], top[2]};
+        const real_t *tet1[] = {bottom[0], bottom[1], top[1], top[2]};
+        const real_t *tet2[] = {bottom[0], top[0], top[1], top[2]};
+        append_tetrahedron(tet0, clipped);
+        append_tetrahedron(tet1, clipped);
+        append_tetrahedron(tet2, clipped);
+    }
+
+    /// Barycentric coordinates of x in the element n of mesh.
+    void barycentric(const Mesh<real_t> *mesh, const index_t *n, const real_t *x, real_t *l) const
+    {
+        const real_t *x0 = mesh->get_coords(n[0]);
+        const real_t *x1 = mesh->get_coords(n[1]);
+        const real_t *x2 = mesh->get_coords(n[2]);
+        if(dim==2) {
+            real_t A = ElementLocator<real_t, dim>::orient(x0, x1, x2);
+            l[0] = ElementLocator<real_t, dim>::orient(x, x1, x2)/A;
+            l[1] = ElementLocator<real_t, dim>::orient(x0, x, x2)/A;
+            l[2] = 1.0-l[0]-l[1];
+        } else {
+            const real_t *x3 = mesh->get_coords(n[3]);
+            real_t V = ElementLocator<real_t, dim>::orient(x0, x1, x2, x3);
+            l[0] = ElementLocator<real_t, dim>::orient(x, x1, x2, x3)/V;
+            l[1] = ElementLocator<real_t, dim>::orient(x0, x, x2, x3)/V;
+            l[2] = ElementLocator<real_t, dim>::orient(x0, x1, x, x3)/V;
+            l[3] = 1.0-l[0]-l[1]-l[2];
+        }
+    }
+
+    real_t element_volume(const Mesh<real_t> *mesh, index_t eid) const
+    {
+        const index_t *n=mesh->get_element(eid);
+        if(dim==2)
+            return std::abs(ElementLocator<real_t, dim>::orient(mesh->get_coords(n[0]), mesh->get_coords(n[1]),
+                            mesh->get_coords(n[2])))/2;
+        else
+            return std::abs(ElementLocator<real_t, dim>::orient(mesh->get_coords(n[0]), mesh->get_coords(n[1]),
+                            mesh->get_coords(n[2]), mesh->get_coords(n[3])))/6;
+    }
+
+    /// Assemble the P1 mass matrix of the new mesh in CSR format.
+    void assemble_mass_matrix()
+    {
+        int NNodes = _new_mesh->get_number_nodes();
+
+        row_ptr.resize(NNodes+1);
+        row_ptr[0] = 0;
+        for(int i=0; i<NNodes; i++)
+            row_ptr[i+1] = row_ptr[i]+1+_new_mesh->NNList[i].size();
+        cols.resize(row_ptr[NNodes]);
+        values.resize(row_ptr[NNodes]);
+        diagonal.resize(NNodes);
+        lumped.resize(NNodes);
+
+        #pragma omp parallel for schedule(guided)
+        for(int i=0; i<NNodes; i++) {
+            index_t *row = &(cols[row_ptr[i]]);
+            real_t *val = &(values[row_ptr[i]]);
+            size_t len = row_ptr[i+1]-row_ptr[i];
+            row[0] = i;
+            std::copy(_new_mesh->NNList[i].begin(), _new_mesh->NNList[i].end(), row+1);
+            std::fill(val, val+len, 0.0);
+
+            for(const auto& e : _new_mesh->NEList[i]) {
+                const index_t *n=_new_mesh->get_element(e);
+                real_t c = element_volume(_new_mesh, e)/((dim+1)*(dim+2));
+                for(size_t v=0; v<nloc; v++) {
+                    size_t j = std::find(row, row+len, n[v])-row;
+                    assert(j<len);
+                    val[j] += (n[v]==i)?2*c:c;
+                }
+            }
+
+            diagonal[i] = val[0];
+            lumped[i] = 0;
+            for(size_t j=0; j<len; j++)
+                lumped[i] += val[j];
+        }
+    }
+
+    /// Jacobi preconditioned conjugate gradients for the mass matrix.
+    int cg(const std::vector<real_t> &b, std::vector<real_t> &x, std::vector<real_t> &r,
+           std::vector<real_t> &z, std::vector<real_t> &p, std::vector<real_t> &Ap,
+           real_t rtol, int max_iterations) const
+    {
+        int NNodes = b.size();
+
+        real_t bb=0, rz=0, rr=0;
+        #pragma omp parallel for schedule(static) reduction(+:bb,rz,rr)
+        for(int i=0; i<NNodes; i++) {
+            real_t Ax = 0;
+            for(index_t j=row_ptr[i]; j<row_ptr[i+1]; j++)
+                Ax += values[j]*x[cols[j]];
+            r[i] = b[i]-Ax;
+            z[i] = (diagonal[i]>0)?r[i]/diagonal[i]:0;
+            p[i] = z[i];
+            bb += b[i]*b[i];
+            rz += r[i]*z[i];
+            rr += r[i]*r[i];
+        }
+
+        real_t tol2 = rtol*rtol*bb;
+        int it=0;
+        for(; it<max_iterations && rr>tol2; it++) {
+            real_t pAp=0;
+            #pragma omp parallel for schedule(static) reduction(+:pAp)
+            for(int i=0; i<NNodes; i++) {
+                real_t Api = 0;
+                for(index_t j=row_ptr[i]; j<row_ptr[i+1]; j++)
+                    Api += values[j]*p[cols[j]];
+                Ap[i] = Api;
+                pAp += p[i]*Api;
+            }
+
+            real_t alpha = rz/pAp;
+            real_t rz_new=0;
+            rr = 0;
+            #pragma omp parallel for schedule(static) reduction(+:rz_new,rr)
+            for(int i=0; i<NNodes; i++) {
+                x[i] += alpha*p[i];
+                r[i] -= alpha*Ap[i];
+                z[i] = (diagonal[i]>0)?r[i]/diagonal[i]:0;
+                rz_new += r[i]*z[i];
+                rr += r[i]*r[i];
+            }
+
+            real_t beta = rz_new/rz;
+            rz = rz_new;
+
+            #pragma omp parallel for schedule(static)
+            for(int i=0; i<NNodes; i++)
+                p[i] = z[i]+beta*p[i];
+        }
+
+        return it;
+    }
+
+    const Mesh<real_t> *_old_mesh, *_new_mesh;
+    const size_t nloc;
+
+    // Intersecting pairs of elements (CSR over the new elements), with
+    // the volume and the mixed mass matrix of each intersection.
+    std::vector<index_t> pair_ptr, pair_old;
+    std::vector<real_t> pair_volume, pair_mass;
+
+    // Mass matrix of the new mesh (CSR), its diagonal and row sums.
+    std::vector<index_t> row_ptr, cols;
+    std::vector<real_t> values, diagonal, lumped;
+};
+
+#endif
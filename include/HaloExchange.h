@@ -176,6 +176,201 @@ void halo_update(MPI_Comm comm,
     return;
 }
 
+/*! \brief Persistent plan for halo updates.
+ *
+ * halo_update sets up its buffers and requests on every call. A HaloPlan
+ * is built once from the send and recv lists of a mesh and then reused
+ * until the topology of the mesh changes: it keeps the list of
+ * neighbouring processes, contiguous pack buffers and persistent
+ * requests bound to them (MPI_Send_init/MPI_Recv_init). Each vertex
+ * carries block values of each of nfields fields, which are packed
+ * together into a single message per neighbour.
+ */
+template <typename DATATYPE>
+class HaloPlan
+{
+public:
+    /*! Build the plan.
+     * @param comm communicator of the mesh.
+     * @param send vertices sent to each process.
+     * @param recv vertices received from each process.
+     * @param version topology version of the mesh the lists were taken from.
+     * @param block number of values per vertex of each field.
+     * @param nfields number of fields exchanged at the same time.
+     */
+    HaloPlan(MPI_Comm comm,
+             const std::vector< std::vector<index_t> > &send,
+             const std::vector< std::vector<index_t> > &recv,
+             size_t version, int block, int nfields=1)
+    {
+        this->version = version;
+        this->block = block;
+        this->nfields = nfields;
+
+        int num_processes, rank;
+        MPI_Comm_size(comm, &num_processes);
+        MPI_Comm_rank(comm, &rank);
+
+        mpi_type_wrapper<DATATYPE> wrap;
+        int width = block*nfields;
+
+        send_ptr.push_back(0);
+        recv_ptr.push_back(0);
+        for(int i=0; i<num_processes && i<(int)send.size(); i++) {
+            if(i==rank || send[i].empty())
+                continue;
+            send_procs.push_back(i);
+            send_ids.insert(send_ids.end(), send[i].begin(), send[i].end());
+            send_ptr.push_back(send_ids.size());
+        }
+        for(int i=0; i<num_processes && i<(int)recv.size(); i++) {
+            if(i==rank || recv[i].empty())
+                continue;
+            recv_procs.push_back(i);
+            recv_ids.insert(recv_ids.end(), recv[i].begin(), recv[i].end());
+            recv_ptr.push_back(recv_ids.size());
+        }
+
+        // The buffers are never resized, as the requests are bound to them.
+        send_buff.resize(send_ids.size()*width);
+        recv_buff.resize(recv_ids.size()*width);
+
+        requests.resize(recv_procs.size()+send_procs.size());
+        for(size_t k=0; k<recv_procs.size(); k++)
+            MPI_Recv_init(&(recv_buff[recv_ptr[k]*width]), (recv_ptr[k+1]-recv_ptr[k])*width, wrap.mpi_type,
+                          recv_procs[k], 0, comm, &(requests[k]));
+        for(size_t k=0; k<send_procs.size(); k++)
+            MPI_Send_init(&(send_buff[send_ptr[k]*width]), (send_ptr[k+1]-send_ptr[k])*width, wrap.mpi_type,
+                          send_procs[k], 0, comm, &(requests[recv_procs.size()+k]));
+    }
+
+    ~HaloPlan()
+    {
+        int finalized;
+        MPI_Finalized(&finalized);
+        if(finalized)
+            return;
+
+        for(size_t k=0; k<requests.size(); k++)
+            MPI_Request_free(&(requests[k]));
+    }
+
+    /// Return true if the plan was built for this topology version of the mesh.
+    bool is_valid(size_t version) const
+    {
+        return this->version==version;
+    }
+
+    /// Update the halo of a single field. Requires nfields==1.
+    void update(std::vector<DATATYPE> &vec)
+    {
+        assert(nfields==1);
+
+        DATATYPE *vecs[] = {vec.data()};
+        update(vecs);
+    }
+
+    /// Update the halo of nfields fields at the same time.
+    void update(DATATYPE * const *vecs)
+    {
+        if(requests.empty())
+            return;
+
+        size_t nrecv = recv_procs.size();
+        MPI_Startall(nrecv, &(requests[0]));
+
+        switch(block) {
+        case 1:
+            pack<1>(vecs);
+            break;
+        case 2:
+            pack<2>(vecs);
+            break;
+        case 3:
+            pack<3>(vecs);
+            break;
+        case 6:
+            pack<6>(vecs);
+            break;
+        default:
+            pack<0>(vecs);
+        }
+
+        if(!send_procs.empty())
+            MPI_Startall(send_procs.size(), &(requests[nrecv]));
+        MPI_Waitall(requests.size(), &(requests[0]), MPI_STATUSES_IGNORE);
+
+        switch(block) {
+        case 1:
+            unpack<1>(vecs);
+            break;
+        case 2:
+            unpack<2>(vecs);
+            break;
+        case 3:
+            unpack<3>(vecs);
+            break;
+        case 6:
+            unpack<6>(vecs);
+            break;
+        default:
+            unpack<0>(vecs);
+        }
+    }
+
+private:
+    // Owns requests bound to its own buffers.
+    HaloPlan(const HaloPlan &);
+    HaloPlan &operator=(const HaloPlan &);
+
+    /// Gather the send vertices of all fields. _block is the block size if known at compile time, else 0.
+    template<int _block>
+    void pack(DATATYPE * const *vecs)
+    {
+        const int b = _block>0?_block:block;
+        const size_t n = send_ids.size();
+        for(int f=0; f<nfields; f++) {
+            const DATATYPE *vec = vecs[f];
+            DATATYPE *buff = send_buff.data()+f*b;
+            for(size_t i=0; i<n; i++) {
+                const DATATYPE *src = vec+send_ids[i]*b;
+                DATATYPE *dst = buff+i*nfields*b;
+                for(int j=0; j<b; j++)
+                    dst[j] = src[j];
+            }
+        }
+    }
+
+    /// Scatter the received values into the halo vertices of all fields.
+    template<int _block>
+    void unpack(DATATYPE * const *vecs)
+    {
+        const int b = _block>0?_block:block;
+        const size_t n = recv_ids.size();
+        for(int f=0; f<nfields; f++) {
+            DATATYPE *vec = vecs[f];
+            const DATATYPE *buff = recv_buff.data()+f*b;
+            for(size_t i=0; i<n; i++) {
+                const DATATYPE *src = buff+i*nfields*b;
+                DATATYPE *dst = vec+recv_ids[i]*b;
+                for(int j=0; j<b; j++)
+                    dst[j] = src[j];
+            }
+        }
+    }
+
+    size_t version;
+    int block, nfields;
+
+    // Neighbouring processes and the vertices exchanged with them, in CSR form.
+    std::vector<int> send_procs, recv_procs;
+    std::vector<size_t> send_ptr, recv_ptr;
+    std::vector<index_t> send_ids, recv_ids;
+
+    std::vector<DATATYPE> send_buff, recv_buff;
+    std::vector<MPI_Request> requests;
+};
+
 #endif
 
 #endif
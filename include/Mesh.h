@@ -148,10 +148,33 @@ public:
     }
 #endif
 
+    /*! Mesh constructor that adopts the caller's arrays rather than
+     * copying them. This is for use when there is no MPI, or with a
+     * single MPI process.
+     *
+     * @param ndims number of spatial dimensions, 2 or 3.
+     * @param ENList element-node list. It is empty on return.
+     * @param coords interleaved coordinates, ndims per node. It is empty on return.
+     */
+    Mesh(int ndims, std::vector<index_t> &ENList, std::vector<real_t> &coords)
+    {
+#ifdef HAVE_MPI
+        _mpi_comm = MPI_COMM_WORLD;
+#endif
+        _init_sizes(coords.size()/ndims, ENList.size()/(ndims+1), ndims);
+        assert(num_processes==1);
+        _ENList.swap(ENList);
+        _coords.swap(coords);
+        _init_mesh();
+    }
+
     /// Default destructor.
     ~Mesh()
     {
         delete property;
+#ifdef HAVE_MPI
+        delete metric_plan;
+#endif
     }
 
     /// Add a new vertex
@@ -197,6 +220,7 @@ public:
     void create_boundary()
     {
         assert(boundary.size()==0);
+        topology_version++;
 
         size_t NNodes = get_number_nodes();
         size_t NElements = get_number_elements();
@@ -317,6 +341,8 @@ public:
 
     void set_boundary(const int *_boundary)
     {
+        topology_version++;
+
         // Sweep through boundary and set ids.
         size_t NElements = get_number_elements();
 	boundary.resize(NElements*nloc);
@@ -407,6 +433,47 @@ public:
         return;
     }
 
+    /*! Attach a per-vertex field to the mesh. Attached fields are
+     * carried through adaptation: they are linearly interpolated onto
+     * new and relocated vertices and compacted by defragment().
+     * @param psi field values, one per vertex.
+     * @return id of the field.
+     */
+    int attach_field(const real_t *psi)
+    {
+        size_t capacity = metric.size()/msize;
+        std::vector<real_t> new_fields(capacity*(nfields+1), 0.0);
+        for(size_t i=0; i<NNodes; i++) {
+            for(size_t k=0; k<nfields; k++)
+                new_fields[i*(nfields+1)+k] = fields[i*nfields+k];
+            new_fields[i*(nfields+1)+nfields] = psi[i];
+        }
+        fields.swap(new_fields);
+
+        return nfields++;
+    }
+
+    /// Return the number of attached fields.
+    inline size_t get_number_fields() const
+    {
+        return nfields;
+    }
+
+    /// Return the attached field values at that vertex.
+    inline const real_t *get_fields(index_t nid) const
+    {
+        assert(nfields>0);
+        return &(fields[nid*nfields]);
+    }
+
+    /// Return copy of attached field id.
+    void get_field(int id, real_t *psi) const
+    {
+        assert(id>=0 && (size_t)id<nfields);
+        for(size_t i=0; i<NNodes; i++)
+            psi[i] = fields[i*nfields+id];
+    }
+
     // Returns the list of facets and corresponding ids
     void get_boundary(int* nfacets, const int** facets, const int** ids)
     {
@@ -452,6 +519,39 @@ public:
       return boundary.data();
     }
 
+    /// Return a counter which is incremented every time the mesh topology changes.
+    inline size_t get_topology_version() const
+    {
+        return topology_version;
+    }
+
+    /// Local ids of the vertices sent to each process in a halo update.
+    inline const std::vector< std::vector<index_t> > &get_halo_send() const
+    {
+        return send;
+    }
+
+    /// Local ids of the vertices received from each process in a halo update.
+    inline const std::vector< std::vector<index_t> > &get_halo_recv() const
+    {
+        return recv;
+    }
+
+#ifdef HAVE_MPI
+    /// Update the metric in the halo. The halo plan is rebuilt only when the topology has changed.
+    void halo_update_metric()
+    {
+        if(num_processes<2)
+            return;
+
+        if(metric_plan==NULL || !metric_plan->is_valid(topology_version)) {
+            delete metric_plan;
+            metric_plan = new HaloPlan<double>(_mpi_comm, send, recv, topology_version, msize);
+        }
+        metric_plan->update(metric);
+    }
+#endif
+
     /// Returns true if the node is in any of the partitioned elements.
     inline bool is_halo_node(index_t nid) const
     {
@@ -930,6 +1030,8 @@ public:
       coarsened. */
     void defragment()
     {
+        topology_version++;
+
         // Discover which vertices and elements are active.
         std::vector<index_t> active_vertex_map(NNodes);
 
@@ -1033,6 +1135,7 @@ public:
         std::vector<index_t> defrag_ENList(NElements*nloc);
         std::vector<real_t> defrag_coords(NNodes*ndims);
         std::vector<double> defrag_metric(NNodes*msize);
+        std::vector<real_t> defrag_fields(NNodes*nfields);
         std::vector<int> defrag_boundary(NElements*nloc);
         std::vector<double> defrag_quality(NElements);
 
@@ -1075,6 +1178,8 @@ public:
                 defrag_coords[new_nid*ndims+j] = _coords[old_nid*ndims+j];
             for(size_t j=0; j<msize; j++)
                 defrag_metric[new_nid*msize+j] = metric[old_nid*msize+j];
+            for(size_t j=0; j<nfields; j++)
+                defrag_fields[new_nid*nfields+j] = fields[old_nid*nfields+j];
         }
 
         memcpy(&_ENList[0], &defrag_ENList[0], NElements*nloc*sizeof(index_t));
@@ -1082,6 +1187,8 @@ public:
         memcpy(&quality[0], &defrag_quality[0], NElements*sizeof(double));
         memcpy(&_coords[0], &defrag_coords[0], NNodes*ndims*sizeof(real_t));
         memcpy(&metric[0], &defrag_metric[0], NNodes*msize*sizeof(double));
+        if(nfields>0)
+            memcpy(&fields[0], &defrag_fields[0], NNodes*nfields*sizeof(real_t));
 
         // Renumber halo, fix lnn2gnn and node_owner.
         if(num_processes>1) {
@@ -1432,39 +1539,24 @@ private:
     template<typename _real_t, int _dim> friend class Refine;
     template<typename _real_t> friend class DeferredOperations;
     template<typename _real_t> friend class VTKTools;
+    template<typename _real_t, int _dim> friend class ElementLocator;
+    template<typename _real_t, int _dim> friend class GalerkinProjection;
+    template<typename _real_t> friend class CheckpointTools;
+    template<typename _real_t> friend class VTUWriter;
 
-    void _init(int _NNodes, int _NElements, const index_t *globalENList,
-               const real_t *x, const real_t *y, const real_t *z,
-               const index_t *lnn2gnn, const index_t *owner_range)
+    /// Empty mesh, filled in directly by CheckpointTools.
+    Mesh() : property(NULL)
     {
-        num_processes = 1;
-        rank=0;
-
-        NElements = _NElements;
-        NNodes = _NNodes;
-
 #ifdef HAVE_MPI
-        MPI_Comm_size(_mpi_comm, &num_processes);
-        MPI_Comm_rank(_mpi_comm, &rank);
-
-        // Assign the correct MPI data type to MPI_INDEX_T and MPI_REAL_T
-        mpi_type_wrapper<index_t> mpi_index_t_wrapper;
-        MPI_INDEX_T = mpi_index_t_wrapper.mpi_type;
-        mpi_type_wrapper<real_t> mpi_real_t_wrapper;
-        MPI_REAL_T = mpi_real_t_wrapper.mpi_type;
+        metric_plan = NULL;
 #endif
+    }
 
-        nthreads = pragmatic_nthreads();
-
-        if(z==NULL) {
-            nloc = 3;
-            ndims = 2;
-            msize = 3;
-        } else {
-            nloc = 4;
-            ndims = 3;
-            msize = 6;
-        }
+    void _init(int _NNodes, int _NElements, const index_t *globalENList,
+               const real_t *x, const real_t *y, const real_t *z,
+               const index_t *lnn2gnn, const index_t *owner_range)
+    {
+        _init_sizes(_NNodes, _NElements, z==NULL?2:3);
 
         // From the globalENList, create the halo and a local ENList if num_processes>1.
         const index_t *ENList;
@@ -1555,13 +1647,7 @@ private:
         }
 
         _ENList.resize(NElements*nloc);
-        quality.resize(NElements);
         _coords.resize(NNodes*ndims);
-        metric.resize(NNodes*msize);
-        NNList.resize(NNodes);
-        NEList.resize(NNodes);
-        node_owner.resize(NNodes);
-        this->lnn2gnn.resize(NNodes);
 
         // TODO I don't know whether this method makes sense anymore.
         // Enforce first-touch policy
@@ -1587,22 +1673,78 @@ private:
                     _coords[i*3+2] = z[i];
                 }
             }
+        }
 
-            #pragma omp single nowait
-            {
-                if(num_processes>1) {
-                    // Take into account renumbering for halo.
-                    for(int j=0; j<num_processes; j++) {
-                        for(size_t k=0; k<recv[j].size(); k++) {
-                            recv_halo.insert(recv[j][k]);
-                        }
-                        for(size_t k=0; k<send[j].size(); k++) {
-                            send_halo.insert(send[j][k]);
-                        }
-                    }
+#ifdef HAVE_MPI
+        if(num_processes>1)
+            delete [] ENList;
+#endif
+
+        _init_mesh();
+    }
+
+    /// Set the sizes and the MPI and OpenMP context of a new mesh.
+    void _init_sizes(int _NNodes, int _NElements, int _ndims)
+    {
+        num_processes = 1;
+        rank=0;
+
+        NElements = _NElements;
+        NNodes = _NNodes;
+        topology_version = 0;
+        nfields = 0;
+#ifdef HAVE_MPI
+        metric_plan = NULL;
+#endif
+
+#ifdef HAVE_MPI
+        MPI_Comm_size(_mpi_comm, &num_processes);
+        MPI_Comm_rank(_mpi_comm, &rank);
+
+        // Assign the correct MPI data type to MPI_INDEX_T and MPI_REAL_T
+        mpi_type_wrapper<index_t> mpi_index_t_wrapper;
+        MPI_INDEX_T = mpi_index_t_wrapper.mpi_type;
+        mpi_type_wrapper<real_t> mpi_real_t_wrapper;
+        MPI_REAL_T = mpi_real_t_wrapper.mpi_type;
+#endif
+
+        nthreads = pragmatic_nthreads();
+
+        if(_ndims==2) {
+            nloc = 3;
+            ndims = 2;
+            msize = 3;
+        } else {
+            nloc = 4;
+            ndims = 3;
+            msize = 6;
+        }
+    }
+
+    /// Build everything else from _ENList and _coords in local numbering.
+    void _init_mesh()
+    {
+        quality.resize(NElements);
+        metric.resize(NNodes*msize);
+        NNList.resize(NNodes);
+        NEList.resize(NNodes);
+        node_owner.resize(NNodes);
+        lnn2gnn.resize(NNodes);
+
+        if(num_processes>1) {
+            // Take into account renumbering for halo.
+            for(int j=0; j<num_processes; j++) {
+                for(size_t k=0; k<recv[j].size(); k++) {
+                    recv_halo.insert(recv[j][k]);
+                }
+                for(size_t k=0; k<send[j].size(); k++) {
+                    send_halo.insert(send[j][k]);
                 }
             }
+        }
 
+        #pragma omp parallel
+        {
             // Set the orientation of elements.
             #pragma omp single
             {
@@ -1702,6 +1844,8 @@ private:
 
     void trim_halo()
     {
+        topology_version++;
+
         std::set<index_t> recv_halo_temp, send_halo_temp;
 
         // Traverse all vertices V in all recv[i] vectors. Vertices in send[i] belong by definition to *this* MPI process,
@@ -1974,12 +2118,59 @@ private:
         }
     }
 
+    /*! Update the quality of a sequence of elements. The elements are
+     * gathered in blocks so that the Lipnikov functional is evaluated
+     * with the vectorised ElementProperty::lipnikov_block2d/3d kernels.
+     * @param begin, end iterators over element ids.
+     */
+    template<int dim, typename iterator>
+    inline void update_quality(iterator begin, iterator end)
+    {
+        const int block = ElementProperty<real_t>::lipnikov_block;
+        const int msz = (dim==2?3:6);
+
+        double x[(dim+1)*dim][block], m[msz][block], q[block];
+        index_t eids[block];
+
+        iterator it=begin;
+        while(it!=end) {
+            int k=0;
+            for(; k<block && it!=end; ++it) {
+                const index_t *n=get_element(*it);
+                if(n[0]<0)
+                    continue;
+
+                for(int i=0; i<dim+1; i++) {
+                    const real_t *xi = get_coords(n[i]);
+                    for(int d=0; d<dim; d++)
+                        x[i*dim+d][k] = xi[d];
+                }
+                if(dim==2)
+                    property->lipnikov_block_metric(m, k, get_metric(n[0]), get_metric(n[1]), get_metric(n[2]));
+                else
+                    property->lipnikov_block_metric(m, k, get_metric(n[0]), get_metric(n[1]), get_metric(n[2]), get_metric(n[3]));
+                eids[k++] = *it;
+            }
+
+            if(dim==2)
+                property->lipnikov_block2d(k, x, m, q);
+            else
+                property->lipnikov_block3d(k, x, m, q);
+
+            for(int j=0; j<k; j++)
+                quality[eids[j]] = q[j];
+        }
+    }
+
     size_t ndims, nloc, msize;
     std::vector<index_t> _ENList;
     std::vector<real_t> _coords;
 
     size_t NNodes, NElements;
 
+    // Bumped by every operation that changes the connectivity or boundary.
+    size_t topology_version;
+
     // Boundary Label
     std::vector<int> boundary;
 
@@ -1995,6 +2186,10 @@ private:
     // Metric tensor field.
     std::vector<double> metric;
 
+    // User fields attached to the vertices, stored vertex by vertex.
+    size_t nfields;
+    std::vector<real_t> fields;
+
     // Parallel support.
     int rank, num_processes, nthreads;
     std::vector< std::vector<index_t> > send, recv;
@@ -2014,6 +2209,9 @@ private:
     // MPI data type for index_t and real_t
     MPI_Datatype MPI_INDEX_T;
     MPI_Datatype MPI_REAL_T;
+
+    // Halo exchange of the metric, kept while the topology is unchanged.
+    HaloPlan<double> *metric_plan;
 #endif
 };
 
@@ -0,0 +1,133 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef METRICCONSTRAINTS_H
+#define METRICCONSTRAINTS_H
+
+#include <cstddef>
+
+/*! \brief A set of bounds to be imposed on a metric tensor field.
+ *
+ * Register the constraints once and impose them all with
+ * MetricField::apply_constraints, which needs a single eigen-decomposition
+ * per vertex. The result is the same as calling, in this order,
+ * MetricField::apply_max_edge_length, apply_min_edge_length (global then
+ * local), apply_max_aspect_ratio and finally apply_nelements,
+ * apply_max_nelements or apply_min_nelements.
+ */
+template<typename real_t> class MetricConstraints
+{
+public:
+    /// How the target number of elements is imposed.
+    enum NElementsMode {
+        EXACT,    ///< Scale the metric to give the target number of elements.
+        AT_MOST,  ///< Scale the metric only if more elements are predicted.
+        AT_LEAST  ///< Scale the metric only if fewer elements are predicted.
+    };
+
+    /// Default constructor, with no constraints.
+    MetricConstraints()
+    {
+        clear();
+    }
+
+    /// Remove all constraints.
+    void clear()
+    {
+        max_len = -1.0;
+        min_len = -1.0;
+        local_min_len = NULL;
+        max_aspect_ratio = -1.0;
+        nelements = -1.0;
+        nelements_mode = EXACT;
+    }
+
+    /*! Maximum edge length.
+     * @param len is the maximum allowed edge length.
+     */
+    void set_max_edge_length(real_t len)
+    {
+        max_len = len;
+    }
+
+    /*! Minimum edge length.
+     * @param len is the minimum allowed edge length globally.
+     */
+    void set_min_edge_length(real_t len)
+    {
+        min_len = len;
+    }
+
+    /*! Minimum edge length at each vertex. The array is not copied, so it
+     * must stay valid until the constraints are applied.
+     * @param len is the minimum allowed edge length at each vertex.
+     */
+    void set_min_edge_length(const real_t *len)
+    {
+        local_min_len = len;
+    }
+
+    /*! Maximum aspect ratio.
+     * @param ratio is the maximum aspect ratio for elements.
+     */
+    void set_max_aspect_ratio(real_t ratio)
+    {
+        max_aspect_ratio = ratio;
+    }
+
+    /*! Number of elements, imposed by a final global scaling of the
+     * metric once all the other constraints are satisfied.
+     * @param n is the number of elements desired after adapting.
+     * @param mode selects whether n is exact, an upper or a lower bound.
+     */
+    void set_nelements(real_t n, NElementsMode mode=EXACT)
+    {
+        nelements = n;
+        nelements_mode = mode;
+    }
+
+private:
+    template<typename _real_t, int _dim> friend class MetricField;
+
+    real_t max_len, min_len;
+    const real_t *local_min_len;
+    real_t max_aspect_ratio;
+    real_t nelements;
+    NElementsMode nelements_mode;
+};
+
+#endif
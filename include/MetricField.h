@@ -48,6 +48,7 @@
 #include <Eigen/Core>
 #include <Eigen/Dense>
 
+#include "MetricConstraints.h"
 #include "MetricTensor.h"
 #include "Mesh.h"
 #include "ElementProperty.h"
@@ -73,6 +74,12 @@
 template<typename real_t, int dim> class MetricField
 {
 public:
+    /// How the Hessian of a field is recovered at the vertices.
+    enum HessianRecovery {
+        QLS,          ///< Quadratic least squares fit over a vertex patch.
+        L2_PROJECTION ///< Two successive lumped L2 projections of the element gradients.
+    };
+
     /*! Default constructor.
     */
     MetricField(Mesh<real_t>& mesh)
@@ -176,40 +183,117 @@ public:
         }
     }
 
-    /* Gradation.
+    /*! Gradation. Limit how fast the metric may vary between neighbouring
+     * vertices: along an edge of metric length d, the local length scales
+     * may grow by at most gamma*d. Passes are repeated until no metric
+     * changes. In each pass a vertex pulls the constraints from those
+     * neighbours whose metric changed in the previous pass, and the
+     * results are only written back once the pass is complete, so
+     * vertices can be processed in parallel.
+     * @param gamma is the gradation factor.
+     * @param maxl is currently unused.
+     * @param max_passes is the maximum number of passes.
+     * @return the number of passes made.
      */
-    void gradation(real_t gamma, real_t maxl)
+    int gradation(real_t gamma, real_t maxl, int max_passes=100)
     {
-        for(int i=0; i<_NNodes; i++) {
-            real_t Di[dim], Vi[dim*dim];
-            _metric[i].eigen_decomp(Di, Vi);
+        const int msize = dim==2?3:6;
 
-            const real_t *xi=_mesh->get_coords(i);
-            for(auto &n : _mesh->NNList[i]) {
-                const real_t *xn=_mesh->get_coords(n);
+        // Relative change in a metric below which it is considered converged.
+        const real_t tol = 1.0e-6;
 
-                real_t d;
-                if(dim==2)
-                    d = (ElementProperty<real_t>::length2d(xi, xn, _metric[i].get_metric()) +
-                         ElementProperty<real_t>::length2d(xi, xn, _metric[n].get_metric()))*0.5;
+        std::vector< MetricTensor<real_t,dim> > next(_NNodes);
+        std::vector<char> changed(_NNodes, 1), next_changed(_NNodes, 0);
 
-                else
-                    d = (ElementProperty<real_t>::length3d(xi, xn, _metric[i].get_metric()) +
-                         ElementProperty<real_t>::length3d(xi, xn, _metric[n].get_metric()))*0.5;
-
-                double D[dim];
-                for(int j=0;j<dim;j++){
-                    double li = 1.0/sqrt(Di[j]);
-                    double ln = li + d*gamma;
-                    D[j] = 1.0/(ln*ln);
+        int pass=0, nchanged=_NNodes;
+        while(nchanged>0 && pass<max_passes) {
+            pass++;
+            nchanged = 0;
+
+            #pragma omp parallel
+            {
+                // Bring the cached eigen-decompositions of the metrics that
+                // changed up to date before they are shared between threads.
+                #pragma omp for schedule(static)
+                for(int i=0; i<_NNodes; i++) {
+                    if(changed[i])
+                        _metric[i].get_eigenvalues();
                 }
 
-                MetricTensor<real_t, dim> M;
-                M.eigen_undecomp(D, Vi);
+                #pragma omp for schedule(guided)
+                for(int i=0; i<_NNodes; i++) {
+                    next_changed[i] = 0;
+
+                    const real_t *xi=_mesh->get_coords(i);
+                    const real_t *mi=_metric[i].get_metric();
+                    const real_t *Di=_metric[i].get_eigenvalues();
+                    const real_t *Vi=_metric[i].get_eigenvectors();
+
+                    bool constrained=false;
+                    for(auto &n : _mesh->NNList[i]) {
+                        if(!changed[n])
+                            continue;
+
+                        const real_t *xn=_mesh->get_coords(n);
+                        const real_t *mn=_metric[n].get_metric();
+                        const real_t *Dn=_metric[n].get_eigenvalues();
+                        const real_t *Vn=_metric[n].get_eigenvectors();
+
+                        real_t d;
+                        if(dim==2)
+                            d = (ElementProperty<real_t>::length2d(xi, xn, mi) +
+                                 ElementProperty<real_t>::length2d(xi, xn, mn))*0.5;
+                        else
+                            d = (ElementProperty<real_t>::length3d(xi, xn, mi) +
+                                 ElementProperty<real_t>::length3d(xi, xn, mn))*0.5;
+
+                        real_t Dc[dim];
+                        for(int j=0; j<dim; j++) {
+                            real_t ln = 1.0/sqrt(Dn[j]) + d*gamma;
+                            Dc[j] = 1.0/(ln*ln);
+                        }
+
+                        // Nothing to do if the constraint is weaker than the
+                        // metric in every direction.
+                        if(weaker_metric(Di, Vi, Dc, Vn))
+                            continue;
 
-                _metric[n].constrain(M.get_metric());
+                        if(!constrained) {
+                            next[i] = _metric[i];
+                            constrained = true;
+                        }
+
+                        MetricTensor<real_t, dim> M;
+                        M.eigen_undecomp(Dc, Vn);
+
+                        next[i].constrain(M);
+                    }
+
+                    if(!constrained)
+                        continue;
+
+                    const real_t *mc=next[i].get_metric();
+                    real_t dm=0, m=0;
+                    for(int j=0; j<msize; j++) {
+                        dm = std::max(dm, std::abs(mc[j]-mi[j]));
+                        m = std::max(m, std::abs(mi[j]));
+                    }
+                    next_changed[i] = dm>tol*m;
+                }
+
+                #pragma omp for schedule(static) reduction(+:nchanged)
+                for(int i=0; i<_NNodes; i++) {
+                    if(next_changed[i]) {
+                        _metric[i] = next[i];
+                        nchanged++;
+                    }
+                }
             }
+
+            changed.swap(next_changed);
         }
+
+        return pass;
     }
 
     /* Start of code generated by fit_ellipsoid_3d.py. Warning - be careful about modifying
@@ -511,64 +595,34 @@ public:
         _metric[id].set_metric(metric);
     }
 
-    /// Update the metric field on the mesh.
+    /*! Relax the metric on the mesh towards the metric field. The two
+     * are blended in log-Euclidean space, which keeps the result
+     * positive definite and interpolates the element density
+     * geometrically.
+     * @param omega is the weight of the metric field.
+     */
     void relax_mesh(double omega)
     {
         assert(_metric!=NULL);
 
-        size_t pNElements = (size_t)predict_nelements_part();
-
-        // We don't really know how much addition space we'll need so this was set after some experimentation.
-        size_t fudge = 5;
-
-        if(pNElements > _mesh->NElements) {
-            // Let's leave a safety margin.
-            pNElements *= fudge;
-        } else {
-            /* The mesh can contain more elements than the predicted number, however
-             * some elements may still need to be refined, therefore until the mesh
-             * is coarsened and defraged we need extra space for the new vertices and
-             * elements that will be created during refinement.
-             */
-            pNElements = _mesh->NElements * fudge;
-        }
-
-        // In 2D, the number of nodes is ~ 1/2 the number of elements.
-        // In 3D, the number of nodes is ~ 1/6 the number of elements.
-        size_t pNNodes = pNElements/(dim==2?2:6);
-
-        _mesh->_ENList.resize(pNElements*(dim+1));
-        _mesh->boundary.resize(pNElements*(dim+1));
-        _mesh->quality.resize(pNElements);
-        _mesh->_coords.resize(pNNodes*dim);
-        _mesh->metric.resize(pNNodes*(dim==2?3:6));
-        _mesh->NNList.resize(pNNodes);
-        _mesh->NEList.resize(pNNodes);
-        _mesh->node_owner.resize(pNNodes, -1);
-        _mesh->lnn2gnn.resize(pNNodes, -1);
-
-#ifdef HAVE_MPI
-        // At this point we can establish a new, gappy global numbering system
-        if(nprocs>1)
-            _mesh->create_gappy_global_numbering(pNElements);
-#endif
+        reserve_mesh();
 
         // Enforce first-touch policy
         #pragma omp parallel
         {
             #pragma omp for schedule(static)
             for(int i=0; i<_NNodes; i++) {
-                double M[dim==2?3:6];
-                _metric[i].get_metric(M);
-                for(int j=0; j<(dim==2?3:6); j++)
-                    _mesh->metric[i*(dim==2?3:6)+j] = (1.0-omega)*_mesh->metric[i*(dim==2?3:6)+j] + omega*M[j];
-                MetricTensor<real_t,dim>::positive_definiteness(&(_mesh->metric[i*(dim==2?3:6)]));
+                real_t *m = &(_mesh->metric[i*(dim==2?3:6)]);
+                real_t log_old[dim==2?3:6], log_new[dim==2?3:6];
+                MetricTensor<real_t,dim>::log_metric(m, log_old);
+                MetricTensor<real_t,dim>::log_metric(_metric[i].get_metric(), log_new);
+                MetricTensor<real_t,dim>::log_interpolate(log_old, log_new, omega, m);
             }
         }
 
 #ifdef HAVE_MPI
         // Halo update if parallel
-        halo_update<double, (dim==2?3:6)>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->metric);
+        _mesh->halo_update_metric();
 #endif
     }
 
@@ -578,42 +632,7 @@ public:
     {
         assert(_metric!=NULL);
 
-        size_t pNElements = (size_t)predict_nelements_part();
-
-        // We don't really know how much addition space we'll need so this was set after some experimentation.
-        size_t fudge = 5;
-
-        if(pNElements > _mesh->NElements) {
-            // Let's leave a safety margin.
-            pNElements *= fudge;
-        } else {
-            /* The mesh can contain more elements than the predicted number, however
-             * some elements may still need to be refined, therefore until the mesh
-             * is coarsened and defraged we need extra space for the new vertices and
-             * elements that will be created during refinement.
-             */
-            pNElements = _mesh->NElements * fudge;
-        }
-
-        // In 2D, the number of nodes is ~ 1/2 the number of elements.
-        // In 3D, the number of nodes is ~ 1/6 the number of elements.
-        size_t pNNodes = std::max(pNElements/(dim==2?2:6), _mesh->get_number_nodes());
-
-        _mesh->_ENList.resize(pNElements*(dim+1));
-        _mesh->boundary.resize(pNElements*(dim+1));
-        _mesh->quality.resize(pNElements);
-        _mesh->_coords.resize(pNNodes*dim);
-        _mesh->metric.resize(pNNodes*(dim==2?3:6));
-        _mesh->NNList.resize(pNNodes);
-        _mesh->NEList.resize(pNNodes);
-        _mesh->node_owner.resize(pNNodes, -1);
-        _mesh->lnn2gnn.resize(pNNodes, -1);
-
-#ifdef HAVE_MPI
-        // At this point we can establish a new, gappy global numbering system
-        if(nprocs>1)
-            _mesh->create_gappy_global_numbering(pNElements);
-#endif
+        reserve_mesh();
 
         // Enforce first-touch policy
         #pragma omp parallel
@@ -622,15 +641,20 @@ public:
             for(int i=0; i<_NNodes; i++) {
                 _metric[i].get_metric(&(_mesh->metric[i*(dim==2?3:6)]));
             }
+            const int block = ElementProperty<real_t>::lipnikov_block;
             #pragma omp for schedule(static)
-            for(int i=0; i<_NElements; i++) {
-                _mesh->template update_quality<dim>(i);
+            for(int i=0; i<_NElements; i+=block) {
+                index_t eids[block];
+                int k = std::min(block, _NElements-i);
+                for(int j=0; j<k; j++)
+                    eids[j] = i+j;
+                _mesh->template update_quality<dim>(eids, eids+k);
             }
         }
 
 #ifdef HAVE_MPI
         // Halo update if parallel
-        halo_update<double, (dim==2?3:6)>(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->metric);
+        _mesh->halo_update_metric();
 #endif
     }
 
@@ -641,87 +665,126 @@ public:
      * apply the p-norm scaling to the metric, as in Chen, Sun and Xu,
      * Mathematics of Computation, Volume 76, Number 257, January 2007,
      * pp. 179-204.
+     * @param recovery selects how the Hessian of psi is recovered.
      */
-    void add_field(const real_t* psi, const real_t target_error, int p_norm=-1)
+    void add_field(const real_t* psi, const real_t target_error, int p_norm=-1, HessianRecovery recovery=QLS)
     {
+        add_fields(&psi, 1, &target_error, p_norm, recovery);
+    }
+
+    /*! Add the contribution from the metric fields of several fields, each
+     * with its own target linear interpolation error. This gives the same
+     * metric as calling add_field for each field in turn, but the
+     * Hessian recovery patch and least squares system are only built and
+     * factorised once per vertex.
+     * @param psis are the nfields fields.
+     * @param nfields is the number of fields.
+     * @param target_errors are the user target errors, one per field.
+     * @param p_norm as for add_field.
+     * @param recovery as for add_field.
+     */
+    void add_fields(const real_t* const* psis, int nfields, const real_t* target_errors, int p_norm=-1, HessianRecovery recovery=QLS)
+    {
+        if(nfields<1)
+            return;
+
         bool add_to=true;
         if(_metric==NULL) {
             add_to = false;
             _metric = new MetricTensor<real_t,dim>[_NNodes];
         }
 
-        real_t eta = 1.0/target_error;
+        const int msize = dim==2?3:6;
+
+        // The projection recovers the Hessians of all vertices at once.
+        std::vector<real_t> projected;
+        if(recovery==L2_PROJECTION) {
+            projected.resize(_NNodes*nfields*msize);
+            hessian_l2_projection(psis, nfields, &(projected[0]));
+        }
+
         #pragma omp parallel
         {
-            // Calculate Hessian at each point.
-            double h[dim==2?3:6];
-
-            if(p_norm>0) {
-                #pragma omp for schedule(static) nowait
-                for(int i=0; i<_NNodes; i++) {
-                    hessian_qls_kernel(psi, i, h);
-
-                    double m_det;
-                    if(dim==2) {
-                        /*|h[0] h[1]|
-                          |h[1] h[2]|*/
-                        m_det = fabs(h[0]*h[2]-h[1]*h[1]);
-                    } else if(dim==3) {
-                        /*|h[0] h[1] h[2]|
-                          |h[1] h[3] h[4]|
-                          |h[2] h[4] h[5]|
-
-                          sympy
-                          h0,h1,h2,h3,h4,h5 = symbols("h[0], h[1], h[2], h[3], h[4], h[5]")
-                          M = Matrix([[h0, h1, h2],
-                          [h1, h3, h4],
-                          [h2, h4, h5]])
-                          print_ccode(det(M))
-                          */
-                        m_det = fabs(h[0]*h[3]*h[5] - h[0]*pow(h[4], 2) - pow(h[1], 2)*h[5] + 2*h[1]*h[2]*h[4] - pow(h[2], 2)*h[3]);
-                    }
+            // Calculate Hessians at each point.
+            std::vector<real_t> h(nfields*msize);
 
-                    double scaling_factor = eta * pow(m_det+DBL_EPSILON, -1.0 / (2.0 * p_norm + dim));
+            #pragma omp for schedule(static)
+            for(int i=0; i<_NNodes; i++) {
+                if(recovery==L2_PROJECTION)
+                    std::copy(projected.begin()+i*nfields*msize, projected.begin()+(i+1)*nfields*msize, h.begin());
+                else
+                    hessian_qls_kernel(psis, nfields, i, &(h[0]));
 
-                    if(std::isnormal(scaling_factor)) {
-                        for(int j=0; j<(dim==2?3:6); j++)
-                            h[j] *= scaling_factor;
-                    } else {
-                        if(dim==2) {
-                            h[0] = min_eigenvalue;
-                            h[1] = 0.0;
-                            h[2] = min_eigenvalue;
-                        } else {
-                            h[0] = min_eigenvalue;
-                            h[1] = 0.0;
-                            h[2] = 0.0;
-                            h[3] = min_eigenvalue;
-                            h[4] = 0.0;
-                            h[5] = min_eigenvalue;
-                        }
-                    }
+                for(int f=0; f<nfields; f++) {
+                    real_t *hf = &(h[f*msize]);
+                    scale_hessian(hf, 1.0/target_errors[f], p_norm);
 
-                    if(add_to) {
+                    if(add_to || f>0) {
                         // Merge this metric with the existing metric field.
-                        _metric[i].constrain(h);
+                        _metric[i].constrain(hf);
                     } else {
-                        _metric[i].set_metric(h);
+                        _metric[i].set_metric(hf);
                     }
                 }
-            } else {
+            }
+        }
+    }
+
+    /*! Apply a set of constraints in a single sweep over the vertices.
+     * Each metric is eigen-decomposed once and all the edge length and
+     * aspect ratio bounds are imposed on its eigenvalues. Any element count
+     * is then imposed by a global scaling of the metric.
+     * @param constraints are the constraints to be applied.
+     */
+    void apply_constraints(const MetricConstraints<real_t> &constraints)
+    {
+        // Bounds on the eigenvalues.
+        const real_t min_d = constraints.max_len>0.0 ? 1.0/(constraints.max_len*constraints.max_len) : 0.0;
+        const real_t max_d = constraints.min_len>0.0 ? 1.0/(constraints.min_len*constraints.min_len) : DBL_MAX;
+        const real_t *local_min_len = constraints.local_min_len;
+        const real_t ratio2 = constraints.max_aspect_ratio*constraints.max_aspect_ratio;
+
+        if(min_d>0.0 || max_d<DBL_MAX || local_min_len!=NULL || constraints.max_aspect_ratio>0.0) {
+            #pragma omp parallel
+            {
                 #pragma omp for schedule(static)
                 for(int i=0; i<_NNodes; i++) {
-                    hessian_qls_kernel(psi, i, h);
-
-                    for(int j=0; j<(dim==2?3:6); j++)
-                        h[j] *= eta;
+                    real_t D[dim];
+                    const real_t *V=_metric[i].get_eigenvectors();
+                    const real_t *Di=_metric[i].get_eigenvalues();
+
+                    real_t d_max=0.0;
+                    for(int k=0; k<dim; k++) {
+                        D[k] = std::min(std::max(Di[k], min_d), max_d);
+                        if(local_min_len!=NULL)
+                            D[k] = std::min(D[k], 1.0/(local_min_len[i]*local_min_len[i]));
+                        d_max = std::max(d_max, D[k]);
+                    }
 
-                    if(add_to) {
-                        // Merge this metric with the existing metric field.
-                        _metric[i].constrain(h);
-                    } else {
-                        _metric[i].set_metric(h);
+                    if(constraints.max_aspect_ratio>0.0) {
+                        for(int k=0; k<dim; k++)
+                            D[k] = std::max(D[k], d_max/ratio2);
                     }
+
+                    _metric[i].eigen_undecomp(D, V);
+                }
+            }
+        }
+
+        if(constraints.nelements>0.0) {
+            real_t predicted = predict_nelements();
+            if(constraints.nelements_mode==MetricConstraints<real_t>::EXACT ||
+                    (constraints.nelements_mode==MetricConstraints<real_t>::AT_MOST && (int)predicted>constraints.nelements) ||
+                    (constraints.nelements_mode==MetricConstraints<real_t>::AT_LEAST && (int)predicted<constraints.nelements)) {
+                double scale_factor = constraints.nelements/predicted;
+                if(dim==3)
+                    scale_factor = pow(scale_factor, 2.0/3.0);
+
+                #pragma omp parallel
+                {
+                    #pragma omp for schedule(static)
+                    for(int i=0; i<_NNodes; i++)
+                        _metric[i].scale(scale_factor);
                 }
             }
         }
@@ -732,28 +795,9 @@ public:
      */
     void apply_max_edge_length(real_t max_len)
     {
-        real_t M[dim==2?3:6];
-        real_t m = 1.0/(max_len*max_len);
-
-        if(dim==2) {
-            M[0] = m;
-            M[1] = 0.0;
-            M[2] = m;
-        } else if(dim==3) {
-            M[0] = m;
-            M[1] = 0.0;
-            M[2] = 0.0;
-            M[3] = m;
-            M[4] = 0.0;
-            M[5] = m;
-        }
-
-        #pragma omp parallel
-        {
-            #pragma omp for schedule(static)
-            for(int i=0; i<_NNodes; i++)
-                _metric[i].constrain(&(M[0]));
-        }
+        MetricConstraints<real_t> constraints;
+        constraints.set_max_edge_length(max_len);
+        apply_constraints(constraints);
     }
 
     /*! Apply minimum edge length constraint.
@@ -761,28 +805,9 @@ public:
      */
     void apply_min_edge_length(real_t min_len)
     {
-        real_t M[dim==2?3:6];
-        double m = 1.0/(min_len*min_len);
-
-        if(dim==2) {
-            M[0] = m;
-            M[1] = 0.0;
-            M[2] = m;
-        } else if(dim==3) {
-            M[0] = m;
-            M[1] = 0.0;
-            M[2] = 0.0;
-            M[3] = m;
-            M[4] = 0.0;
-            M[5] = m;
-        }
-
-        #pragma omp parallel
-        {
-            #pragma omp for schedule(static)
-            for(int i=0; i<_NNodes; i++)
-                _metric[i].constrain(M, false);
-        }
+        MetricConstraints<real_t> constraints;
+        constraints.set_min_edge_length(min_len);
+        apply_constraints(constraints);
     }
 
     /*! Apply minimum edge length constraint.
@@ -790,30 +815,9 @@ public:
      */
     void apply_min_edge_length(const real_t *min_len)
     {
-        #pragma omp parallel
-        {
-            real_t M[dim==2?3:6];
-            #pragma omp for schedule(static)
-            for(int n=0; n<_NNodes; n++)
-            {
-                double m = 1.0/(min_len[n]*min_len[n]);
-
-                if(dim==2) {
-                    M[0] = m;
-                    M[1] = 0.0;
-                    M[2] = m;
-                } else if(dim==3) {
-                    M[0] = m;
-                    M[1] = 0.0;
-                    M[2] = 0.0;
-                    M[3] = m;
-                    M[4] = 0.0;
-                    M[5] = m;
-                }
-
-                _metric[n].constrain(M, false);
-            }
-        }
+        MetricConstraints<real_t> constraints;
+        constraints.set_min_edge_length(min_len);
+        apply_constraints(constraints);
     }
 
     /*! Apply maximum aspect ratio constraint.
@@ -821,12 +825,9 @@ public:
      */
     void apply_max_aspect_ratio(real_t max_aspect_ratio)
     {
-        #pragma omp parallel
-        {
-            #pragma omp for schedule(static)
-            for(int i=0; i<_NNodes; i++)
-                _metric[i].limit_aspect_ratio(max_aspect_ratio);
-        }
+        MetricConstraints<real_t> constraints;
+        constraints.set_max_aspect_ratio(max_aspect_ratio);
+        apply_constraints(constraints);
     }
 
     /*! Apply maximum number of elements constraint.
@@ -834,9 +835,9 @@ public:
      */
     void apply_max_nelements(real_t nelements)
     {
-        int predicted = predict_nelements();
-        if(predicted>nelements)
-            apply_nelements(nelements);
+        MetricConstraints<real_t> constraints;
+        constraints.set_nelements(nelements, MetricConstraints<real_t>::AT_MOST);
+        apply_constraints(constraints);
     }
 
     /*! Apply minimum number of elements constraint.
@@ -844,9 +845,9 @@ public:
      */
     void apply_min_nelements(real_t nelements)
     {
-        int predicted = predict_nelements();
-        if(predicted<nelements)
-            apply_nelements(nelements);
+        MetricConstraints<real_t> constraints;
+        constraints.set_nelements(nelements, MetricConstraints<real_t>::AT_LEAST);
+        apply_constraints(constraints);
     }
 
     /*! Apply required number of elements.
@@ -854,126 +855,362 @@ public:
      */
     void apply_nelements(real_t nelements)
     {
-        double scale_factor = nelements/predict_nelements();
-        if(dim==3)
-            scale_factor = pow(scale_factor, 2.0/3.0);
-
-        #pragma omp parallel
-        {
-            #pragma omp for schedule(static)
-            for(int i=0; i<_NNodes; i++)
-                _metric[i].scale(scale_factor);
-        }
+        MetricConstraints<real_t> constraints;
+        constraints.set_nelements(nelements);
+        apply_constraints(constraints);
     }
 
     /*! Predict the number of elements in this partition when mesh satisfies metric tensor field.
     */
     real_t predict_nelements_part()
     {
-        real_t predicted;
+        real_t predicted = 0.0;
 
-        if(dim==2) {
-            real_t total_area_metric = 0.0;
+        #pragma omp parallel for schedule(static) reduction(+:predicted)
+        for(int i=0; i<_NElements; i++)
+            predicted += predict_element_weight(i);
 
-            const real_t inv3=1.0/3.0;
+        return predicted;
+    }
 
-            const real_t *refx0 = _mesh->get_coords(_mesh->get_element(0)[0]);
-            const real_t *refx1 = _mesh->get_coords(_mesh->get_element(0)[1]);
-            const real_t *refx2 = _mesh->get_coords(_mesh->get_element(0)[2]);
-            ElementProperty<real_t> property(refx0, refx1, refx2);
+    /*! Predict the number of elements when mesh satisfies metric tensor field.
+    */
+    real_t predict_nelements()
+    {
+        double predicted=predict_nelements_part();
 
-            #pragma omp parallel for reduction(+:total_area_metric)
-            for(int i=0; i<_NElements; i++) {
-                const index_t *n=_mesh->get_element(i);
+#ifdef HAVE_MPI
+        if(nprocs>1) {
+            MPI_Allreduce(MPI_IN_PLACE, &predicted, 1, _mesh->MPI_REAL_T, MPI_SUM, _mesh->get_mpi_comm());
+        }
+#endif
 
-                const real_t *x0 = _mesh->get_coords(n[0]);
-                const real_t *x1 = _mesh->get_coords(n[1]);
-                const real_t *x2 = _mesh->get_coords(n[2]);
-                real_t area = property.area(x0, x1, x2);
+        return predicted;
+    }
 
-                const real_t *m0=_metric[n[0]].get_metric();
-                const real_t *m1=_metric[n[1]].get_metric();
-                const real_t *m2=_metric[n[2]].get_metric();
+    /*! Predict the number of vertices in this partition when mesh satisfies metric tensor field.
+    */
+    real_t predict_nnodes_part()
+    {
+        return predict_nelements_part()/(dim==2?2.0:5.2);
+    }
 
-                real_t m00 = (m0[0]+m1[0]+m2[0])*inv3;
-                real_t m01 = (m0[1]+m1[1]+m2[1])*inv3;
-                real_t m11 = (m0[2]+m1[2]+m2[2])*inv3;
+    /*! Predict the number of vertices when mesh satisfies metric tensor field.
+    */
+    real_t predict_nnodes()
+    {
+        return predict_nelements()/(dim==2?2.0:5.2);
+    }
 
-                real_t det = std::abs(m00*m11-m01*m01);
+    /*! Predict how many elements each element of the current mesh will
+     * be replaced by when the mesh satisfies the metric tensor field.
+     * The weights sum to predict_nelements_part().
+     * @param weights is resized to the number of elements. Deleted elements have zero weight.
+     */
+    void predict_element_weights(std::vector<real_t> &weights)
+    {
+        weights.resize(_NElements);
 
-                total_area_metric += area*sqrt(det);
-            }
+        #pragma omp parallel for schedule(static)
+        for(int i=0; i<_NElements; i++)
+            weights[i] = predict_element_weight(i);
+    }
 
-            /* Ideal area of equilateral triangle in metric space:
-               s^2*sqrt(3)/4 where s is the length of the side. However, algorithm
-               allows lengths from 1/sqrt(2) up to sqrt(2) in metric
-               space. Therefore:*/
-            const real_t smallest_ideal_area = 0.5*(sqrt(3.0)/4.0);
-            predicted = total_area_metric/smallest_ideal_area;
-        } else if(dim==3) {
-            real_t total_volume_metric = 0.0;
-
-            const real_t *refx0 = _mesh->get_coords(_mesh->get_element(0)[0]);
-            const real_t *refx1 = _mesh->get_coords(_mesh->get_element(0)[1]);
-            const real_t *refx2 = _mesh->get_coords(_mesh->get_element(0)[2]);
-            const real_t *refx3 = _mesh->get_coords(_mesh->get_element(0)[3]);
-            ElementProperty<real_t> property(refx0, refx1, refx2, refx3);
-
-            #pragma omp parallel for reduction(+:total_volume_metric)
-            for(int i=0; i<_NElements; i++) {
-                const index_t *n=_mesh->get_element(i);
-
-                const real_t *x0 = _mesh->get_coords(n[0]);
-                const real_t *x1 = _mesh->get_coords(n[1]);
-                const real_t *x2 = _mesh->get_coords(n[2]);
-                const real_t *x3 = _mesh->get_coords(n[3]);
-                real_t volume = property.volume(x0, x1, x2, x3);
-
-                const real_t *m0=_metric[n[0]].get_metric();
-                const real_t *m1=_metric[n[1]].get_metric();
-                const real_t *m2=_metric[n[2]].get_metric();
-                const real_t *m3=_metric[n[3]].get_metric();
-
-                real_t m00 = (m0[0]+m1[0]+m2[0]+m3[0])*0.25;
-                real_t m01 = (m0[1]+m1[1]+m2[1]+m3[1])*0.25;
-                real_t m02 = (m0[2]+m1[2]+m2[2]+m3[2])*0.25;
-                real_t m11 = (m0[3]+m1[3]+m2[3]+m3[3])*0.25;
-                real_t m12 = (m0[4]+m1[4]+m2[4]+m3[4])*0.25;
-                real_t m22 = (m0[5]+m1[5]+m2[5]+m3[5])*0.25;
-
-                real_t det = (m11*m22 - m12*m12)*m00 - (m01*m22 - m02*m12)*m01 + (m01*m12 - m02*m11)*m02;
-
-                assert(det>-DBL_EPSILON);
-                total_volume_metric += volume*sqrt(det);
-            }
+    /*! Predict the number of elements each vertex will be surrounded by,
+     * shared equally between the vertices of an element, when the mesh
+     * satisfies the metric tensor field. This is the expected adaptive
+     * work per vertex and is suitable as a vertex weight for
+     * partitioning before adaptation. The weights sum to
+     * predict_nelements_part().
+     * @param weights is resized to the number of vertices.
+     */
+    void predict_vertex_weights(std::vector<real_t> &weights)
+    {
+        std::vector<real_t> element_weights;
+        predict_element_weights(element_weights);
 
-            // Ideal volume of triangle in metric space.
-            real_t ideal_volume = 1.0/sqrt(72.0);
-            predicted = total_volume_metric/ideal_volume;
-        }
+        weights.resize(_NNodes);
 
-        return predicted;
+        const real_t inv_nloc = 1.0/(dim+1);
+        #pragma omp parallel for schedule(static)
+        for(int i=0; i<_NNodes; i++) {
+            real_t w = 0.0;
+            for(typename std::set<index_t>::const_iterator it=_mesh->NEList[i].begin(); it!=_mesh->NEList[i].end(); ++it)
+                w += element_weights[*it];
+            weights[i] = w*inv_nloc;
+        }
     }
 
-    /*! Predict the number of elements when mesh satisfies metric tensor field.
-    */
-    real_t predict_nelements()
+    /*! Predict the load imbalance after adaptation, i.e. the ratio of
+     * the largest predicted partition to the mean predicted partition
+     * size. A value close to 1 means the partitioning will remain
+     * balanced.
+     */
+    real_t predict_load_imbalance()
     {
         double predicted=predict_nelements_part();
+        double largest=predicted, total=predicted;
 
 #ifdef HAVE_MPI
         if(nprocs>1) {
-            MPI_Allreduce(MPI_IN_PLACE, &predicted, 1, _mesh->MPI_REAL_T, MPI_SUM, _mesh->get_mpi_comm());
+            MPI_Allreduce(&predicted, &largest, 1, MPI_DOUBLE, MPI_MAX, _mesh->get_mpi_comm());
+            MPI_Allreduce(&predicted, &total, 1, MPI_DOUBLE, MPI_SUM, _mesh->get_mpi_comm());
         }
 #endif
 
-        return predicted;
+        if(total<=0.0)
+            return 1.0;
+
+        return largest*nprocs/total;
     }
 
 private:
 
+    /*! Size the mesh arrays for adapting to the metric field. Deleted
+     * elements and vertices keep their slots until the mesh is
+     * defragmented, so besides the larger of the current and the
+     * predicted mesh room is left for refining up to the predicted
+     * mesh (twice over in 3D, where coarsening lags behind). Refine
+     * and Mesh::append_element grow the arrays if this falls short.
+     */
+    void reserve_mesh()
+    {
+        size_t predicted = (size_t)predict_nelements_part();
+        size_t pNElements = std::max(predicted, _mesh->NElements) + (dim-1)*predicted;
+        size_t pNNodes = std::max((size_t)(pNElements/(dim==2?2.0:5.2)), _mesh->NNodes);
+
+        _mesh->_ENList.resize(pNElements*(dim+1));
+        _mesh->boundary.resize(pNElements*(dim+1));
+        _mesh->quality.resize(pNElements);
+        _mesh->_coords.resize(pNNodes*dim);
+        _mesh->metric.resize(pNNodes*(dim==2?3:6));
+        _mesh->fields.resize(pNNodes*_mesh->nfields);
+        _mesh->NNList.resize(pNNodes);
+        _mesh->NEList.resize(pNNodes);
+        _mesh->node_owner.resize(pNNodes, -1);
+        _mesh->lnn2gnn.resize(pNNodes, -1);
+
+#ifdef HAVE_MPI
+        // At this point we can establish a new, gappy global numbering system
+        if(nprocs>1)
+            _mesh->create_gappy_global_numbering(pNElements);
+#endif
+    }
+
+    /*! Predict the number of elements that element i will be replaced
+     * by: its volume in metric space over the metric volume of an
+     * element of the adapted mesh.
+     */
+    real_t predict_element_weight(int i) const
+    {
+        const index_t *n=_mesh->get_element(i);
+        if(n[0]<0)
+            return 0.0;
+
+        if(dim==2) {
+            const real_t inv3=1.0/3.0;
+
+            real_t area = std::abs(_mesh->property->area(_mesh->get_coords(n[0]),
+                                   _mesh->get_coords(n[1]),
+                                   _mesh->get_coords(n[2])));
+
+            const real_t *m0=_metric[n[0]].get_metric();
+            const real_t *m1=_metric[n[1]].get_metric();
+            const real_t *m2=_metric[n[2]].get_metric();
+
+            real_t m00 = (m0[0]+m1[0]+m2[0])*inv3;
+            real_t m01 = (m0[1]+m1[1]+m2[1])*inv3;
+            real_t m11 = (m0[2]+m1[2]+m2[2])*inv3;
+
+            real_t det = std::abs(m00*m11-m01*m01);
+
+            /* The area of a unit equilateral triangle is sqrt(3)/4. The
+               lengths of the edges of the adapted mesh range from
+               1/sqrt(2) up to sqrt(2) in metric space and the elements
+               are not equilateral, so the mean element is somewhat
+               smaller: ~0.88 of the ideal, calibrated over isotropic,
+               anisotropic and field driven adapts (+/-15%).*/
+            const real_t ideal_area = 0.88*sqrt(3.0)/4.0;
+            return area*sqrt(det)/ideal_area;
+        } else {
+            real_t volume = std::abs(_mesh->property->volume(_mesh->get_coords(n[0]),
+                                     _mesh->get_coords(n[1]),
+                                     _mesh->get_coords(n[2]),
+                                     _mesh->get_coords(n[3])));
+
+            const real_t *m0=_metric[n[0]].get_metric();
+            const real_t *m1=_metric[n[1]].get_metric();
+            const real_t *m2=_metric[n[2]].get_metric();
+            const real_t *m3=_metric[n[3]].get_metric();
+
+            real_t m00 = (m0[0]+m1[0]+m2[0]+m3[0])*0.25;
+            real_t m01 = (m0[1]+m1[1]+m2[1]+m3[1])*0.25;
+            real_t m02 = (m0[2]+m1[2]+m2[2]+m3[2])*0.25;
+            real_t m11 = (m0[3]+m1[3]+m2[3]+m3[3])*0.25;
+            real_t m12 = (m0[4]+m1[4]+m2[4]+m3[4])*0.25;
+            real_t m22 = (m0[5]+m1[5]+m2[5]+m3[5])*0.25;
+
+            real_t det = (m11*m22 - m12*m12)*m00 - (m01*m22 - m02*m12)*m01 + (m01*m12 - m02*m11)*m02;
+
+            assert(det>-DBL_EPSILON);
+
+            // Volume of the unit regular tetrahedron is 1/sqrt(72); calibrated as in 2D.
+            const real_t ideal_volume = 0.72/sqrt(72.0);
+            return volume*sqrt(std::max(det, (real_t)0.0))/ideal_volume;
+        }
+    }
+
+    /*! Cheap sufficient test for Mc <= Mi, where both metrics are given
+     * by their eigen-decompositions. Mc is mapped into the space where
+     * Mi is the identity and its eigenvalues are bounded with
+     * Gershgorin's theorem.
+     */
+    static bool weaker_metric(const real_t *Di, const real_t *Vi, const real_t *Dc, const real_t *Vc)
+    {
+        // P = Vi*Vc^T; the mapped metric is Di^-1/2 P Dc P^T Di^-1/2.
+        real_t P[dim][dim];
+        for(int a=0; a<dim; a++) {
+            for(int b=0; b<dim; b++) {
+                P[a][b] = 0;
+                for(int k=0; k<dim; k++)
+                    P[a][b] += Vi[a*dim+k]*Vc[b*dim+k];
+            }
+        }
+
+        for(int a=0; a<dim; a++) {
+            real_t row=0;
+            for(int b=0; b<dim; b++) {
+                real_t t=0;
+                for(int k=0; k<dim; k++)
+                    t += P[a][k]*Dc[k]*P[b][k];
+                row += std::abs(t)/sqrt(Di[a]*Di[b]);
+            }
+            if(row>1.0)
+                return false;
+        }
+
+        return true;
+    }
+
+    /*! Scale a Hessian by the inverse target error eta, with the
+     * optional p-norm scaling of add_field.
+     */
+    void scale_hessian(real_t *h, real_t eta, int p_norm) const
+    {
+        if(p_norm>0) {
+            double m_det;
+            if(dim==2) {
+                /*|h[0] h[1]|
+                  |h[1] h[2]|*/
+                m_det = fabs(h[0]*h[2]-h[1]*h[1]);
+            } else if(dim==3) {
+                /*|h[0] h[1] h[2]|
+                  |h[1] h[3] h[4]|
+                  |h[2] h[4] h[5]|
+
+                  sympy
+                  h0,h1,h2,h3,h4,h5 = symbols("h[0], h[1], h[2], h[3], h[4], h[5]")
+                  M = Matrix([[h0, h1, h2],
+                  [h1, h3, h4],
+                  [h2, h4, h5]])
+                  print_ccode(det(M))
+                  */
+                m_det = fabs(h[0]*h[3]*h[5] - h[0]*pow(h[4], 2) - pow(h[1], 2)*h[5] + 2*h[1]*h[2]*h[4] - pow(h[2], 2)*h[3]);
+            }
+
+            double scaling_factor = eta * pow(m_det+DBL_EPSILON, -1.0 / (2.0 * p_norm + dim));
+
+            if(std::isnormal(scaling_factor)) {
+                for(int j=0; j<(dim==2?3:6); j++)
+                    h[j] *= scaling_factor;
+            } else {
+                if(dim==2) {
+                    h[0] = min_eigenvalue;
+                    h[1] = 0.0;
+                    h[2] = min_eigenvalue;
+                } else {
+                    h[0] = min_eigenvalue;
+                    h[1] = 0.0;
+                    h[2] = 0.0;
+                    h[3] = min_eigenvalue;
+                    h[4] = 0.0;
+                    h[5] = min_eigenvalue;
+                }
+            }
+        } else {
+            for(int j=0; j<(dim==2?3:6); j++)
+                h[j] *= eta;
+        }
+    }
+
+    /*! Solve the normal equations A a = b of the quadratic fit. A is
+     * symmetric positive definite unless the patch is degenerate, so it is
+     * Jacobi scaled (the monomials range from 1 to x^4) and Cholesky
+     * factorised. Only when the scaled factorisation fails or its pivots
+     * suggest it is close to rank deficient do we fall back to the more
+     * expensive SVD.
+     * Solve field by field so the result does not depend on the number
+     * of columns of b.
+     */
+    template<int N>
+    static void qls_solve(const Eigen::Matrix<real_t, N, N> &A,
+                          const Eigen::Matrix<real_t, N, Eigen::Dynamic> &b,
+                          Eigen::Matrix<real_t, N, Eigen::Dynamic> &a)
+    {
+        bool spd=true;
+        Eigen::Matrix<real_t, N, 1> s;
+        for(int j=0; j<N; j++) {
+            if(A(j,j)>0.0) {
+                s[j] = 1.0/sqrt(A(j,j));
+            } else {
+                spd = false;
+                break;
+            }
+        }
+
+        if(spd) {
+            Eigen::Matrix<real_t, N, N> As = s.asDiagonal()*A*s.asDiagonal();
+            Eigen::LLT<Eigen::Matrix<real_t, N, N> > llt(As);
+
+            if(llt.info()==Eigen::Success) {
+                // Cheap rank deficiency heuristic: the squared ratio of the
+                // extreme Cholesky pivots is only a lower bound on the
+                // condition number of the scaled matrix, so worse
+                // conditioned systems can pass it. It avoids computing an
+                // eigenvalue or rcond estimate for every vertex.
+                real_t lmin=llt.matrixLLT()(0,0), lmax=lmin;
+                for(int j=1; j<N; j++) {
+                    lmin = std::min(lmin, llt.matrixLLT()(j,j));
+                    lmax = std::max(lmax, llt.matrixLLT()(j,j));
+                }
+
+                if(lmin>1.0e-6*lmax) {
+                    for(int f=0; f<b.cols(); f++)
+                        a.col(f) = s.asDiagonal()*llt.solve(s.asDiagonal()*b.col(f));
+                    return;
+                }
+            }
+        }
+
+        Eigen::JacobiSVD<Eigen::Matrix<real_t, N, N>, Eigen::HouseholderQRPreconditioner> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+        for(int f=0; f<b.cols(); f++)
+            a.col(f) = svd.solve(b.col(f));
+    }
+
     /// Least squared Hessian recovery.
     void hessian_qls_kernel(const real_t *psi, int i, real_t *Hessian)
+    {
+        hessian_qls_kernel(&psi, 1, i, Hessian);
+    }
+
+    /*! Least squared Hessian recovery of several fields at once. The
+     * least squares matrix only depends on the patch geometry, so it is
+     * assembled and factorised once and all fields are solved for together.
+     * @param psis are the nfields fields.
+     * @param i is the vertex at which the Hessians are recovered.
+     * @param Hessians receives the nfields Hessians, one after the other.
+     */
+    void hessian_qls_kernel(const real_t* const* psis, int nfields, int i, real_t *Hessians)
     {
         int min_patch_size = (dim==2?6:15); // In 3D, 10 is the minimum but can give crappy results.
 
@@ -985,7 +1222,7 @@ private:
             // P = a0*y^2+a1*x^2+a2*x*y+a3*y+a4*x+a5
             // A = P^TP
             Eigen::Matrix<real_t, 6, 6> A = Eigen::Matrix<real_t, 6, 6>::Zero(6,6);
-            Eigen::Matrix<real_t, 6, 1> b = Eigen::Matrix<real_t, 6, 1>::Zero(6);
+            Eigen::Matrix<real_t, 6, Eigen::Dynamic> b = Eigen::Matrix<real_t, 6, Eigen::Dynamic>::Zero(6, nfields);
 
             real_t x0=_mesh->_coords[i*2], y0=_mesh->_coords[i*2+1];
 
@@ -1014,12 +1251,15 @@ private:
                 A(5,4)+=x;
                 A(5,5)+=1;
 
-                b[0]+=psi[*n]*y*y;
-                b[1]+=psi[*n]*x*x;
-                b[2]+=psi[*n]*x*y;
-                b[3]+=psi[*n]*y;
-                b[4]+=psi[*n]*x;
-                b[5]+=psi[*n];
+                for(int f=0; f<nfields; f++) {
+                    real_t psi=psis[f][*n];
+                    b(0,f)+=psi*y*y;
+                    b(1,f)+=psi*x*x;
+                    b(2,f)+=psi*x*y;
+                    b(3,f)+=psi*y;
+                    b(4,f)+=psi*x;
+                    b(5,f)+=psi;
+                }
             }
             A(0,1) = A(1,0);
             A(0,2) = A(2,0);
@@ -1037,21 +1277,22 @@ private:
             A(3,5)= A(5,3);
             A(4,5)= A(5,4);
 
-            Eigen::Matrix<real_t, 6, 1> a = Eigen::Matrix<real_t, 6, 1>::Zero(6);
-            Eigen::JacobiSVD<Eigen::Matrix<real_t, 6, 6>, Eigen::HouseholderQRPreconditioner> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+            Eigen::Matrix<real_t, 6, Eigen::Dynamic> a(6, nfields);
+            qls_solve<6>(A, b, a);
 
-            a = svd.solve(b);
-
-            Hessian[0] = 2*a[1]; // d2/dx2
-            Hessian[1] = a[2];   // d2/dxdy
-            Hessian[2] = 2*a[0]; // d2/dy2
+            for(int f=0; f<nfields; f++) {
+                real_t *Hessian = Hessians+f*3;
+                Hessian[0] = 2*a(1,f); // d2/dx2
+                Hessian[1] = a(2,f);   // d2/dxdy
+                Hessian[2] = 2*a(0,f); // d2/dy2
+            }
 
         } else if(dim==3) {
             // Form quadratic system to be solved. The quadratic fit is:
             // P = 1 + x + y + z + x^2 + y^2 + z^2 + xy + xz + yz
             // A = P^TP
             Eigen::Matrix<real_t, 10, 10> A = Eigen::Matrix<real_t, 10, 10>::Zero(10,10);
-            Eigen::Matrix<real_t, 10, 1> b = Eigen::Matrix<real_t, 10, 1>::Zero(10);
+            Eigen::Matrix<real_t, 10, Eigen::Dynamic> b = Eigen::Matrix<real_t, 10, Eigen::Dynamic>::Zero(10, nfields);
 
             real_t x0=_mesh->_coords[i*3], y0=_mesh->_coords[i*3+1], z0=_mesh->_coords[i*3+2];
             assert(std::isfinite(x0));
@@ -1063,7 +1304,6 @@ private:
                 assert(std::isfinite(x));
                 assert(std::isfinite(y));
                 assert(std::isfinite(z));
-                assert(std::isfinite(psi[*n]));
 
                 A(0,0)+=1;
                 A(1,0)+=x;
@@ -1121,16 +1361,21 @@ private:
                 A(9,8)+=y*z*z*z;
                 A(9,9)+=z*z*z*z;
 
-                b[0]+=psi[*n]*1;
-                b[1]+=psi[*n]*x;
-                b[2]+=psi[*n]*y;
-                b[3]+=psi[*n]*z;
-                b[4]+=psi[*n]*x*x;
-                b[5]+=psi[*n]*x*y;
-                b[6]+=psi[*n]*x*z;
-                b[7]+=psi[*n]*y*y;
-                b[8]+=psi[*n]*y*z;
-                b[9]+=psi[*n]*z*z;
+                for(int f=0; f<nfields; f++) {
+                    real_t psi=psis[f][*n];
+                    assert(std::isfinite(psi));
+
+                    b(0,f)+=psi*1;
+                    b(1,f)+=psi*x;
+                    b(2,f)+=psi*y;
+                    b(3,f)+=psi*z;
+                    b(4,f)+=psi*x*x;
+                    b(5,f)+=psi*x*y;
+                    b(6,f)+=psi*x*z;
+                    b(7,f)+=psi*y*y;
+                    b(8,f)+=psi*y*z;
+                    b(9,f)+=psi*z*z;
+                }
             }
 
             A(0,1) = A(1,0);
@@ -1179,17 +1424,256 @@ private:
             A(7,9) = A(9,7);
             A(8,9) = A(9,8);
 
-            Eigen::Matrix<real_t, 10, 1> a = Eigen::Matrix<real_t, 10, 1>::Zero(10);
-            Eigen::JacobiSVD<Eigen::Matrix<real_t, 10, 10>, Eigen::HouseholderQRPreconditioner> svd(A, Eigen::ComputeThinU | Eigen::ComputeThinV);
+            Eigen::Matrix<real_t, 10, Eigen::Dynamic> a(10, nfields);
+            qls_solve<10>(A, b, a);
+
+            for(int f=0; f<nfields; f++) {
+                real_t *Hessian = Hessians+f*6;
+                Hessian[0] = a(4,f)*2.0; // d2/dx2
+                Hessian[1] = a(5,f);     // d2/dxdy
+                Hessian[2] = a(6,f);     // d2/dxdz
+                Hessian[3] = a(7,f)*2.0; // d2/dy2
+                Hessian[4] = a(8,f);     // d2/dydz
+                Hessian[5] = a(9,f)*2.0; // d2/dz2
+            }
+        }
+    }
+
+    /// Collect the vertices not on the boundary within nlayers of vertex i.
+    void get_interior_patch(index_t i, const std::vector<char> &on_boundary, int nlayers, std::set<index_t> &interior) const
+    {
+        for(typename std::vector<index_t>::const_iterator it=_mesh->NNList[i].begin(); it!=_mesh->NNList[i].end(); ++it) {
+            if(!on_boundary[*it])
+                interior.insert(*it);
+
+            if(nlayers>1) {
+                for(typename std::vector<index_t>::const_iterator jt=_mesh->NNList[*it].begin(); jt!=_mesh->NNList[*it].end(); ++jt) {
+                    if(!on_boundary[*jt])
+                        interior.insert(*jt);
+                }
+            }
+        }
+    }
+
+    /*! Hessian recovery of several fields by double L2 projection. The
+     * gradient of each field is constant on an element; projecting it onto
+     * the vertices with a lumped mass matrix (the volume weighted average
+     * over the elements around a vertex) recovers a continuous gradient.
+     * Repeating this on the recovered gradient gives the Hessian. Both
+     * projections are a streaming loop over the elements followed by a
+     * gather over NEList. The projection is only first order accurate on
+     * the boundary, so there the gradient is extrapolated from the interior
+     * and the Hessian is taken as the average over the interior neighbours.
+     * @param psis are the nfields fields.
+     * @param nfields is the number of fields.
+     * @param Hessians receives the nfields Hessians of every vertex, one
+     * vertex after the other.
+     */
+    void hessian_l2_projection(const real_t* const* psis, int nfields, real_t *Hessians)
+    {
+        const int nloc = dim+1;
+        const int msize = dim==2?3:6;
+
+        // Shape function gradients and volume (up to a constant) of each element.
+        std::vector<real_t> dN(_NElements*nloc*dim), vol(_NElements);
+        std::vector<real_t> element_grad(_NElements*dim), element_hessian(_NElements*msize);
+        std::vector< std::vector<real_t> > grad(nfields, std::vector<real_t>(_NNodes*dim));
+        std::vector<char> on_boundary(_NNodes, 0);
+
+#ifdef HAVE_MPI
+        // The same halo plan is used for the gradient of every field.
+        HaloPlan<real_t> grad_plan(_mesh->get_mpi_comm(), _mesh->send, _mesh->recv, _mesh->get_topology_version(), dim);
+#endif
+
+        #pragma omp parallel
+        {
+            #pragma omp for schedule(static)
+            for(int e=0; e<_NElements; e++) {
+                const index_t *n = _mesh->get_element(e);
+                if(n[0]<0) {
+                    vol[e] = 0.0;
+                    continue;
+                }
+
+                Eigen::Matrix<real_t, dim, dim> J;
+                for(int k=0; k<dim; k++)
+                    for(int d=0; d<dim; d++)
+                        J(d,k) = _mesh->_coords[n[k+1]*dim+d]-_mesh->_coords[n[0]*dim+d];
+
+                Eigen::Matrix<real_t, dim, dim> Jinv = J.inverse();
+                vol[e] = std::abs(J.determinant());
+
+                real_t *dNe = &(dN[e*nloc*dim]);
+                for(int d=0; d<dim; d++) {
+                    dNe[d] = 0.0;
+                    for(int k=0; k<dim; k++) {
+                        dNe[(k+1)*dim+d] = Jinv(k,d);
+                        dNe[d] -= Jinv(k,d);
+                    }
+                }
+            }
+
+            // Boundary vertices are those on a boundary facet.
+            if(_mesh->boundary.size()) {
+                #pragma omp for schedule(static)
+                for(int i=0; i<_NNodes; i++) {
+                    for(typename std::set<index_t>::const_iterator it=_mesh->NEList[i].begin(); it!=_mesh->NEList[i].end(); ++it) {
+                        const index_t *n = _mesh->get_element(*it);
+                        for(int k=0; k<nloc; k++) {
+                            if(n[k]!=i && _mesh->boundary[(*it)*nloc+k]>0)
+                                on_boundary[i] = 1;
+                        }
+                    }
+                }
+            }
+
+            for(int f=0; f<nfields; f++) {
+                const real_t *psi = psis[f];
+
+                // First projection: element gradients onto the vertices.
+                #pragma omp for schedule(static)
+                for(int e=0; e<_NElements; e++) {
+                    if(vol[e]==0.0)
+                        continue;
+
+                    const index_t *n = _mesh->get_element(e);
+                    const real_t *dNe = &(dN[e*nloc*dim]);
+                    for(int d=0; d<dim; d++) {
+                        real_t g=0.0;
+                        for(int k=0; k<nloc; k++)
+                            g += psi[n[k]]*dNe[k*dim+d];
+                        element_grad[e*dim+d] = g;
+                    }
+                }
+
+                #pragma omp for schedule(static)
+                for(int i=0; i<_NNodes; i++) {
+                    real_t g[dim], sum_vol=0.0;
+                    for(int d=0; d<dim; d++)
+                        g[d] = 0.0;
+
+                    for(typename std::set<index_t>::const_iterator it=_mesh->NEList[i].begin(); it!=_mesh->NEList[i].end(); ++it) {
+                        sum_vol += vol[*it];
+                        for(int d=0; d<dim; d++)
+                            g[d] += vol[*it]*element_grad[(*it)*dim+d];
+                    }
+
+                    for(int d=0; d<dim; d++)
+                        grad[f][i*dim+d] = sum_vol>0.0 ? g[d]/sum_vol : 0.0;
+                }
+
+                // The projected gradient is only first order on the
+                // boundary, which would spoil the Hessian of the next layer
+                // in. Instead extrapolate a linear fit of the gradients of
+                // the nearest interior vertices.
+                #pragma omp for schedule(static)
+                for(int i=0; i<_NNodes; i++) {
+                    if(!on_boundary[i])
+                        continue;
+
+                    // The interior neighbours alone can be coplanar, so
+                    // always fit over two layers.
+                    std::set<index_t> interior;
+                    get_interior_patch(i, on_boundary, 2, interior);
+                    if(interior.size()<(size_t)nloc)
+                        continue;
+
+                    // Fit g = a0 + a1*x + ... componentwise, with x relative to vertex i.
+                    Eigen::Matrix<real_t, dim+1, dim+1> A = Eigen::Matrix<real_t, dim+1, dim+1>::Zero();
+                    Eigen::Matrix<real_t, dim+1, Eigen::Dynamic> b = Eigen::Matrix<real_t, dim+1, Eigen::Dynamic>::Zero(dim+1, dim);
+                    for(typename std::set<index_t>::const_iterator it=interior.begin(); it!=interior.end(); ++it) {
+                        Eigen::Matrix<real_t, dim+1, 1> p;
+                        p[0] = 1.0;
+                        for(int d=0; d<dim; d++)
+                            p[d+1] = _mesh->_coords[(*it)*dim+d]-_mesh->_coords[i*dim+d];
+
+                        A += p*p.transpose();
+                        for(int c=0; c<dim; c++)
+                            b.col(c) += grad[f][(*it)*dim+c]*p;
+                    }
+
+                    Eigen::Matrix<real_t, dim+1, Eigen::Dynamic> a(dim+1, dim);
+                    qls_solve<dim+1>(A, b, a);
+                    for(int c=0; c<dim; c++)
+                        grad[f][i*dim+c] = a(0,c);
+                }
+
+#ifdef HAVE_MPI
+                #pragma omp single
+                {
+                    grad_plan.update(grad[f]);
+                }
+#endif
+
+                // Second projection: symmetrised element gradients of the
+                // recovered gradient onto the vertices.
+                #pragma omp for schedule(static)
+                for(int e=0; e<_NElements; e++) {
+                    if(vol[e]==0.0)
+                        continue;
+
+                    const index_t *n = _mesh->get_element(e);
+                    const real_t *dNe = &(dN[e*nloc*dim]);
+                    real_t H[dim][dim];
+                    for(int c=0; c<dim; c++) {
+                        for(int d=0; d<dim; d++) {
+                            H[c][d] = 0.0;
+                            for(int k=0; k<nloc; k++)
+                                H[c][d] += grad[f][n[k]*dim+c]*dNe[k*dim+d];
+                        }
+                    }
+
+                    for(int c=0, m=0; c<dim; c++)
+                        for(int d=c; d<dim; d++, m++)
+                            element_hessian[e*msize+m] = 0.5*(H[c][d]+H[d][c]);
+                }
+
+                #pragma omp for schedule(static)
+                for(int i=0; i<_NNodes; i++) {
+                    real_t *h = Hessians+(i*nfields+f)*msize;
+                    real_t sum_vol=0.0;
+                    for(int m=0; m<msize; m++)
+                        h[m] = 0.0;
+
+                    for(typename std::set<index_t>::const_iterator it=_mesh->NEList[i].begin(); it!=_mesh->NEList[i].end(); ++it) {
+                        sum_vol += vol[*it];
+                        for(int m=0; m<msize; m++)
+                            h[m] += vol[*it]*element_hessian[(*it)*msize+m];
+                    }
+
+                    if(sum_vol>0.0) {
+                        for(int m=0; m<msize; m++)
+                            h[m] /= sum_vol;
+                    }
+                }
+
+                // Replace the boundary values by the average over the
+                // interior neighbours, where there are any.
+                #pragma omp for schedule(static)
+                for(int i=0; i<_NNodes; i++) {
+                    if(!on_boundary[i])
+                        continue;
 
-            a = svd.solve(b);
+                    std::set<index_t> interior;
+                    get_interior_patch(i, on_boundary, 1, interior);
+                    if(interior.empty())
+                        get_interior_patch(i, on_boundary, 2, interior);
+                    if(interior.empty())
+                        continue;
 
-            Hessian[0] = a[4]*2.0; // d2/dx2
-            Hessian[1] = a[5];     // d2/dxdy
-            Hessian[2] = a[6];     // d2/dxdz
-            Hessian[3] = a[7]*2.0; // d2/dy2
-            Hessian[4] = a[8];     // d2/dydz
-            Hessian[5] = a[9]*2.0; // d2/dz2
+                    real_t h[msize];
+                    for(int m=0; m<msize; m++)
+                        h[m] = 0.0;
+
+                    for(typename std::set<index_t>::const_iterator it=interior.begin(); it!=interior.end(); ++it) {
+                        for(int m=0; m<msize; m++)
+                            h[m] += Hessians[((*it)*nfields+f)*msize+m];
+                    }
+
+                    for(int m=0; m<msize; m++)
+                        Hessians[(i*nfields+f)*msize+m] = h[m]/interior.size();
+                }
+            }
         }
     }
 
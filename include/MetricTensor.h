@@ -38,7 +38,10 @@
 #ifndef METRICTENSOR_H
 #define METRICTENSOR_H
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <limits>
 
 #include <Eigen/Core>
 #include <Eigen/Dense>
@@ -67,7 +70,7 @@ template<typename treal_t, int dim> class MetricTensor
 {
 public:
     /// Default constructor.
-    MetricTensor() {};
+    MetricTensor() : _decomposed(false) {};
 
     /// Default destructor.
     ~MetricTensor() {};
@@ -106,6 +109,15 @@ public:
     {
         for(size_t i=0; i<(dim==2?3:6); i++)
             _metric[i] = metric._metric[i];
+
+        _decomposed = metric._decomposed;
+        if(_decomposed) {
+            for(size_t i=0; i<dim; i++)
+                _D[i] = metric._D[i];
+            for(size_t i=0; i<dim*dim; i++)
+                _V[i] = metric._V[i];
+        }
+
         return *this;
     }
 
@@ -143,45 +155,28 @@ public:
         for(size_t i=0; i<(dim==2?3:6); i++)
             _metric[i] = metric[i];
 
-        if (enforce_posDef)
-          positive_definiteness(_metric);
+        _decomposed = false;
+
+        // Enforcing positive definiteness decomposes the metric anyway, so keep the result.
+        if(enforce_posDef && !is_zero(_metric)) {
+            update_decomposition();
+            eigen_compose(_D, _V, _metric);
+        }
     }
 
     // Enforce positive definiteness
     static void positive_definiteness(treal_t* metric)
     {
-        Eigen::Matrix<treal_t, dim, dim> M;
-
-        if(dim==2) {
-            M << metric[0], metric[1],
-                 metric[1], metric[2];
-        } else if(dim==3) {
-            M << metric[0], metric[1], metric[2],
-                 metric[1], metric[3], metric[4],
-                 metric[2], metric[4], metric[5];
-        }
-
-        if(M.isZero())
+        if(is_zero(metric))
             return;
 
-        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver(M);
+        treal_t D[dim], V[dim*dim];
+        eigen_solve(metric, D, V);
 
-        Eigen::Matrix<treal_t, dim, 1> evalues = solver.eigenvalues().real().cwiseAbs();
-        Eigen::Matrix<treal_t, dim, dim> evectors = solver.eigenvectors().real();
-        Eigen::Matrix<treal_t, dim, dim> Mp = evectors*evalues.asDiagonal()*evectors.transpose();
+        for(int i=0; i<dim; i++)
+            D[i] = fabs(D[i]);
 
-        if(dim==2) {
-          metric[0] = Mp(0,0);
-          metric[1] = Mp(0,1);
-          metric[2] = Mp(1,1);
-        } else if(dim==3) {
-          metric[0] = Mp(0,0);
-          metric[1] = Mp(0,1);
-          metric[2] = Mp(0,2);
-          metric[3] = Mp(1,1);
-          metric[4] = Mp(1,2);
-          metric[5] = Mp(2,2);
-        }
+        eigen_compose(D, V, metric);
 
         return;
     }
@@ -202,93 +197,65 @@ public:
         }
 
         MetricTensor<treal_t,dim> metric(M_in);
+        constrain(metric, perserved_small_edges);
+    }
 
+    /*! As constrain(const treal_t*, bool), for a metric that is already
+     * positive definite, which saves decomposing it if its
+     * eigen-decomposition is already known.
+     * @param metric is a reference to a MetricTensor object.
+     * @param perserved_small_edges when true causes small edge lengths to be preserved (default). Otherwise long edge are perserved.
+     */
+    void constrain(const MetricTensor<treal_t,dim> &metric, bool perserved_small_edges=true)
+    {
         // Make the tensor with the smallest aspect ratio the reference space Mr.
-        const treal_t *Mr=_metric, *Mi=metric._metric;
-        Eigen::Matrix<treal_t, dim, dim> M1;
-        if(dim==2)
-            M1 << _metric[0], _metric[1],
-                  _metric[1], _metric[2];
-        else if(dim==3) {
-            M1(0,0) = _metric[0];
-            M1(0,1) = _metric[1];
-            M1(0,2) = _metric[2];
-            M1(1,0) = _metric[1];
-            M1(1,1) = _metric[3];
-            M1(1,2) = _metric[4];
-            M1(2,0) = _metric[2];
-            M1(2,1) = _metric[4];
-            M1(2,2) = _metric[5];
-        }
-
-        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver1(M1);
-        Eigen::Matrix<treal_t, dim, 1> evalues1 = solver1.eigenvalues().real().cwiseAbs();
+        update_decomposition();
+        const treal_t *D1=_D, *V1=_V;
 
         treal_t aspect_r;
         if(dim==2) {
-            aspect_r = std::min(evalues1[0], evalues1[1])/
-                       std::max(evalues1[0], evalues1[1]);
+            aspect_r = std::min(D1[0], D1[1])/
+                       std::max(D1[0], D1[1]);
 
             // Just replace metric if it is foobar
             if(!std::isnormal(aspect_r)) {
-                for(int i=0; i<3; i++)
-                    _metric[i] = M_in[i];
+                *this = metric;
                 return;
             }
         } else if(dim==3)
-            aspect_r = std::min(std::min(evalues1[0], evalues1[1]), evalues1[2])/
-                       std::max(std::max(evalues1[0], evalues1[1]), evalues1[2]);
-
-        Eigen::Matrix<treal_t, dim, dim> M2;
-        if(dim==2)
-            M2 << metric._metric[0], metric._metric[1],
-                  metric._metric[1], metric._metric[2];
-        else if(dim==3) {
-            M2(0,0) = metric._metric[0];
-            M2(0,1) = metric._metric[1];
-            M2(0,2) = metric._metric[2];
-            M2(1,0) = metric._metric[1];
-            M2(1,1) = metric._metric[3];
-            M2(1,2) = metric._metric[4];
-            M2(2,0) = metric._metric[2];
-            M2(2,1) = metric._metric[4];
-            M2(2,2) = metric._metric[5];
-        }
+            aspect_r = std::min(std::min(D1[0], D1[1]), D1[2])/
+                       std::max(std::max(D1[0], D1[1]), D1[2]);
 
         // The input matrix could be zero if there is zero curvature in the local solution.
-        if(M2.isZero())
+        if(is_zero(metric._metric))
             return;
 
-        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver2(M2);
-        Eigen::Matrix<treal_t, dim, 1> evalues2 = solver2.eigenvalues().real().cwiseAbs();
+        metric.update_decomposition();
+        const treal_t *D2=metric._D, *V2=metric._V;
 
         treal_t aspect_i;
         if(dim==2)
-            aspect_i = std::min(evalues2[0], evalues2[1])/
-                       std::max(evalues2[0], evalues2[1]);
+            aspect_i = std::min(D2[0], D2[1])/
+                       std::max(D2[0], D2[1]);
         else if (dim==3)
-            aspect_i = std::min(std::min(evalues2[0], evalues2[1]), evalues2[2])/
-                       std::max(std::max(evalues2[0], evalues2[1]), evalues2[2]);
+            aspect_i = std::min(std::min(D2[0], D2[1]), D2[2])/
+                       std::max(std::max(D2[0], D2[1]), D2[2]);
 
+        const treal_t *Mi=metric._metric, *Dr=D1, *Vr=V1;
         if(aspect_i>aspect_r) {
             Mi=_metric;
-            Mr=metric._metric;
+            Dr=D2;
+            Vr=V2;
         }
 
-        // Map Mi to the reference space where Mr==I
-        if(dim==2)
-            M1 << Mr[0], Mr[1],
-                  Mr[1], Mr[2];
-        else if(dim==3)
-            M1 << Mr[0], Mr[1], Mr[2],
-                  Mr[1], Mr[3], Mr[4],
-                  Mr[2], Mr[4], Mr[5];
-
-        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver(M1);
-        Eigen::Matrix<treal_t, dim, dim> F =
-            solver.eigenvalues().real().cwiseAbs().cwiseSqrt().asDiagonal()*
-            solver.eigenvectors().real();
+        // Map Mi to the reference space where Mr==I, using Mr = F^T F with
+        // F = sqrt(D) V^T (the eigenvectors are the rows of V).
+        Eigen::Matrix<treal_t, dim, dim> F;
+        for(int i=0; i<dim; i++)
+            for(int j=0; j<dim; j++)
+                F(i,j) = sqrt(Dr[i])*Vr[i*dim+j];
 
+        Eigen::Matrix<treal_t, dim, dim> M2;
         if(dim==2)
             M2 << Mi[0], Mi[1],
                   Mi[1], Mi[2];
@@ -297,20 +264,43 @@ public:
                   Mi[1], Mi[3], Mi[4],
                   Mi[2], Mi[4], Mi[5];
 
-        Eigen::Matrix<treal_t, dim, dim> M = F.inverse().transpose()*M2*F.inverse();
+        Eigen::Matrix<treal_t, dim, dim> Finv = F.inverse();
+        Eigen::Matrix<treal_t, dim, dim> M = Finv.transpose()*M2*Finv;
 
-        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver3(M);
-        Eigen::Matrix<treal_t, dim, 1> evalues = solver3.eigenvalues().real().cwiseAbs();
-        Eigen::Matrix<treal_t, dim, dim> evectors = solver3.eigenvectors().real();
+        treal_t m[dim==2?3:6];
+        if(dim==2) {
+            m[0] = M(0,0);
+            m[1] = M(0,1);
+            m[2] = M(1,1);
+        } else if(dim==3) {
+            m[0] = M(0,0);
+            m[1] = M(0,1);
+            m[2] = M(0,2);
+            m[3] = M(1,1);
+            m[4] = M(1,2);
+            m[5] = M(2,2);
+        }
+
+        treal_t D[dim], V[dim*dim];
+        eigen_solve(m, D, V);
 
         if(perserved_small_edges)
             for(size_t i=0; i<dim; i++)
-                evalues[i] = std::max((treal_t) 1.0, evalues[i]);
+                D[i] = std::max((treal_t) 1.0, fabs(D[i]));
         else
             for(size_t i=0; i<dim; i++)
-                evalues[i] = std::min((treal_t) 1.0, evalues[i]);
+                D[i] = std::min((treal_t) 1.0, fabs(D[i]));
+
+        eigen_compose(D, V, m);
+        if(dim==2)
+            M << m[0], m[1],
+                 m[1], m[2];
+        else if(dim==3)
+            M << m[0], m[1], m[2],
+                 m[1], m[3], m[4],
+                 m[2], m[4], m[5];
 
-        Eigen::Matrix<treal_t, dim, dim> Mc = F.transpose()*evectors*evalues.asDiagonal()*evectors.transpose()*F;
+        Eigen::Matrix<treal_t, dim, dim> Mc = F.transpose()*M*F;
 
         if(dim==2) {
             _metric[0] = Mc(0,0);
@@ -324,6 +314,7 @@ public:
             _metric[4] = Mc(1,2);
             _metric[5] = Mc(2,2);
         }
+        _decomposed = false;
 
         return;
     }
@@ -333,26 +324,8 @@ public:
      */
     void limit_aspect_ratio(treal_t max_ratio)
     {
-        Eigen::Matrix<treal_t, dim, dim> M1;
-        if(dim==2)
-            M1 << _metric[0], _metric[1],
-                  _metric[1], _metric[2];
-        else if(dim==3) {
-            M1(0,0) = _metric[0];
-            M1(0,1) = _metric[1];
-            M1(0,2) = _metric[2];
-            M1(1,0) = _metric[1];
-            M1(1,1) = _metric[3];
-            M1(1,2) = _metric[4];
-            M1(2,0) = _metric[2];
-            M1(2,1) = _metric[4];
-            M1(2,2) = _metric[5];
-        }
-
-        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver1(M1);
-
-        Eigen::Matrix<treal_t, dim, 1> evalues = solver1.eigenvalues().real().cwiseAbs();
-        Eigen::Matrix<treal_t, dim, dim> evectors = solver1.eigenvectors().real();
+        update_decomposition();
+        treal_t *evalues=_D, *evectors=_V;
 
         if(dim==2) {
             if(evalues[0]<evalues[1]) {
@@ -368,20 +341,7 @@ public:
                 evalues[i] = std::max(evalues[i], min_eigenvalue);
         }
 
-        Eigen::Matrix<treal_t, dim, dim> Mc = evectors*evalues.asDiagonal()*evectors.transpose();
-
-        if(dim==2) {
-            _metric[0] = Mc(0,0);
-            _metric[1] = Mc(0,1);
-            _metric[2] = Mc(1,1);
-        } else if(dim==3) {
-            _metric[0] = Mc(0,0);
-            _metric[1] = Mc(0,1);
-            _metric[2] = Mc(0,2);
-            _metric[3] = Mc(1,1);
-            _metric[4] = Mc(1,2);
-            _metric[5] = Mc(2,2);
-        }
+        eigen_compose(evalues, evectors, _metric);
 
         return;
     }
@@ -394,6 +354,12 @@ public:
     {
         for(size_t i=0; i<(dim==2?3:6); i++)
             _metric[i] *= scale_factor;
+
+        // Scaling leaves the eigenvectors alone.
+        if(_decomposed) {
+            for(size_t i=0; i<dim; i++)
+                _D[i] *= fabs(scale_factor);
+        }
     }
 
     treal_t average_length() const
@@ -453,72 +419,390 @@ public:
         return sqrt(1.0/max_d); // ie, the min
     }
 
+    /*! Eigen-decomposition of the metric. The eigenvalues are made
+     * positive and the eigenvectors are returned as the rows of
+     * eigenvectors. A zero metric gives zero eigenvalues and eigenvectors.
+     */
     void eigen_decomp(treal_t* eigenvalues, treal_t* eigenvectors) const
     {
-        Eigen::Matrix<treal_t, dim, dim> M;
-        if(dim==2)
-            M << _metric[0], _metric[1],
-                 _metric[1], _metric[2];
-        else if(dim==3)
-            M << _metric[0], _metric[1], _metric[2],
-                 _metric[1], _metric[3], _metric[4],
-                 _metric[2], _metric[4], _metric[5];
-
-        if(M.isZero()) {
+        if(is_zero(_metric)) {
             for(size_t i=0; i<dim; i++)
                 eigenvalues[i] = 0.0;
 
             for(size_t i=0; i<dim*dim; i++)
                 eigenvectors[i] = 0.0;
         } else {
-            Eigen::SelfAdjointEigenSolver< Eigen::Matrix<treal_t, dim, dim> > solver(M);
-
-            Eigen::Matrix<treal_t, dim, 1> evalues = solver.eigenvalues().real().cwiseAbs();
-            Eigen::Matrix<treal_t, dim, dim> evectors = solver.eigenvectors().real();
-
-            for(size_t i=0; i<dim; i++)
-                eigenvalues[i] = evalues[i];
+            update_decomposition();
 
-            Eigen::Matrix<treal_t, dim, dim> Mp = evectors.transpose();
             for(size_t i=0; i<dim; i++)
-              for(size_t j=0; j<dim; j++)
-                eigenvectors[i*dim+j] = Mp(i,j);
+                eigenvalues[i] = _D[i];
+            for(size_t i=0; i<dim*dim; i++)
+                eigenvectors[i] = _V[i];
         }
     }
 
+    /*! Set the metric from its eigen-decomposition, which is kept as
+     * the cached decomposition.
+     */
     void eigen_undecomp(const treal_t* D, const treal_t* V)
     {
         // Insure eigenvalues are positive
-        treal_t eigenvalues[dim];
         for(size_t i=0; i<dim; i++)
-            eigenvalues[i] = fabs(D[i]);
-
-        treal_t M[dim*dim];
-        for(size_t i=0; i<dim; i++) {
-            for(size_t j=0; j<dim; j++) {
-                int ii = (i*dim) + j;
-                M[ii] = 0.0;
-                for(size_t k=0; k<dim; k++)
-                    M[ii]+=eigenvalues[k]*V[k*dim+i]*V[k*dim+j];
-            }
-        }
+            _D[i] = fabs(D[i]);
+        for(size_t i=0; i<dim*dim; i++)
+            _V[i] = V[i];
+        _decomposed = true;
+
+        eigen_compose(_D, _V, _metric);
+    }
+
+    /*! Eigenvalues of the metric, made positive, as eigen_solve followed
+     * by fabs. The eigen-decomposition is cached until the metric
+     * changes, and operations that know the new decomposition update
+     * the cache in place. Bringing the cache up to date writes to the
+     * tensor, so it must not race with other threads reading it.
+     */
+    const treal_t* get_eigenvalues() const
+    {
+        update_decomposition();
+        return _D;
+    }
+
+    /*! Eigenvectors of the metric, as rows, matching get_eigenvalues().
+    */
+    const treal_t* get_eigenvectors() const
+    {
+        update_decomposition();
+        return _V;
+    }
+
+    /*! Closed form eigen-decomposition of a symmetric 2x2 or 3x3 matrix,
+     * which is much cheaper than the iterative Eigen::SelfAdjointEigenSolver.
+     * In 3D the best separated eigenvalue is found with the trigonometric
+     * form of Cardano's formula. Following D. Eberly, "A Robust Eigensolver
+     * for 3x3 Symmetric Matrices", its eigenvector is found from the rows of
+     * A-lambda*I and the other two eigenpairs from the 2x2 problem in its
+     * orthogonal complement, so repeated eigenvalues still give an
+     * orthonormal basis.
+     * @param m is the upper triangle of the matrix, as for set_metric.
+     * @param D receives the eigenvalues in ascending order.
+     * @param V receives the eigenvectors, as rows.
+     */
+    static void eigen_solve(const treal_t *m, treal_t *D, treal_t *V)
+    {
+        if(dim==2)
+            eigen_solve2d(m[0], m[1], m[2], D, V);
+        else if(dim==3)
+            eigen_solve3d(m, D, V);
+    }
 
+    /*! Batched eigen_solve over n matrices in structure of arrays layout,
+     * i.e. component k of matrix i is m[k*n+i]. The eigenvalues and
+     * eigenvectors are returned in the same layout, eigenvalue k in
+     * D[k*n+i] and component j of eigenvector k in V[(k*dim+j)*n+i].
+     */
+    static void eigen_solve_batch(int n, const treal_t *m, treal_t *D, treal_t *V)
+    {
         if(dim==2) {
-            _metric[0] = M[0];
-            _metric[1] = M[1];
-            _metric[2] = M[3];
+            for(int i=0; i<n; i++) {
+                treal_t Di[2], Vi[4];
+                eigen_solve2d(m[i], m[n+i], m[2*n+i], Di, Vi);
+
+                D[i] = Di[0];
+                D[n+i] = Di[1];
+                V[i] = Vi[0];
+                V[n+i] = Vi[1];
+                V[2*n+i] = Vi[2];
+                V[3*n+i] = Vi[3];
+            }
         } else if(dim==3) {
-            _metric[0] = M[0];
-            _metric[1] = M[1];
-            _metric[2] = M[2];
-            _metric[3] = M[4];
-            _metric[4] = M[5];
-            _metric[5] = M[8];
+            for(int i=0; i<n; i++) {
+                treal_t mi[6], Di[3], Vi[9];
+                for(int k=0; k<6; k++)
+                    mi[k] = m[k*n+i];
+
+                eigen_solve3d(mi, Di, Vi);
+
+                for(int k=0; k<3; k++)
+                    D[k*n+i] = Di[k];
+                for(int k=0; k<9; k++)
+                    V[k*n+i] = Vi[k];
+            }
         }
     }
 
+    /*! Inverse of eigen_solve, giving the upper triangle of the matrix
+     * with eigenvalues D and eigenvectors as the rows of V.
+     */
+    static void eigen_compose(const treal_t *D, const treal_t *V, treal_t *m)
+    {
+        for(int i=0, k=0; i<dim; i++) {
+            for(int j=i; j<dim; j++, k++) {
+                m[k] = 0.0;
+                for(int l=0; l<dim; l++)
+                    m[k] += D[l]*V[l*dim+i]*V[l*dim+j];
+            }
+        }
+    }
+
+    /*! Matrix logarithm of a metric, giving the upper triangle. The
+     * eigenvalues are made positive, as positive_definiteness, and are
+     * floored at the smallest normalised number so that a degenerate
+     * metric has a finite logarithm.
+     */
+    static void log_metric(const treal_t *m, treal_t *logm)
+    {
+        treal_t D[dim], V[dim*dim];
+        eigen_solve(m, D, V);
+
+        for(int i=0; i<dim; i++)
+            D[i] = log(std::max(fabs(D[i]), std::numeric_limits<treal_t>::min()));
+
+        eigen_compose(D, V, logm);
+    }
+
+    /*! Matrix exponential of a symmetric matrix given by its upper
+     * triangle. The result is always symmetric positive definite.
+     */
+    static void exp_metric(const treal_t *logm, treal_t *m)
+    {
+        treal_t D[dim], V[dim*dim];
+        eigen_solve(logm, D, V);
+
+        for(int i=0; i<dim; i++)
+            D[i] = exp(D[i]);
+
+        eigen_compose(D, V, m);
+    }
+
+    /*! Log-Euclidean interpolation exp((1-w)*log(M0) + w*log(M1)),
+     * see V. Arsigny et al., "Log-Euclidean metrics for fast and simple
+     * calculus on diffusion tensors", Magn Reson Med 56 (2006) 411-421.
+     * Unlike interpolating the components, the result is positive
+     * definite by construction and the determinant, i.e. the element
+     * density, is interpolated geometrically.
+     * @param logm0 is log(M0), as given by log_metric.
+     * @param logm1 is log(M1), as given by log_metric.
+     * @param w is the interpolation weight of M1.
+     * @param m receives the upper triangle of the interpolated metric.
+     */
+    static void log_interpolate(const treal_t *logm0, const treal_t *logm1, treal_t w, treal_t *m)
+    {
+        treal_t logm[dim==2?3:6];
+        #pragma omp simd
+        for(int i=0; i<(dim==2?3:6); i++)
+            logm[i] = logm0[i] + w*(logm1[i]-logm0[i]);
+
+        exp_metric(logm, m);
+    }
+
 private:
+    /// Decompose the metric unless the cached decomposition is up to date.
+    void update_decomposition() const
+    {
+        if(_decomposed)
+            return;
+
+        eigen_solve(_metric, _D, _V);
+        for(int i=0; i<dim; i++)
+            _D[i] = fabs(_D[i]);
+
+        _decomposed = true;
+    }
+
+    /// Whether all entries are negligible, as Eigen's isZero().
+    static bool is_zero(const treal_t *m)
+    {
+        for(int i=0; i<(dim==2?3:6); i++) {
+            if(fabs(m[i])>Eigen::NumTraits<treal_t>::dummy_precision())
+                return false;
+        }
+        return true;
+    }
+
+    /// Symmetric 2x2 eigen-decomposition of |a b; b c|, see eigen_solve.
+    static void eigen_solve2d(treal_t a, treal_t b, treal_t c, treal_t *D, treal_t *V)
+    {
+        treal_t mean = 0.5*(a+c), d = 0.5*(a-c);
+        treal_t r = sqrt(d*d+b*b);
+
+        D[0] = mean-r;
+        D[1] = mean+r;
+
+        // Eigenvector of the largest eigenvalue, choosing the form that
+        // avoids cancellation. It is zero only for a multiple of I.
+        treal_t x = d>=0.0 ? d+r : b;
+        treal_t y = d>=0.0 ? b : r-d;
+        treal_t l2 = x*x+y*y;
+        if(l2>0.0) {
+            treal_t inv = 1.0/sqrt(l2);
+            x *= inv;
+            y *= inv;
+        } else {
+            x = 1.0;
+            y = 0.0;
+        }
+
+        V[0] = -y;
+        V[1] = x;
+        V[2] = x;
+        V[3] = y;
+    }
+
+    static void cross3d(const treal_t *u, const treal_t *v, treal_t *w)
+    {
+        w[0] = u[1]*v[2]-u[2]*v[1];
+        w[1] = u[2]*v[0]-u[0]*v[2];
+        w[2] = u[0]*v[1]-u[1]*v[0];
+    }
+
+    /// Symmetric 3x3 eigen-decomposition, see eigen_solve.
+    static void eigen_solve3d(const treal_t *m, treal_t *D, treal_t *V)
+    {
+        // Scale to avoid over/underflow.
+        treal_t max_abs = 0.0;
+        for(int i=0; i<6; i++)
+            max_abs = std::max(max_abs, (treal_t)fabs(m[i]));
+
+        if(max_abs==0.0) {
+            for(int i=0; i<3; i++) {
+                D[i] = 0.0;
+                for(int j=0; j<3; j++)
+                    V[i*3+j] = i==j?1.0:0.0;
+            }
+            return;
+        }
+
+        treal_t a[6];
+        for(int i=0; i<6; i++)
+            a[i] = m[i]/max_abs;
+
+        // Shift by the mean eigenvalue and normalise: B = (A-q*I)/p.
+        treal_t q = (a[0]+a[3]+a[5])/3.0;
+        treal_t b00 = a[0]-q, b11 = a[3]-q, b22 = a[5]-q;
+        treal_t p = sqrt((b00*b00+b11*b11+b22*b22+2.0*(a[1]*a[1]+a[2]*a[2]+a[4]*a[4]))/6.0);
+
+        if(p==0.0) {
+            for(int i=0; i<3; i++) {
+                D[i] = q*max_abs;
+                for(int j=0; j<3; j++)
+                    V[i*3+j] = i==j?1.0:0.0;
+            }
+            return;
+        }
+
+        // The eigenvalues of B are 2*cos(phi+2*pi*k/3) with cos(3*phi)=det(B)/2.
+        treal_t c00 = b11*b22-a[4]*a[4];
+        treal_t c01 = a[1]*b22-a[4]*a[2];
+        treal_t c02 = a[1]*a[4]-b11*a[2];
+        treal_t half_det = 0.5*(b00*c00-a[1]*c01+a[2]*c02)/(p*p*p);
+        half_det = std::min(std::max(half_det, (treal_t)-1.0), (treal_t)1.0);
+
+        treal_t phi = acos(half_det)/3.0;
+        const treal_t two_thirds_pi = 2.09439510239319549;
+        treal_t beta2 = 2.0*cos(phi);
+        treal_t beta0 = 2.0*cos(phi+two_thirds_pi);
+
+        // Start from the eigenvalue best separated from the other two.
+        treal_t *w = half_det>=0.0 ? V+6 : V;
+        separated_eigenvector3d(a, half_det>=0.0 ? q+p*beta2 : q+p*beta0, w);
+
+        // The other two eigenpairs follow from the 2x2 problem in the plane
+        // orthogonal to w, which is solved exactly. This, and the Rayleigh
+        // quotient for the separated eigenvalue, avoids the loss of accuracy
+        // of Cardano's formula for nearly repeated eigenvalues.
+        treal_t u[3], t[3];
+        if(fabs(w[0])>fabs(w[1])) {
+            treal_t inv = 1.0/sqrt(w[0]*w[0]+w[2]*w[2]);
+            u[0] = -w[2]*inv;
+            u[1] = 0.0;
+            u[2] = w[0]*inv;
+        } else {
+            treal_t inv = 1.0/sqrt(w[1]*w[1]+w[2]*w[2]);
+            u[0] = 0.0;
+            u[1] = w[2]*inv;
+            u[2] = -w[1]*inv;
+        }
+        cross3d(w, u, t);
+
+        treal_t Dp[2], Vp[4];
+        eigen_solve2d(quadratic_form3d(a, u, u), quadratic_form3d(a, u, t), quadratic_form3d(a, t, t), Dp, Vp);
+
+        treal_t *v0 = half_det>=0.0 ? V : V+3;
+        treal_t *v1 = half_det>=0.0 ? V+3 : V+6;
+        for(int j=0; j<3; j++) {
+            v0[j] = Vp[0]*u[j]+Vp[1]*t[j];
+            v1[j] = Vp[2]*u[j]+Vp[3]*t[j];
+        }
+
+        treal_t lambda = quadratic_form3d(a, w, w);
+        if(half_det>=0.0) {
+            D[0] = Dp[0];
+            D[1] = Dp[1];
+            D[2] = lambda;
+        } else {
+            D[0] = lambda;
+            D[1] = Dp[0];
+            D[2] = Dp[1];
+        }
+
+        // Keep the eigenvalues ascending should rounding reorder them.
+        for(int i=0; i<2; i++) {
+            for(int k=0; k<2-i; k++) {
+                if(D[k]>D[k+1]) {
+                    std::swap(D[k], D[k+1]);
+                    for(int j=0; j<3; j++)
+                        std::swap(V[k*3+j], V[(k+1)*3+j]);
+                }
+            }
+        }
+
+        for(int i=0; i<3; i++)
+            D[i] *= max_abs;
+    }
+
+    /// u^T a v for the packed symmetric matrix a.
+    static treal_t quadratic_form3d(const treal_t *a, const treal_t *u, const treal_t *v)
+    {
+        return u[0]*(a[0]*v[0]+a[1]*v[1]+a[2]*v[2])+
+               u[1]*(a[1]*v[0]+a[3]*v[1]+a[4]*v[2])+
+               u[2]*(a[2]*v[0]+a[4]*v[1]+a[5]*v[2]);
+    }
+
+    /*! Eigenvector of a simple eigenvalue lambda of the packed symmetric
+     * matrix a, as the largest cross product of two rows of a-lambda*I.
+     */
+    static void separated_eigenvector3d(const treal_t *a, treal_t lambda, treal_t *v)
+    {
+        treal_t r0[] = {a[0]-lambda, a[1], a[2]};
+        treal_t r1[] = {a[1], a[3]-lambda, a[4]};
+        treal_t r2[] = {a[2], a[4], a[5]-lambda};
+
+        treal_t c[3][3];
+        cross3d(r0, r1, c[0]);
+        cross3d(r0, r2, c[1]);
+        cross3d(r1, r2, c[2]);
+
+        int imax=0;
+        treal_t dmax=-1.0;
+        for(int i=0; i<3; i++) {
+            treal_t d = c[i][0]*c[i][0]+c[i][1]*c[i][1]+c[i][2]*c[i][2];
+            if(d>dmax) {
+                dmax = d;
+                imax = i;
+            }
+        }
+
+        treal_t inv = 1.0/sqrt(dmax);
+        for(int j=0; j<3; j++)
+            v[j] = c[imax][j]*inv;
+    }
+
     treal_t _metric[dim==2?3:(dim==3?6:-1)];
+
+    // Cached eigen-decomposition of _metric; see get_eigenvalues().
+    mutable treal_t _D[dim], _V[dim*dim];
+    mutable bool _decomposed;
 };
 
 template<typename treal_t, int dim>
@@ -98,9 +98,10 @@ public:
         newQualities.resize(nthreads);
         newCoords.resize(nthreads);
         newMetric.resize(nthreads);
+        newWeights.resize(nthreads);
+        newFields.resize(nthreads);
 
-        // Pre-allocate the maximum size that might be required
-        allNewVertices.resize(_mesh->_ENList.size());
+        lastEdgeSplitCnt = 0;
 
         threadIdx.resize(nthreads);
         splitCnt.resize(nthreads);
@@ -144,6 +145,11 @@ public:
         size_t origNNodes = _mesh->get_number_nodes();
         size_t edgeSplitCnt = 0;
 
+        _mesh->topology_version++;
+
+        logMetricNeeded.assign(origNNodes, 0);
+        logMetric.resize(msize*origNNodes);
+
         #pragma omp parallel
         {
             #pragma omp single nowait
@@ -158,15 +164,21 @@ public:
             /*
              * Average vertex degree in 2D is ~6, so there
              * are approx. (6/2)*NNodes edges in the mesh.
-             * In 3D, average vertex degree is ~12.
+             * In 3D, average vertex degree is ~12. Successive
+             * refinement passes split fewer and fewer edges, so
+             * after the first pass the previous split count is a
+             * far tighter estimate.
              */
-            size_t reserve_size = nedge*origNNodes/nthreads;
+            size_t reserve_size = (lastEdgeSplitCnt>0?lastEdgeSplitCnt:nedge*origNNodes)/nthreads;
             newVertices[tid].clear();
             newVertices[tid].reserve(reserve_size);
             newCoords[tid].clear();
             newCoords[tid].reserve(dim*reserve_size);
             newMetric[tid].clear();
-            newMetric[tid].reserve(msize*reserve_size);
+            newWeights[tid].clear();
+            newWeights[tid].reserve(reserve_size);
+            newFields[tid].clear();
+            newFields[tid].reserve(_mesh->nfields*reserve_size);
 
             /* Loop through all edges and select them for refinement if
                its length is greater than L_max in transformed space. */
@@ -190,6 +202,33 @@ public:
                 }
             }
 
+            /* The metric of the new vertices is interpolated in log-Euclidean
+               space, so the logarithm of the metric is computed once for each
+               vertex on a split edge however many of its edges are split. */
+            #pragma omp barrier
+            #pragma omp for schedule(guided)
+            for(size_t i=0; i<origNNodes; ++i) {
+                if(logMetricNeeded[i])
+                    MetricTensor<double,dim>::log_metric(_mesh->get_metric(i), &logMetric[msize*i]);
+            }
+
+            newMetric[tid].resize(msize*splitCnt[tid]);
+            for(size_t i=0; i<splitCnt[tid]; ++i) {
+                index_t n0 = newVertices[tid][i].edge.first;
+                index_t n1 = newVertices[tid][i].edge.second;
+                double *m = &newMetric[tid][msize*i];
+
+                MetricTensor<double,dim>::log_interpolate(&logMetric[msize*n0], &logMetric[msize*n1], newWeights[tid][i], m);
+
+                for(size_t j=0; j<msize; j++) {
+                    if(pragmatic_isnan(m[j]))
+                        std::cerr<<"ERROR: metric health is bad in "<<__FILE__<<std::endl
+                                 <<"m0[j] = "<<_mesh->get_metric(n0)[j]<<std::endl
+                                 <<"m1[j] = "<<_mesh->get_metric(n1)[j]<<std::endl
+                                 <<"weight = "<<newWeights[tid][i]<<std::endl;
+                }
+            }
+
             threadIdx[tid] = pragmatic_omp_atomic_capture(&_mesh->NNodes, splitCnt[tid]);
             assert(newVertices[tid].size()==splitCnt[tid]);
 
@@ -199,19 +238,27 @@ public:
             {
                 size_t reserve = 1.1*_mesh->NNodes; // extra space is required for centroidals
                 if(_mesh->_coords.size()<reserve*dim) {
+                    // Grow geometrically so that consecutive passes do not all reallocate.
+                    reserve = std::max(reserve, 3*_mesh->_coords.size()/(2*dim));
                     _mesh->_coords.resize(reserve*dim);
                     _mesh->metric.resize(reserve*msize);
+                    _mesh->fields.resize(reserve*_mesh->nfields);
                     _mesh->NNList.resize(reserve);
                     _mesh->NEList.resize(reserve);
                     _mesh->node_owner.resize(reserve);
                     _mesh->lnn2gnn.resize(reserve);
                 }
                 edgeSplitCnt = _mesh->NNodes - origNNodes;
+                lastEdgeSplitCnt = edgeSplitCnt;
+                if(allNewVertices.size()<edgeSplitCnt)
+                    allNewVertices.resize(edgeSplitCnt);
             }
 
             // Append new coords and metric to the mesh.
             memcpy(&_mesh->_coords[dim*threadIdx[tid]], &newCoords[tid][0], dim*splitCnt[tid]*sizeof(real_t));
             memcpy(&_mesh->metric[msize*threadIdx[tid]], &newMetric[tid][0], msize*splitCnt[tid]*sizeof(double));
+            if(_mesh->nfields>0)
+                memcpy(&_mesh->fields[_mesh->nfields*threadIdx[tid]], &newFields[tid][0], _mesh->nfields*splitCnt[tid]*sizeof(real_t));
 
             // Fix IDs of new vertices
             assert(newVertices[tid].size()==splitCnt[tid]);
@@ -332,9 +379,11 @@ public:
             newElements[tid].clear();
             newBoundaries[tid].clear();
             newQualities[tid].clear();
-            newElements[tid].reserve(dim*dim*origNElements/nthreads);
-            newBoundaries[tid].reserve(dim*dim*origNElements/nthreads);
-            newQualities[tid].reserve(origNElements/nthreads);
+            // Each split edge creates ~2 elements in 2D and ~5 in 3D.
+            size_t reserve_elements = (dim==2?2:6)*edgeSplitCnt/nthreads;
+            newElements[tid].reserve(nloc*reserve_elements);
+            newBoundaries[tid].reserve(nloc*reserve_elements);
+            newQualities[tid].reserve(reserve_elements);
 
             #pragma omp for schedule(guided) nowait
             for(size_t eid=0; eid<origNElements; ++eid) {
@@ -356,9 +405,10 @@ public:
             #pragma omp single
             {
                 if(_mesh->_ENList.size()<_mesh->NElements*nloc) {
-                    _mesh->_ENList.resize(_mesh->NElements*nloc);
-                    _mesh->boundary.resize(_mesh->NElements*nloc);
-                    _mesh->quality.resize(_mesh->NElements);
+                    size_t reserve = std::max(_mesh->NElements, 3*_mesh->_ENList.size()/(2*nloc));
+                    _mesh->_ENList.resize(reserve*nloc);
+                    _mesh->boundary.resize(reserve*nloc);
+                    _mesh->quality.resize(reserve);
                 }
             }
 
@@ -536,7 +586,7 @@ private:
 
         // Calculate the position of the new point. From equation 16 in
         // Li et al, Comp Methods Appl Mech Engrg 194 (2005) 4915-4950.
-        real_t x, m;
+        real_t x;
         const real_t *x0 = _mesh->get_coords(n0);
         const double *m0 = _mesh->get_metric(n0);
 
@@ -552,18 +602,57 @@ private:
             newCoords[tid].push_back(x);
         }
 
-        // Interpolate new metric and append it to OMP thread's temp storage
-        for(size_t i=0; i<msize; i++) {
-            m = m0[i]+weight*(m1[i] - m0[i]);
-            newMetric[tid].push_back(m);
-            if(pragmatic_isnan(m))
-                std::cerr<<"ERROR: metric health is bad in "<<__FILE__<<std::endl
-                         <<"m0[i] = "<<m0[i]<<std::endl
-                         <<"m1[i] = "<<m1[i]<<std::endl
-                         <<"property->length(x0, x1, m0) = "<<property->template length<dim>(x0, x1, m0)<<std::endl
-                             <<"property->length(x0, x1, m1) = "<<property->template length<dim>(x0, x1, m1)<<std::endl
-                                     <<"weight = "<<weight<<std::endl;
+        // The metric is interpolated once the logarithms of the end point metrics are known.
+        newWeights[tid].push_back(weight);
+
+        // Attached fields are interpolated linearly along the edge.
+        size_t nfields = _mesh->nfields;
+        for(size_t k=0; k<nfields; k++) {
+            real_t f0 = _mesh->fields[n0*nfields+k];
+            real_t f1 = _mesh->fields[n1*nfields+k];
+            newFields[tid].push_back(f0+weight*(f1-f0));
+        }
+
+        #pragma omp atomic write
+        logMetricNeeded[n0] = 1;
+        #pragma omp atomic write
+        logMetricNeeded[n1] = 1;
+    }
+
+    /* Interpolate the attached fields at vertex nid, positioned at x,
+     * using the basis functions of the parent tetrahedron n. Vertices
+     * are sorted by their coordinates for consistency across MPI processes.
+     */
+    inline void interpolate_fields(index_t nid, const real_t *x, const index_t *n)
+    {
+        std::map<Coords_t, index_t> parent_coords;
+        for(int j=0; j<nloc; ++j) {
+            Coords_t cn(_mesh->get_coords(n[j]));
+            parent_coords[cn] = n[j];
         }
+
+        const real_t *xp[4];
+        index_t sorted_n[4];
+        int j=0;
+        for(typename std::map<Coords_t, index_t>::const_iterator it=parent_coords.begin(); it!=parent_coords.end(); ++it, ++j) {
+            xp[j] = _mesh->get_coords(it->second);
+            sorted_n[j] = it->second;
+        }
+
+        real_t L = fabs(property->volume(xp[0], xp[1], xp[2], xp[3]));
+
+        real_t l[4];
+        l[0] = fabs(property->volume(x    , xp[1], xp[2], xp[3])/L);
+        l[1] = fabs(property->volume(xp[0], x    , xp[2], xp[3])/L);
+        l[2] = fabs(property->volume(xp[0], xp[1], x    , xp[3])/L);
+        l[3] = fabs(property->volume(xp[0], xp[1], xp[2], x    )/L);
+
+        size_t nfields = _mesh->nfields;
+        for(size_t k=0; k<nfields; k++)
+            _mesh->fields[nid*nfields+k] = l[0]*_mesh->fields[sorted_n[0]*nfields+k]+
+                                           l[1]*_mesh->fields[sorted_n[1]*nfields+k]+
+                                           l[2]*_mesh->fields[sorted_n[2]*nfields+k]+
+                                           l[3]*_mesh->fields[sorted_n[3]*nfields+k];
     }
 
     inline void refine_facet(index_t eid, const index_t *facet, int tid)
@@ -2733,6 +2822,9 @@ private:
                                              l[2]*_mesh->metric[sorted_best_e[2]*msize+i]+
                                              l[3]*_mesh->metric[sorted_best_e[3]*msize+i];
 
+            if(_mesh->nfields>0)
+                interpolate_fields(cid, nc, n);
+
             append_element(ele1, ele1_boundary, tid);
             append_element(ele2, ele2_boundary, tid);
             append_element(ele3, ele3_boundary, tid);
@@ -2952,6 +3044,10 @@ private:
     std::vector< std::vector< DirectedEdge<index_t> > > newVertices;
     std::vector< std::vector<real_t> > newCoords;
     std::vector< std::vector<double> > newMetric;
+    std::vector< std::vector<real_t> > newWeights;
+    std::vector< std::vector<real_t> > newFields;
+    std::vector<double> logMetric;
+    std::vector<char> logMetricNeeded;
     std::vector< std::vector<index_t> > newElements;
     std::vector< std::vector<int> > newBoundaries;
     std::vector< std::vector<double> > newQualities;
@@ -2959,6 +3055,7 @@ private:
 
     std::vector<size_t> threadIdx, splitCnt;
     std::vector< DirectedEdge<index_t> > allNewVertices;
+    size_t lastEdgeSplitCnt;
     std::vector< std::set<Wedge> > cidRecv_additional, cidSend_additional;
 
     DeferredOperations<real_t>* def_ops;
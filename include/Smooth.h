@@ -54,6 +54,7 @@
 #include <omp.h>
 #endif
 
+#include "Colour.h"
 #include "ElementProperty.h"
 #include "Lock.h"
 #include "Mesh.h"
@@ -66,10 +67,19 @@ template<typename real_t, int dim>
 class Smooth
 {
 public:
+    /// How vertices are scheduled for concurrent smoothing.
+    enum Schedule {
+        LOCKING,  ///< Lock each vertex patch, retrying vertices whose neighbours are busy.
+        COLOURING, ///< Sweep the colour classes of a vertex colouring; lock-free and deterministic.
+        WORKLIST  ///< Visit only vertices whose patch is worse than the quality tolerance, and only again once their patch changed. See smart_laplacian.
+    };
+
     /// Default constructor.
     Smooth(Mesh<real_t> &mesh):nloc(dim+1), msize(dim==2?3:6)
     {
         _mesh = &mesh;
+        colouring_version = 0;
+        colouring_valid = false;
 
         mpi_nparts = 1;
         rank=0;
@@ -79,6 +89,8 @@ public:
 #endif
 
         epsilon_q = DBL_EPSILON;
+        newton_p = 4.0;
+        newton_tol = 1.0e-3;
 
         // Set the orientation of elements.
         property = NULL;
@@ -109,8 +121,69 @@ public:
         delete property;
     }
 
-    // Smart laplacian mesh smoothing.
-    void smart_laplacian(int max_iterations=10, double quality_tol=-1.0)
+    /*! Smart laplacian mesh smoothing. The kernel itself does not use
+     * quality_tol, and moving vertices of good patches next to bad ones
+     * improves the worst elements. So with WORKLIST the default
+     * quality_tol is 1: every vertex is queued and the final qmin is that
+     * of LOCKING, for about the same number of kernel calls. An explicit
+     * quality_tol restricts the worklist and trades qmin for work: with
+     * the mean quality, on the graded 20^3 box, the kernel calls drop
+     * from 68k to 36k but qmin from 0.0761 to 0.0667.
+     */
+    void smart_laplacian(int max_iterations=10, double quality_tol=-1.0, Schedule schedule=LOCKING)
+    {
+        if(schedule==COLOURING)
+            coloured_sweeps(&Smooth::smart_laplacian_kernel, max_iterations, quality_tol);
+        else if(schedule==WORKLIST)
+            worklist_sweeps(&Smooth::smart_laplacian_kernel, max_iterations, quality_tol<0?1.0:quality_tol);
+        else
+            locked_sweeps(&Smooth::smart_laplacian_kernel, max_iterations, quality_tol);
+    }
+
+    // Linf optimisation based smoothing..
+    void optimisation_linf(int max_iterations=10, double quality_tol=-1.0, Schedule schedule=LOCKING)
+    {
+        if(schedule==COLOURING)
+            coloured_sweeps(&Smooth::optimisation_linf_kernel, max_iterations, quality_tol);
+        else if(schedule==WORKLIST)
+            worklist_sweeps(&Smooth::optimisation_linf_kernel, max_iterations, quality_tol);
+        else
+            locked_sweeps(&Smooth::optimisation_linf_kernel, max_iterations, quality_tol);
+    }
+
+    /*! Newton based smoothing. Each vertex is moved to minimise the
+     * p-mean of the inverse element quality over its patch, using
+     * analytic gradients and Hessians of the Lipnikov functional. Steps
+     * are safeguarded so the worst element of a patch never gets worse.
+     */
+    void optimisation_newton(int max_iterations=10, double quality_tol=-1.0, Schedule schedule=LOCKING)
+    {
+        if(schedule==COLOURING)
+            coloured_sweeps(&Smooth::optimisation_newton_kernel, max_iterations, quality_tol);
+        else if(schedule==WORKLIST)
+            worklist_sweeps(&Smooth::optimisation_newton_kernel, max_iterations, quality_tol);
+        else
+            locked_sweeps(&Smooth::optimisation_newton_kernel, max_iterations, quality_tol);
+    }
+
+    // Laplacian smoothing
+    void laplacian(int max_iterations=10, Schedule schedule=LOCKING)
+    {
+        if(schedule==COLOURING)
+            coloured_sweeps(&Smooth::laplacian_kernel, max_iterations, -1.0);
+        else if(schedule==WORKLIST)
+            worklist_sweeps(&Smooth::laplacian_kernel, max_iterations, -1.0);
+        else
+            locked_sweeps(&Smooth::laplacian_kernel, max_iterations, -1.0);
+    }
+
+private:
+
+    /*! Apply a smoothing kernel to all active interior vertices. Each
+     * vertex is locked together with its neighbours; vertices whose
+     * neighbourhood is busy are retried.
+     */
+    void locked_sweeps(bool (Smooth::*kernel)(index_t), int max_iterations, double quality_tol)
     {
         int NNodes = _mesh->get_number_nodes();
         int NElements = _mesh->get_number_elements();
@@ -165,7 +238,7 @@ public:
                     assert(std::isfinite(_mesh->quality[i]));
                     qsum+=_mesh->quality[i];
                 }
-#pragma single
+                #pragma omp single
                 {
                     good_q = qsum/NElements;
                     assert(std::isnormal(good_q));
@@ -197,7 +270,7 @@ public:
                     }
 
                     if(!abort) {
-                        if(smart_laplacian_kernel(node)) {
+                        if((this->*kernel)(node)) {
                             for(auto& it : _mesh->NNList[node]) {
                                 assert(!_mesh->NNList[node].empty());
                                 assert(!_mesh->NEList[node].empty());
@@ -231,7 +304,7 @@ public:
                         }
 
                         if(!abort) {
-                            if(smart_laplacian_kernel(node)) {
+                            if((this->*kernel)(node)) {
                                 for(auto& it : _mesh->NNList[node]) {
                                     assert(!_mesh->NNList[node].empty());
                                     assert(!_mesh->NEList[node].empty());
@@ -256,8 +329,12 @@ public:
         return;
     }
 
-    // Linf optimisation based smoothing..
-    void optimisation_linf(int max_iterations=10, double quality_tol=-1.0)
+    /*! Apply a smoothing kernel colour class by colour class. Vertices of
+     * one colour are not adjacent, and hence share no element, so each
+     * class is smoothed fully in parallel without locks. The outcome does
+     * not depend on the number of threads.
+     */
+    void coloured_sweeps(bool (Smooth::*kernel)(index_t), int max_iterations, double quality_tol)
     {
         int NNodes = _mesh->get_number_nodes();
         int NElements = _mesh->get_number_elements();
@@ -265,73 +342,149 @@ public:
         if(NElements==0)
             return;
 
-        std::vector< std::atomic<bool> > is_boundary(NNodes);
-        std::vector< std::atomic<bool> > active_vertices(NNodes);
-        if(vLocks.size() < NNodes)
-            vLocks.resize(NNodes);
+        update_colouring();
 
-        double qsum=0;
         good_q = quality_tol;
+        if(good_q<0) {
+            double qsum=0;
+            #pragma omp parallel for schedule(static) reduction(+:qsum)
+            for(int i=0; i<NElements; i++) {
+                const int *n=_mesh->get_element(i);
+                if(n[0]<0)
+                    continue;
+
+                assert(std::isfinite(_mesh->quality[i]));
+                qsum+=_mesh->quality[i];
+            }
+            good_q = qsum/NElements;
+            assert(std::isnormal(good_q));
+        }
+
+        std::vector< std::atomic<bool> > active_vertices(NNodes);
+        int ncolours = colour_ptr.size()-1;
 
         #pragma omp parallel
         {
             #pragma omp for schedule(static)
             for(int n=0; n<NNodes; ++n) {
-                is_boundary[n].store(false, std::memory_order_relaxed);
-                if(_mesh->NNList[n].empty()) {
-                    assert(_mesh->NEList[n].empty());
-                    active_vertices[n].store(false, std::memory_order_relaxed);
-                } else {
-                    active_vertices[n].store(true, std::memory_order_relaxed);
+                active_vertices[n].store(!_mesh->NNList[n].empty(), std::memory_order_relaxed);
+            }
+
+            for(int iter=0; iter<max_iterations; iter++) {
+                for(int c=0; c<ncolours; c++) {
+                    #pragma omp for schedule(guided)
+                    for(index_t i=colour_ptr[c]; i<colour_ptr[c+1]; i++) {
+                        index_t node = colour_vertices[i];
+                        if(!active_vertices[node].load(std::memory_order_relaxed))
+                            continue;
+
+                        if((this->*kernel)(node)) {
+                            for(auto& it : _mesh->NNList[node])
+                                active_vertices[it].store(true, std::memory_order_relaxed);
+                        } else {
+                            active_vertices[node].store(false, std::memory_order_relaxed);
+                        }
+                    }
                 }
-                vLocks[n].unlock();
             }
+        }
+    }
 
-            #pragma omp for schedule(guided)
+    /*! Apply a smoothing kernel to a worklist of vertices whose patch is
+     * worse than good_q. The worklist is processed in passes, in vertex
+     * order, with the same patch locking as locked_sweeps. When a vertex
+     * moves, it and its neighbours are queued again: for the current pass
+     * if they have not been visited in it yet, otherwise for the next one.
+     * Vertices with good patches, or whose patch did not change since they
+     * were last visited, are not visited. At most max_iterations passes
+     * are made.
+     */
+    void worklist_sweeps(bool (Smooth::*kernel)(index_t), int max_iterations, double quality_tol)
+    {
+        int NNodes = _mesh->get_number_nodes();
+        int NElements = _mesh->get_number_elements();
+
+        if(NElements==0 || max_iterations<1)
+            return;
+
+        good_q = quality_tol;
+        if(good_q<0) {
+            double qsum=0;
+            #pragma omp parallel for schedule(static) reduction(+:qsum)
             for(int i=0; i<NElements; i++) {
                 const int *n=_mesh->get_element(i);
                 if(n[0]<0)
                     continue;
 
-                for(size_t j=0; j<nloc; j++) {
-                    if(_mesh->boundary[i*nloc+j]>0) {
-                        for(size_t k=1; k<nloc; k++) {
-                            is_boundary[n[(j+k)%nloc]].store(true, std::memory_order_relaxed);
-                        }
-                    }
-                }
+                assert(std::isfinite(_mesh->quality[i]));
+                qsum+=_mesh->quality[i];
             }
+            good_q = qsum/NElements;
+            assert(std::isnormal(good_q));
+        }
 
-            if(good_q<0) {
-                #pragma omp for schedule(static) reduction(+:qsum)
-                for(int i=0; i<NElements; i++) {
-                    const int *n=_mesh->get_element(i);
-                    if(n[0]<0)
-                        continue;
+        std::vector<char> smoothable;
+        find_smoothable(smoothable);
 
-                    assert(std::isfinite(_mesh->quality[i]));
-                    qsum+=_mesh->quality[i];
+        // The pass a vertex is queued for (-1 if none), and the last pass
+        // in which it was visited.
+        std::vector< std::atomic<int> > queued(NNodes);
+        std::vector<int> visited(NNodes);
+        if(vLocks.size() < NNodes)
+            vLocks.resize(NNodes);
+
+        std::vector<index_t> current, pending, next, deferred;
+        int pass=0;
+
+        #pragma omp parallel
+        {
+            // Thread local worklists for the current and the next pass.
+            std::vector<index_t> local_worklist[2], local_deferred;
+
+            #pragma omp for schedule(static)
+            for(int n=0; n<NNodes; ++n) {
+                queued[n].store(-1, std::memory_order_relaxed);
+                visited[n] = -1;
+                vLocks[n].unlock();
+            }
+
+            #pragma omp for schedule(guided)
+            for(index_t n=0; n<NNodes; ++n) {
+                if(smoothable[n])
+                    worklist_push(n, 0, queued, visited, local_worklist);
+            }
+
+            for(;;) {
+                #pragma omp critical
+                {
+                    pending.insert(pending.end(), local_worklist[0].begin(), local_worklist[0].end());
+                    next.insert(next.end(), local_worklist[1].begin(), local_worklist[1].end());
                 }
-#pragma single
+                local_worklist[0].clear();
+                local_worklist[1].clear();
+                #pragma omp barrier
+
+                #pragma omp single
                 {
-                    good_q = qsum/NElements;
-                    assert(std::isnormal(good_q));
+                    current.clear();
+                    if(pending.empty()) {
+                        pass++;
+                        if(pass<max_iterations)
+                            pending.swap(next);
+                    }
+                    current.swap(pending);
+                    std::sort(current.begin(), current.end());
                 }
-            }
 
-            // First sweep through all vertices. Add vertices adjacent to any
-            // vertex moved into the active_vertex list.
-            std::vector<index_t> retry, next_retry;
+                if(current.empty())
+                    break;
 
-            int iter=0;
-            while((iter++) < max_iterations) {
-                #pragma omp for schedule(guided) nowait
-                for(index_t node=0; node<NNodes; ++node) {
-                    if(_mesh->is_halo_node(node) || is_boundary[node].load(std::memory_order_relaxed) || !active_vertices[node].load(std::memory_order_relaxed))
-                        continue;
+                #pragma omp for schedule(guided)
+                for(size_t i=0; i<current.size(); i++) {
+                    index_t node = current[i];
 
                     if(!vLocks[node].try_lock()) {
-                        retry.push_back(node);
+                        local_deferred.push_back(node);
                         continue;
                     }
 
@@ -343,96 +496,134 @@ public:
                         }
                     }
 
-                    if(!abort) {
-                        if(optimisation_linf_kernel(node)) {
-                            for(auto& it : _mesh->NNList[node]) {
-                                assert(!_mesh->NNList[node].empty());
-                                assert(!_mesh->NEList[node].empty());
-                                active_vertices[it].store(true, std::memory_order_relaxed);
-                            }
-                        } else {
-                            active_vertices[node].store(false, std::memory_order_relaxed);
-                        }
-                    } else {
-                        retry.push_back(node);
-                    }
+                    if(abort)
+                        local_deferred.push_back(node);
+                    else
+                        worklist_visit(kernel, node, pass, queued, visited, local_worklist, smoothable);
+
                     vLocks[node].unlock();
                 }
 
-                for(int iretry=0; iretry<100; iretry++) { // Put a hard limit on the number of times we try to get a lock.
-                    next_retry.clear();
-
-                    for(const auto& node : retry) {
-                        bool abort = false;
+                // Vertices whose patch was busy are smoothed by a single
+                // thread, so every round makes progress.
+                #pragma omp critical
+                {
+                    deferred.insert(deferred.end(), local_deferred.begin(), local_deferred.end());
+                }
+                local_deferred.clear();
+                #pragma omp barrier
 
-                        if(!vLocks[node].try_lock()) {
-                            next_retry.push_back(node);
-                            continue;
-                        }
+                #pragma omp single
+                {
+                    for(const auto& node : deferred)
+                        worklist_visit(kernel, node, pass, queued, visited, local_worklist, smoothable);
+                    deferred.clear();
+                }
+            }
+        }
+    }
 
-                        for(const auto& it : _mesh->NNList[node]) {
-                            if(vLocks[it].is_locked()) {
-                                abort = true;
-                                break;
-                            }
-                        }
+    /// Run the kernel on a queued vertex; if the vertex moved, queue it
+    /// and its neighbours again. The caller owns the patch of node.
+    inline void worklist_visit(bool (Smooth::*kernel)(index_t), index_t node, int pass,
+                               std::vector< std::atomic<int> > &queued, std::vector<int> &visited,
+                               std::vector<index_t> *local_worklist, const std::vector<char> &smoothable)
+    {
+        queued[node].store(-1, std::memory_order_relaxed);
+        visited[node] = pass;
 
-                        if(!abort) {
-                            if(optimisation_linf_kernel(node)) {
-                                for(auto& it : _mesh->NNList[node]) {
-                                    assert(!_mesh->NNList[node].empty());
-                                    assert(!_mesh->NEList[node].empty());
-                                    active_vertices[it].store(true, std::memory_order_relaxed);
-                                }
-                            } else {
-                                active_vertices[node].store(false, std::memory_order_relaxed);
-                            }
-                        } else {
-                            next_retry.push_back(node);
-                        }
-                        vLocks[node].unlock();
-                    }
+        if(!(this->*kernel)(node))
+            return;
 
-                    retry.swap(next_retry);
-                    if(retry.empty())
-                        break;
-                }
-            }
+        worklist_push(node, pass, queued, visited, local_worklist);
+        for(const auto& it : _mesh->NNList[node]) {
+            if(smoothable[it])
+                worklist_push(it, pass, queued, visited, local_worklist);
         }
+    }
 
-        return;
+    /// Queue a vertex whose worst element is below good_q, unless it is
+    /// queued already. It joins the current pass if it has not been
+    /// visited in it yet, otherwise the next pass.
+    inline void worklist_push(index_t node, int pass, std::vector< std::atomic<int> > &queued,
+                              const std::vector<int> &visited, std::vector<index_t> *local_worklist) const
+    {
+        int queued_for = queued[node].load(std::memory_order_relaxed);
+        if(queued_for>=pass)
+            return;
+
+        // Some elements of node lie outside the patch owned by the
+        // caller, so their quality may be updated concurrently. This race
+        // is benign: a thread that changes the quality of an element
+        // pushes all the vertices of that element once it has written the
+        // new quality, so a stale value here is at worst corrected by
+        // that later push.
+        double qmin = std::numeric_limits<double>::max();
+        for(const auto& ie : _mesh->NEList[node])
+            qmin = std::min(qmin, _mesh->quality[ie]);
+
+        if(!(qmin<good_q))
+            return;
+
+        int target = (visited[node]<pass)?pass:pass+1;
+        if(!queued[node].compare_exchange_strong(queued_for, target, std::memory_order_relaxed))
+            return;
+
+        local_worklist[target-pass].push_back(node);
     }
 
-    // Laplacian smoothing
-    void laplacian(int max_iterations=10)
+    /// Colour the smoothable (owned, non-boundary) vertices, unless the
+    /// mesh topology is unchanged since the last colouring.
+    void update_colouring()
     {
+        if(colouring_valid && colouring_version==_mesh->get_topology_version())
+            return;
+
         int NNodes = _mesh->get_number_nodes();
-        int NElements = _mesh->get_number_elements();
 
-        std::vector< std::atomic<bool> > is_boundary(NNodes);
-        std::vector< std::atomic<bool> > active_vertices(NNodes);
-        if(vLocks.size() < NNodes)
-            vLocks.resize(NNodes);
+        std::vector<char> smoothable;
+        find_smoothable(smoothable);
 
-        #pragma omp parallel for
+        std::vector<int> colour;
+        int ncolours = Colour<index_t>::jones_plassmann(NNodes, _mesh->NNList, smoothable, colour);
+
+        // Store the colour classes in CSR format, vertices in ascending order.
+        colour_ptr.assign(ncolours+1, 0);
+        for(int n=0; n<NNodes; ++n) {
+            if(colour[n]>=0)
+                colour_ptr[colour[n]+1]++;
+        }
+        for(int c=0; c<ncolours; c++)
+            colour_ptr[c+1] += colour_ptr[c];
+
+        colour_vertices.resize(colour_ptr[ncolours]);
+        std::vector<index_t> offset(colour_ptr.begin(), colour_ptr.end()-1);
         for(int n=0; n<NNodes; ++n) {
-            is_boundary[n].store(false, std::memory_order_relaxed);
+            if(colour[n]>=0)
+                colour_vertices[offset[colour[n]]++] = n;
         }
 
+        colouring_version = _mesh->get_topology_version();
+        colouring_valid = true;
+    }
+
+    /// Flag the vertices that may be moved: owned vertices which are
+    /// not on the boundary.
+    void find_smoothable(std::vector<char> &smoothable) const
+    {
+        int NNodes = _mesh->get_number_nodes();
+        int NElements = _mesh->get_number_elements();
+
+        smoothable.resize(NNodes);
+
         #pragma omp parallel
         {
             #pragma omp for schedule(static)
             for(int n=0; n<NNodes; ++n) {
-                is_boundary[n].store(false, std::memory_order_relaxed);
-                if(_mesh->NNList[n].empty()) {
-                    assert(_mesh->NEList[n].empty());
-                    active_vertices[n].store(false, std::memory_order_relaxed);
-                } else {
-                    active_vertices[n].store(true, std::memory_order_relaxed);
-                }
-                vLocks[n].unlock();
+                smoothable[n] = (!_mesh->NNList[n].empty() && !_mesh->is_halo_node(n));
             }
 
+            // Boundary vertices are never moved.
             #pragma omp for schedule(guided)
             for(int i=0; i<NElements; i++) {
                 const int *n=_mesh->get_element(i);
@@ -442,96 +633,14 @@ public:
                 for(size_t j=0; j<nloc; j++) {
                     if(_mesh->boundary[i*nloc+j]>0) {
                         for(size_t k=1; k<nloc; k++) {
-                            is_boundary[n[(j+k)%nloc]].store(true, std::memory_order_relaxed);
+                            smoothable[n[(j+k)%nloc]] = 0;
                         }
                     }
                 }
             }
-            // First sweep through all vertices. Add vertices adjacent to any
-            // vertex moved into the active_vertex list.
-            std::vector<index_t> retry, next_retry;
-
-            int iter=0;
-            while((iter++) < max_iterations) {
-                #pragma omp for schedule(guided) nowait
-                for(index_t node=0; node<NNodes; ++node) {
-                    if(_mesh->is_halo_node(node) || is_boundary[node].load(std::memory_order_relaxed) || !active_vertices[node].load(std::memory_order_relaxed))
-                        continue;
-
-                    if(!vLocks[node].try_lock()) {
-                        retry.push_back(node);
-                        continue;
-                    }
-
-                    bool abort = false;
-                    for(const auto& it : _mesh->NNList[node]) {
-                        if(vLocks[it].is_locked()) {
-                            abort = true;
-                            break;
-                        }
-                    }
-
-                    if(!abort) {
-                        if(laplacian_kernel(node)) {
-                            for(auto& it : _mesh->NNList[node]) {
-                                assert(!_mesh->NNList[node].empty());
-                                assert(!_mesh->NEList[node].empty());
-                                active_vertices[it].store(true, std::memory_order_relaxed);
-                            }
-                        } else {
-                            active_vertices[node].store(false, std::memory_order_relaxed);
-                        }
-                    } else {
-                        retry.push_back(node);
-                    }
-                    vLocks[node].unlock();
-                }
-
-                for(int iretry=0; iretry<100; iretry++) { // Put a hard limit on the number of times we try to get a lock.
-                    next_retry.clear();
-
-                    for(const auto& node : retry) {
-                        bool abort = false;
-
-                        if(!vLocks[node].try_lock()) {
-                            next_retry.push_back(node);
-                            continue;
-                        }
-
-                        for(const auto& it : _mesh->NNList[node]) {
-                            if(vLocks[it].is_locked()) {
-                                abort = true;
-                                break;
-                            }
-                        }
-
-                        if(!abort) {
-                            if(laplacian_kernel(node)) {
-                                for(auto& it : _mesh->NNList[node]) {
-                                    assert(!_mesh->NNList[node].empty());
-                                    assert(!_mesh->NEList[node].empty());
-                                    active_vertices[it].store(true, std::memory_order_relaxed);
-                                }
-                            } else {
-                                active_vertices[node].store(false, std::memory_order_relaxed);
-                            }
-                        } else {
-                            next_retry.push_back(node);
-                        }
-                        vLocks[node].unlock();
-                    }
-
-                    retry.swap(next_retry);
-                    if(retry.empty())
-                        break;
-                }
-            }
         }
-        return;
     }
 
-private:
-
     // Laplacian smooth kernels
     inline bool laplacian_kernel(index_t node)
     {
@@ -563,14 +672,16 @@ private:
         if(!valid)
             return false;
 
+        if(_mesh->nfields>0)
+            interpolate_fields(node, p);
+
         for(size_t j=0; j<2; j++)
             _mesh->_coords[node*2+j] = p[j];
 
         for(size_t j=0; j<3; j++)
             _mesh->metric[node*3+j] = mp[j];
 
-        for(auto& e : _mesh->NEList[node])
-            update_quality(e);
+        _mesh->template update_quality<dim>(_mesh->NEList[node].begin(), _mesh->NEList[node].end());
 
         return true;
     }
@@ -592,14 +703,16 @@ private:
         if(!valid)
             return false;
 
+        if(_mesh->nfields>0)
+            interpolate_fields(node, p);
+
         for(size_t j=0; j<3; j++)
             _mesh->_coords[node*3+j] = p[j];
 
         for(size_t j=0; j<6; j++)
             _mesh->metric[node*6+j] = mp[j];
 
-        for(auto& e : _mesh->NEList[node])
-            update_quality(e);
+        _mesh->template update_quality<dim>(_mesh->NEList[node].begin(), _mesh->NEList[node].end());
 
         return true;
     }
@@ -737,14 +850,16 @@ private:
         if(functional-functional_orig<epsilon_q)
             return false;
 
+        if(_mesh->nfields>0)
+            interpolate_fields(node, p);
+
         for(size_t j=0; j<2; j++)
             _mesh->_coords[node*2+j] = p[j];
 
         for(size_t j=0; j<3; j++)
             _mesh->metric[node*3+j] = mp[j];
 
-        for(const auto& e : _mesh->NEList[node])
-            update_quality(e);
+        _mesh->template update_quality<dim>(_mesh->NEList[node].begin(), _mesh->NEList[node].end());
 
         return true;
     }
@@ -759,7 +874,7 @@ private:
         if(!valid) {
             // Try the mid point.
             for(size_t j=0; j<3; j++)
-                p[j] = 0.5*(p[j] +  _mesh->_coords[node*2+j]);
+                p[j] = 0.5*(p[j] +  _mesh->_coords[node*3+j]);
 
             valid = generate_location_3d(node, p, mp);
         }
@@ -774,14 +889,16 @@ private:
         if(functional-functional_orig<epsilon_q)
             return false;
 
+        if(_mesh->nfields>0)
+            interpolate_fields(node, p);
+
         for(size_t j=0; j<3; j++)
             _mesh->_coords[node*3+j] = p[j];
 
         for(size_t j=0; j<6; j++)
             _mesh->metric[node*6+j] = mp[j];
 
-        for(const auto& e : _mesh->NEList[node])
-            update_quality(e);
+        _mesh->template update_quality<dim>(_mesh->NEList[node].begin(), _mesh->NEList[node].end());
 
         return true;
     }
@@ -849,7 +966,7 @@ private:
         double alpha;
         {
             double bbox[] = {DBL_MAX, -DBL_MAX, DBL_MAX, -DBL_MAX};
-            for(const auto& it : _mesh->NEList[n0]) {
+            for(const auto& it : _mesh->NNList[n0]) {
                 const double *x1 = _mesh->get_coords(it);
 
                 bbox[0] = std::min(bbox[0], x1[0]);
@@ -949,14 +1066,16 @@ private:
             }
             assert(new_quality.empty());
 
+            if(_mesh->nfields>0)
+                interpolate_fields(n0, new_x0);
+
             for(size_t i=0; i<dim; i++)
                 _mesh->_coords[n0*dim+i] = new_x0[i];
 
             for(size_t i=0; i<msize; i++)
                 _mesh->metric[n0*msize+i] = new_m0[i];
 
-            for(auto& e : _mesh->NEList[n0])
-                update_quality(e);
+            _mesh->template update_quality<dim>(_mesh->NEList[n0].begin(), _mesh->NEList[n0].end());
 
             break;
         }
@@ -1037,7 +1156,7 @@ private:
         double alpha;
         {
             double bbox[] = {DBL_MAX, -DBL_MAX, DBL_MAX, -DBL_MAX, DBL_MAX, -DBL_MAX};
-            for(const auto& it : _mesh->NEList[n0]) {
+            for(const auto& it : _mesh->NNList[n0]) {
                 const double *x1 = _mesh->get_coords(it);
 
                 bbox[0] = std::min(bbox[0], x1[0]);
@@ -1185,14 +1304,16 @@ private:
             }
             assert(new_quality.empty());
 
+            if(_mesh->nfields>0)
+                interpolate_fields(n0, new_x0);
+
             for(size_t i=0; i<dim; i++)
                 _mesh->_coords[n0*dim+i] = new_x0[i];
 
             for(size_t i=0; i<msize; i++)
                 _mesh->metric[n0*msize+i] = new_m0[i];
 
-            for(auto& e : _mesh->NEList[n0])
-                update_quality(e);
+            _mesh->template update_quality<dim>(_mesh->NEList[n0].begin(), _mesh->NEList[n0].end());
 
             break;
         }
@@ -1200,6 +1321,202 @@ private:
         return linf_update;
     }
 
+    /* Newton kernel. Minimises G(x) = sum_e q_e(x)^-p over the patch of
+     * n0, with the metric held at its current value while computing the
+     * step. Indefinite Hessians are made positive definite by taking
+     * the absolute value of (and bounding) their eigenvalues. Moves are
+     * limited to half the shortest incident edge and must keep the patch
+     * valid, reduce G by more than newton_tol relative to G and not
+     * reduce the minimum quality of the patch.
+     */
+    inline bool optimisation_newton_kernel(index_t n0)
+    {
+        typedef Eigen::Matrix<double, dim, 1> Vector;
+        typedef Eigen::Matrix<double, dim, dim> Matrix;
+
+        const double p = newton_p;
+        const double *x0 = _mesh->get_coords(n0);
+        const double *m0 = _mesh->get_metric(n0);
+
+        double qmin = functional_Linf(n0);
+        if(qmin>good_q)
+            return false;
+
+        double G = 0;
+        Vector grad = Vector::Zero();
+        Matrix hess = Matrix::Zero();
+        for(const auto& ie : _mesh->NEList[n0]) {
+            index_t r[dim+1];
+            patch_element(n0, ie, r);
+
+            // Metric averaged over the element.
+            double m[dim==2?3:6];
+            for(size_t k=0; k<msize; k++) {
+                m[k] = m0[k];
+                for(int i=1; i<=dim; i++)
+                    m[k] += _mesh->metric[r[i]*msize+k];
+                m[k] /= (dim+1);
+            }
+
+            Vector gq;
+            Matrix hq;
+            double q;
+            if(dim==2)
+                q = property->lipnikov_hessian(x0, _mesh->get_coords(r[1]), _mesh->get_coords(r[2]),
+                                               m, gq.data(), hq.data());
+            else
+                q = property->lipnikov_hessian(x0, _mesh->get_coords(r[1]), _mesh->get_coords(r[2]), _mesh->get_coords(r[3]),
+                                               m, gq.data(), hq.data());
+            if(!(q>0))
+                return false;
+
+            double qp = pow(q, -p);
+            G += qp;
+            grad -= (p*qp/q)*gq;
+            hess += (p*(p+1)*qp/(q*q))*gq*gq.transpose() - (p*qp/q)*hq;
+        }
+
+        Eigen::SelfAdjointEigenSolver<Matrix> eigen(hess);
+        Vector lambda = eigen.eigenvalues().cwiseAbs();
+        double lambda_max = lambda.maxCoeff();
+        if(!(lambda_max>0) || !std::isfinite(lambda_max))
+            return false;
+        for(int i=0; i<dim; i++)
+            lambda[i] = std::max(lambda[i], 1.0e-3*lambda_max);
+
+        Vector step = -eigen.eigenvectors()*((eigen.eigenvectors().transpose()*grad).cwiseQuotient(lambda));
+
+        double hmin = DBL_MAX;
+        for(const auto& it : _mesh->NNList[n0]) {
+            const double *x1 = _mesh->get_coords(it);
+            double h2 = 0;
+            for(int i=0; i<dim; i++)
+                h2 += (x1[i]-x0[i])*(x1[i]-x0[i]);
+            hmin = std::min(hmin, h2);
+        }
+        hmin = sqrt(hmin);
+
+        double step_norm = step.norm();
+        if(!std::isfinite(step_norm) || !(step_norm>0))
+            return false;
+
+        // Line search along the Newton direction. Near a degenerate element
+        // q^-p behaves like a barrier and the Newton step is short, so the
+        // step is also extended while it keeps improving G.
+        double alpha_max = 0.5*hmin/step_norm;
+        double alpha0 = std::min(1.0, alpha_max);
+        double alpha = alpha0;
+
+        double best_x0[dim], best_m0[dim==2?3:6], best_G=G;
+        bool found = false;
+        for(int isearch=0; isearch<8; isearch++) {
+            if(newton_trial(n0, step, alpha, qmin, best_G, best_x0, best_m0)) {
+                found = true;
+                break;
+            }
+            alpha *= 0.5;
+        }
+        if(!found)
+            return false;
+
+        if(alpha==alpha0) {
+            for(alpha*=2.0; alpha<=alpha_max; alpha*=2.0) {
+                if(!newton_trial(n0, step, alpha, qmin, best_G, best_x0, best_m0))
+                    break;
+            }
+        }
+
+        // The vertex has converged; leave it where it is.
+        if(!((G-best_G)>newton_tol*G))
+            return false;
+
+        if(_mesh->nfields>0)
+            interpolate_fields(n0, best_x0);
+
+        for(int i=0; i<dim; i++)
+            _mesh->_coords[n0*dim+i] = best_x0[i];
+
+        for(size_t i=0; i<msize; i++)
+            _mesh->metric[n0*msize+i] = best_m0[i];
+
+        _mesh->template update_quality<dim>(_mesh->NEList[n0].begin(), _mesh->NEList[n0].end());
+
+        return true;
+    }
+
+    /* Try moving n0 by alpha*step. The move is accepted (and the new
+     * position, metric and functional are returned) if the patch stays
+     * valid, its minimum quality does not fall below qmin and the p-mean
+     * functional is smaller than best_G.
+     */
+    template<typename vector_t>
+    inline bool newton_trial(index_t n0, const vector_t &step, double alpha, double qmin,
+                             double &best_G, double *best_x0, double *best_m0) const
+    {
+        const double *x0 = _mesh->get_coords(n0);
+
+        double new_x0[dim], new_m0[dim==2?3:6];
+        for(int i=0; i<dim; i++)
+            new_x0[i] = x0[i] + alpha*step[i];
+
+        bool valid;
+        if(dim==2)
+            valid = generate_location_2d(n0, new_x0, new_m0);
+        else
+            valid = generate_location_3d(n0, new_x0, new_m0);
+        if(!valid)
+            return false;
+
+        double new_G = 0;
+        for(const auto& ie : _mesh->NEList[n0]) {
+            index_t r[dim+1];
+            patch_element(n0, ie, r);
+
+            double q;
+            if(dim==2)
+                q = property->lipnikov(new_x0, _mesh->get_coords(r[1]), _mesh->get_coords(r[2]),
+                                       new_m0, _mesh->get_metric(r[1]), _mesh->get_metric(r[2]));
+            else
+                q = property->lipnikov(new_x0, _mesh->get_coords(r[1]), _mesh->get_coords(r[2]), _mesh->get_coords(r[3]),
+                                       new_m0, _mesh->get_metric(r[1]), _mesh->get_metric(r[2]), _mesh->get_metric(r[3]));
+            if(!(q>0) || q<qmin)
+                return false;
+
+            new_G += pow(q, -newton_p);
+        }
+
+        if(!(new_G<best_G))
+            return false;
+
+        best_G = new_G;
+        for(int i=0; i<dim; i++)
+            best_x0[i] = new_x0[i];
+        for(size_t i=0; i<msize; i++)
+            best_m0[i] = new_m0[i];
+
+        return true;
+    }
+
+    /// Vertices of element eid, reordered to start with n0 while preserving orientation.
+    inline void patch_element(index_t n0, index_t eid, index_t *r) const
+    {
+        const index_t *n=_mesh->get_element(eid);
+        if(dim==2) {
+            int loc = (n[0]==n0)?0:((n[1]==n0)?1:2);
+            r[0] = n0;
+            r[1] = n[(loc+1)%3];
+            r[2] = n[(loc+2)%3];
+        } else {
+            static const int order[4][3] = {{1, 2, 3}, {2, 0, 3}, {0, 1, 3}, {0, 2, 1}};
+            int loc = 0;
+            while(n[loc]!=n0)
+                loc++;
+            r[0] = n0;
+            for(int i=0; i<3; i++)
+                r[i+1] = n[order[loc][i]];
+        }
+    }
+
     inline real_t get_x(index_t nid) const
     {
         return _mesh->_coords[nid*dim];
@@ -1240,7 +1557,11 @@ private:
 
     inline real_t functional_Linf_2d(index_t n0, const real_t *p, const real_t *mp) const
     {
+        const int block = ElementProperty<real_t>::lipnikov_block;
+        double x[6][block], m[3][block], q[block];
+
         real_t functional = DBL_MAX;
+        int k=0;
         for(const auto& ie : _mesh->NEList[n0]) {
             const index_t *n=_mesh->get_element(ie);
             assert(n[0]>=0);
@@ -1258,17 +1579,31 @@ private:
             const double *m1 = _mesh->get_metric(n[loc1]);
             const double *m2 = _mesh->get_metric(n[loc2]);
 
-            real_t fnl = property->lipnikov(p,  x1, x2,
-                                            mp, m1, m2);
-            functional = std::min(functional, fnl);
+            for(int d=0; d<2; d++) {
+                x[d][k] = p[d];
+                x[2+d][k] = x1[d];
+                x[4+d][k] = x2[d];
+            }
+            property->lipnikov_block_metric(m, k, mp, m1, m2);
+
+            if(++k==block) {
+                functional = std::min(functional, (real_t)property->lipnikov_block2d(k, x, m, q));
+                k = 0;
+            }
         }
+        if(k>0)
+            functional = std::min(functional, (real_t)property->lipnikov_block2d(k, x, m, q));
 
         return functional;
     }
 
     inline real_t functional_Linf_3d(index_t n0, const real_t *p, const real_t *mp) const
     {
+        const int block = ElementProperty<real_t>::lipnikov_block;
+        double x[12][block], m[6][block], q[block];
+
         real_t functional = DBL_MAX;
+        int k=0;
         for(const auto& ie : _mesh->NEList[n0]) {
             const index_t *n=_mesh->get_element(ie);
             size_t loc=0;
@@ -1308,18 +1643,52 @@ private:
             const double *m2 = _mesh->get_metric(n2);
             const double *m3 = _mesh->get_metric(n3);
 
-            real_t fnl = property->lipnikov(p, x1, x2, x3,
-                                            mp,m1, m2, m3);
+            for(int d=0; d<3; d++) {
+                x[d][k] = p[d];
+                x[3+d][k] = x1[d];
+                x[6+d][k] = x2[d];
+                x[9+d][k] = x3[d];
+            }
+            property->lipnikov_block_metric(m, k, mp, m1, m2, m3);
 
-            functional = std::min(functional, fnl);
+            if(++k==block) {
+                functional = std::min(functional, (real_t)property->lipnikov_block3d(k, x, m, q));
+                k = 0;
+            }
         }
+        if(k>0)
+            functional = std::min(functional, (real_t)property->lipnikov_block3d(k, x, m, q));
+
         return functional;
     }
 
     inline bool generate_location_2d(index_t node, const real_t *p, double *mp) const
     {
         // Interpolate metric at this new position.
-        real_t l[]= {-1, -1, -1};
+        real_t l[3];
+        int best_e = locate_2d(node, p, l);
+        if(best_e<0)
+            return false;
+
+        const index_t *n=_mesh->get_element(best_e);
+        assert(n[0]>=0);
+
+        for(size_t i=0; i<msize; i++)
+            mp[i] =
+                l[0]*_mesh->metric[n[0]*msize+i]+
+                l[1]*_mesh->metric[n[1]*msize+i]+
+                l[2]*_mesh->metric[n[2]*msize+i];
+
+        return true;
+    }
+
+    /* Find the element of the patch of node that best contains the
+     * position p, i.e. the one with the largest minimum barycentric
+     * coordinate, and return it with the barycentric coordinates l.
+     * Returns -1 if moving node to p would invert an element.
+     */
+    inline int locate_2d(index_t node, const real_t *p, real_t *l) const
+    {
         int best_e=-1;
         real_t tol=-1;
 
@@ -1342,7 +1711,7 @@ private:
                 area = property->area(x0, x1, p);
             }
             if(area<0)
-                return false;
+                return -1;
 
             real_t L = property->area(x0, x1, x2);
 
@@ -1369,6 +1738,17 @@ private:
         assert(best_e!=-1);
         assert(tol>-DBL_EPSILON);
 
+        return best_e;
+    }
+
+    inline bool generate_location_3d(index_t node, const real_t *p, double *mp) const
+    {
+        // Interpolate metric at this new position.
+        real_t l[4];
+        int best_e = locate_3d(node, p, l);
+        if(best_e<0)
+            return false;
+
         const index_t *n=_mesh->get_element(best_e);
         assert(n[0]>=0);
 
@@ -1376,15 +1756,15 @@ private:
             mp[i] =
                 l[0]*_mesh->metric[n[0]*msize+i]+
                 l[1]*_mesh->metric[n[1]*msize+i]+
-                l[2]*_mesh->metric[n[2]*msize+i];
+                l[2]*_mesh->metric[n[2]*msize+i]+
+                l[3]*_mesh->metric[n[3]*msize+i];
 
         return true;
     }
 
-    inline bool generate_location_3d(index_t node, const real_t *p, double *mp) const
+    /// 3D version of locate_2d.
+    inline int locate_3d(index_t node, const real_t *p, real_t *l) const
     {
-        // Interpolate metric at this new position.
-        real_t l[]= {-1, -1, -1, -1};
         int best_e=-1;
         real_t tol=-1;
 
@@ -1410,7 +1790,7 @@ private:
                 volume = property->volume(x0, x1, x2, p);
             }
             if(volume<0)
-                return false;
+                return -1;
 
             real_t L = property->volume(x0, x1, x2, x3);
 
@@ -1443,69 +1823,27 @@ private:
         assert(tol>-10*DBL_EPSILON);
 #endif
 
-        const index_t *n=_mesh->get_element(best_e);
-        assert(n[0]>=0);
-
-        for(size_t i=0; i<msize; i++)
-            mp[i] =
-                l[0]*_mesh->metric[n[0]*msize+i]+
-                l[1]*_mesh->metric[n[1]*msize+i]+
-                l[2]*_mesh->metric[n[2]*msize+i]+
-                l[3]*_mesh->metric[n[3]*msize+i];
-
-        return true;
-    }
-
-    inline void update_quality(index_t element)
-    {
-        if(dim==2)
-            update_quality_2d(element);
-        else
-            update_quality_3d(element);
-
-        assert(std::isfinite(_mesh->quality[element]));
-    }
-
-    inline void update_quality_2d(index_t element)
-    {
-        const index_t *n=_mesh->get_element(element);
-
-        assert(n[0]>=0);
-        assert(n[1]>=0);
-        assert(n[2]>=0);
-
-        const double *x0 = _mesh->get_coords(n[0]);
-        const double *x1 = _mesh->get_coords(n[1]);
-        const double *x2 = _mesh->get_coords(n[2]);
-
-        const double *m0 = _mesh->get_metric(n[0]);
-        const double *m1 = _mesh->get_metric(n[1]);
-        const double *m2 = _mesh->get_metric(n[2]);
-
-        _mesh->quality[element] = property->lipnikov(x0, x1, x2,
-                                  m0, m1, m2);
-
-        return;
+        return best_e;
     }
 
-    inline void update_quality_3d(index_t element)
+    /* Re-interpolate the attached fields at node, which is about to be
+     * moved to p, from the vertices of its current patch. Each field
+     * value is read before it is overwritten, so this is done in place.
+     */
+    inline void interpolate_fields(index_t node, const real_t *p)
     {
-        const index_t *n=_mesh->get_element(element);
-
-        const double *x0 = _mesh->get_coords(n[0]);
-        const double *x1 = _mesh->get_coords(n[1]);
-        const double *x2 = _mesh->get_coords(n[2]);
-        const double *x3 = _mesh->get_coords(n[3]);
-
-        const double *m0 = _mesh->get_metric(n[0]);
-        const double *m1 = _mesh->get_metric(n[1]);
-        const double *m2 = _mesh->get_metric(n[2]);
-        const double *m3 = _mesh->get_metric(n[3]);
+        real_t l[4];
+        int best_e = (dim==2) ? locate_2d(node, p, l) : locate_3d(node, p, l);
+        assert(best_e>=0);
 
-        _mesh->quality[element] = property->lipnikov(x0, x1, x2, x3,
-                                  m0, m1, m2, m3);
-
-        return;
+        const index_t *n=_mesh->get_element(best_e);
+        size_t nfields = _mesh->nfields;
+        for(size_t k=0; k<nfields; k++) {
+            real_t f = 0;
+            for(size_t i=0; i<nloc; i++)
+                f += l[i]*_mesh->fields[n[i]*nfields+k];
+            _mesh->fields[node*nfields+k] = f;
+        }
     }
 
     /*
@@ -1526,10 +1864,21 @@ private:
     ElementProperty<real_t> *property;
     std::vector<Lock> vLocks;
 
+    // Colour classes of the smoothable vertices (CSR) and the mesh
+    // topology version they were computed for.
+    std::vector<index_t> colour_ptr, colour_vertices;
+    size_t colouring_version;
+    bool colouring_valid;
+
     const size_t nloc, msize;
 
     int mpi_nparts, rank;
     real_t good_q, epsilon_q;
+
+    // Exponent of the p-mean used by optimisation_newton and the relative
+    // decrease of the p-mean functional below which a vertex is considered
+    // converged and is not moved.
+    double newton_p, newton_tol;
 };
 
 #endif
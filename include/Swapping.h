@@ -104,6 +104,8 @@ public:
 
         min_Q = quality_tolerance;
 
+        _mesh->topology_version++;
+
         if(nnodes_reserve<NNodes) {
             nnodes_reserve = NNodes;
 
@@ -647,502 +649,201 @@ private:
 
     inline bool swap_kernel3d(const Edge<index_t>& edge, propagation_map& pMap)
     {
+        // Edge-swap templates indexed by shell size. Each new element is
+        // given by three ring vertices followed by the ring elements whose
+        // outer faces it inherits (-1 for an interior face). The first half
+        // of the elements in each option is capped by nl, the second half by nk.
+        static const int swap3to2[1][2][6] = {
+            {{0, 1, 2, 1, 2, 0}, {1, 0, 2, 2, 1, 0}}
+        };
+        static const int swap4to4[2][4][6] = {
+            {{0, 1, 3, -1, 3, 0}, {1, 2, 3, 2, -1, 1}, {1, 0, 3, 3, -1, 0}, {2, 1, 3, -1, 2, 1}},
+            {{0, 1, 2, 1, -1, 0}, {0, 2, 3, 2, 3, -1}, {0, 2, 1, 1, 0, -1}, {0, 3, 2, 2, -1, 3}}
+        };
+        static const int swap5to6[5][6][6] = {
+            {{0, 1, 2, 1, -1, 0}, {2, 3, 0, -1, -1, 2}, {3, 4, 0, 4, -1, 3}, {1, 0, 2, -1, 1, 0}, {3, 2, 0, -1, -1, 2}, {4, 3, 0, -1, 4, 3}},
+            {{0, 1, 4, -1, 4, 0}, {1, 3, 4, 3, -1, -1}, {1, 2, 3, 2, -1, 1}, {0, 4, 1, -1, 0, 4}, {1, 4, 3, 3, -1, -1}, {1, 3, 2, 2, 1, -1}},
+            {{2, 0, 1, 0, 1, -1}, {2, 4, 0, 4, -1, -1}, {2, 3, 4, 3, -1, 2}, {2, 1, 0, 0, -1, 1}, {2, 0, 4, 4, -1, -1}, {2, 4, 3, 3, 2, -1}},
+            {{3, 1, 2, 1, 2, -1}, {3, 0, 1, 0, -1, -1}, {3, 4, 0, 4, -1, 3}, {3, 2, 1, 1, -1, 2}, {3, 1, 0, 0, -1, -1}, {3, 0, 4, 4, 3, -1}},
+            {{4, 0, 1, 0, -1, 4}, {4, 1, 2, 1, -1, -1}, {4, 2, 3, 2, 3, -1}, {4, 1, 0, 0, 4, -1}, {4, 2, 1, 1, -1, -1}, {4, 3, 2, 2, -1, 3}}
+        };
+
         index_t nk = edge.edge.first;
         index_t nl = edge.edge.second;
 
         if(_mesh->is_halo_node(nk) && _mesh->is_halo_node(nl))
             return false;
 
-        std::set<index_t> neigh_elements;
-        set_intersection(_mesh->NEList[nk].begin(), _mesh->NEList[nk].end(),
-                         _mesh->NEList[nl].begin(), _mesh->NEList[nl].end(),
-                         inserter(neigh_elements, neigh_elements.begin()));
-
-        bool abort = true;
-        for(auto& e : neigh_elements) {
-            if(_mesh->quality[e] < min_Q) {
-                abort = false;
-                break;
+        // Gather the shell of elements around the edge. Only shells of 3, 4
+        // or 5 elements can be swapped, so anything bigger is rejected here.
+        index_t shell[max_shell3d];
+        size_t nelements = 0;
+        {
+            std::set<index_t>::const_iterator it=_mesh->NEList[nk].begin(), jt=_mesh->NEList[nl].begin();
+            while(it!=_mesh->NEList[nk].end() && jt!=_mesh->NEList[nl].end()) {
+                if(*it<*jt) {
+                    ++it;
+                } else if(*jt<*it) {
+                    ++jt;
+                } else {
+                    if(nelements==max_shell3d)
+                        return false;
+                    shell[nelements++] = *it;
+                    ++it;
+                    ++jt;
+                }
             }
         }
 
-        if(abort)
+        if(nelements<3)
             return false;
 
         double min_quality = 1.0;
-        std::vector<index_t> constrained_edges_unsorted;
-        std::map<int, std::map<index_t, int> > b;
-        std::vector<int> element_order, e_to_eid;
+        for(size_t e=0; e<nelements; e++)
+            min_quality = std::min(min_quality, _mesh->quality[shell[e]]);
 
-        for(auto& it : neigh_elements) {
-            min_quality = std::min(min_quality, _mesh->quality[it]);
+        if(min_quality >= min_Q)
+            return false;
 
-            const int *m=_mesh->get_element(it);
-            if(m[0]<0) {
+        // For each shell element record the two ring vertices (in element
+        // order) and the boundary labels of the faces opposite nk and nl.
+        index_t ring_pair[max_shell3d][2];
+        int bk_shell[max_shell3d], bl_shell[max_shell3d];
+
+        // Ring vertex -> incident shell elements, open addressed on the vertex id.
+        const int table_size = 8;
+        index_t table_vid[table_size];
+        int table_ele[table_size][2];
+        std::fill(table_vid, table_vid+table_size, -1);
+        size_t nring = 0;
+
+        for(size_t e=0; e<nelements; e++) {
+            const int *m=_mesh->get_element(shell[e]);
+            if(m[0]<0)
                 return false;
-            }
-
-            e_to_eid.push_back(it);
 
+            int loc=0;
             for(int j=0; j<4; j++) {
                 if((m[j]!=nk)&&(m[j]!=nl)) {
-                    constrained_edges_unsorted.push_back(m[j]);
+                    ring_pair[e][loc++] = m[j];
                 } else if(m[j] == nk) {
-                    b[it][nk] = _mesh->boundary[nloc*(it)+j];
+                    bk_shell[e] = _mesh->boundary[nloc*shell[e]+j];
                 } else { // if(m[j] == nl)
-                    b[it][nl] = _mesh->boundary[nloc*(it)+j];
+                    bl_shell[e] = _mesh->boundary[nloc*shell[e]+j];
+                }
+            }
+            assert(loc==2);
+
+            for(int j=0; j<2; j++) {
+                int slot = ring_pair[e][j]&(table_size-1);
+                while(table_vid[slot]!=-1 && table_vid[slot]!=ring_pair[e][j])
+                    slot = (slot+1)&(table_size-1);
+
+                if(table_vid[slot]==-1) {
+                    // A closed ring has as many vertices as shell elements.
+                    if(nring++==nelements)
+                        return false;
+                    table_vid[slot] = ring_pair[e][j];
+                    table_ele[slot][0] = e;
+                    table_ele[slot][1] = -1;
+                } else if(table_ele[slot][1]==-1) {
+                    table_ele[slot][1] = e;
+                } else {
+                    // Ring vertex shared by more than two shell elements.
+                    return false;
                 }
             }
         }
 
-        size_t nelements = neigh_elements.size();
-        assert(nelements*2==constrained_edges_unsorted.size());
-        assert(b.size() == nelements);
+        // Walk around the ring starting from the first shell element. Every
+        // ring vertex must be shared by exactly two shell elements, otherwise
+        // this is a surface edge and cannot be swapped.
+        index_t ring[max_shell3d+1];
+        int element_order[max_shell3d];
+        int bk[max_shell3d], bl[max_shell3d];
 
-        // Sort edges.
-        std::vector<index_t> constrained_edges;
-        std::vector<bool> sorted(nelements, false);
-        constrained_edges.push_back(constrained_edges_unsorted[0]);
-        constrained_edges.push_back(constrained_edges_unsorted[1]);
-        element_order.push_back(e_to_eid[0]);
+        element_order[0] = 0;
+        ring[0] = ring_pair[0][0];
+        ring[1] = ring_pair[0][1];
         for(size_t j=1; j<nelements; j++) {
-            for(size_t e=1; e<nelements; e++) {
-                if(sorted[e])
-                    continue;
-                if(*constrained_edges.rbegin()==constrained_edges_unsorted[e*2]) {
-                    constrained_edges.push_back(constrained_edges_unsorted[e*2]);
-                    constrained_edges.push_back(constrained_edges_unsorted[e*2+1]);
-                    element_order.push_back(e_to_eid[e]);
-                    sorted[e]=true;
-                    break;
-                } else if(*constrained_edges.rbegin()==constrained_edges_unsorted[e*2+1]) {
-                    constrained_edges.push_back(constrained_edges_unsorted[e*2+1]);
-                    constrained_edges.push_back(constrained_edges_unsorted[e*2]);
-                    element_order.push_back(e_to_eid[e]);
-                    sorted[e]=true;
-                    break;
-                }
-            }
-        }
+            int slot = ring[j]&(table_size-1);
+            while(table_vid[slot]!=ring[j])
+                slot = (slot+1)&(table_size-1);
 
-        if(*constrained_edges.begin() != *constrained_edges.rbegin()) {
-            return false;
+            int prev = element_order[j-1];
+            int next = (table_ele[slot][0]==prev) ? table_ele[slot][1] : table_ele[slot][0];
+            if(next<=0)
+                return false;
+
+            element_order[j] = next;
+            ring[j+1] = (ring_pair[next][0]==ring[j]) ? ring_pair[next][1] : ring_pair[next][0];
         }
-        // assert(element_order.size() == nelements);
-        if(element_order.size() != nelements) {
-            std::cerr<<"assert(element_order.size() == nelements) would fail "<<element_order.size()<<", "<<nelements<<std::endl;
+
+        if(ring[nelements] != ring[0])
             return false;
+
+        for(size_t j=0; j<nelements; j++) {
+            bk[j] = bk_shell[element_order[j]];
+            bl[j] = bl_shell[element_order[j]];
         }
 
         double orig_vol = 0.0;
-        for(auto& ele : neigh_elements) {
-            const index_t* n = _mesh->get_element(ele);
+        for(size_t e=0; e<nelements; e++) {
+            const index_t* n = _mesh->get_element(shell[e]);
             orig_vol += property->volume(_mesh->get_coords(n[0]), _mesh->get_coords(n[1]),
                                          _mesh->get_coords(n[2]), _mesh->get_coords(n[3]));
         }
 
-        std::vector< std::vector<index_t> > new_elements;
-        std::vector< std::vector<int> > new_boundaries;
+        const int *templates;
+        size_t noptions, new_nelements;
         if(nelements==3) {
             // This is the 3-element to 2-element swap.
-            new_elements.resize(1);
-            new_boundaries.resize(1);
-
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(nl);
-            new_boundaries[0].push_back(b[element_order[1]][nk]);
-            new_boundaries[0].push_back(b[element_order[2]][nk]);
-            new_boundaries[0].push_back(b[element_order[0]][nk]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(nk);
-            new_boundaries[0].push_back(b[element_order[2]][nl]);
-            new_boundaries[0].push_back(b[element_order[1]][nl]);
-            new_boundaries[0].push_back(b[element_order[0]][nl]);
-            new_boundaries[0].push_back(0);
+            templates = &swap3to2[0][0][0];
+            noptions = 1;
+            new_nelements = 2;
         } else if(nelements==4) {
             // This is the 4-element to 4-element swap.
-            new_elements.resize(2);
-            new_boundaries.resize(2);
-
-            // Option 1.
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(nl);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[3]][nk]);
-            new_boundaries[0].push_back(b[element_order[0]][nk]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(nl);
-            new_boundaries[0].push_back(b[element_order[2]][nk]);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[1]][nk]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(nk);
-            new_boundaries[0].push_back(b[element_order[3]][nl]);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[0]][nl]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(nk);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[2]][nl]);
-            new_boundaries[0].push_back(b[element_order[1]][nl]);
-            new_boundaries[0].push_back(0);
-
-            // Option 2
-            new_elements[1].push_back(constrained_edges[0]);
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(constrained_edges[4]);
-            new_elements[1].push_back(nl);
-            new_boundaries[1].push_back(b[element_order[1]][nk]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(b[element_order[0]][nk]);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[0]);
-            new_elements[1].push_back(constrained_edges[4]);
-            new_elements[1].push_back(constrained_edges[6]);
-            new_elements[1].push_back(nl);
-            new_boundaries[1].push_back(b[element_order[2]][nk]);
-            new_boundaries[1].push_back(b[element_order[3]][nk]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[0]);
-            new_elements[1].push_back(constrained_edges[4]);
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(nk);
-            new_boundaries[1].push_back(b[element_order[1]][nl]);
-            new_boundaries[1].push_back(b[element_order[0]][nl]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[0]);
-            new_elements[1].push_back(constrained_edges[6]);
-            new_elements[1].push_back(constrained_edges[4]);
-            new_elements[1].push_back(nk);
-            new_boundaries[1].push_back(b[element_order[2]][nl]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(b[element_order[3]][nl]);
-            new_boundaries[1].push_back(0);
-        } else if(nelements==5) {
-            // This is the 5-element to 6-element swap.
-            new_elements.resize(5);
-            new_boundaries.resize(5);
-
-            // Option 1
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(nl);
-            new_boundaries[0].push_back(b[element_order[1]][nk]);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[0]][nk]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(nl);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[2]][nk]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(constrained_edges[8]);
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(nl);
-            new_boundaries[0].push_back(b[element_order[4]][nk]);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[3]][nk]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[2]);
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(nk);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[1]][nl]);
-            new_boundaries[0].push_back(b[element_order[0]][nl]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(constrained_edges[4]);
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(nk);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[2]][nl]);
-            new_boundaries[0].push_back(0);
-
-            new_elements[0].push_back(constrained_edges[8]);
-            new_elements[0].push_back(constrained_edges[6]);
-            new_elements[0].push_back(constrained_edges[0]);
-            new_elements[0].push_back(nk);
-            new_boundaries[0].push_back(0);
-            new_boundaries[0].push_back(b[element_order[4]][nl]);
-            new_boundaries[0].push_back(b[element_order[3]][nl]);
-            new_boundaries[0].push_back(0);
-
-            // Option 2
-            new_elements[1].push_back(constrained_edges[0]);
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(constrained_edges[8]);
-            new_elements[1].push_back(nl);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(b[element_order[4]][nk]);
-            new_boundaries[1].push_back(b[element_order[0]][nk]);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(constrained_edges[6]);
-            new_elements[1].push_back(constrained_edges[8]);
-            new_elements[1].push_back(nl);
-            new_boundaries[1].push_back(b[element_order[3]][nk]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(constrained_edges[4]);
-            new_elements[1].push_back(constrained_edges[6]);
-            new_elements[1].push_back(nl);
-            new_boundaries[1].push_back(b[element_order[2]][nk]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(b[element_order[1]][nk]);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[0]);
-            new_elements[1].push_back(constrained_edges[8]);
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(nk);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(b[element_order[0]][nl]);
-            new_boundaries[1].push_back(b[element_order[4]][nl]);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(constrained_edges[8]);
-            new_elements[1].push_back(constrained_edges[6]);
-            new_elements[1].push_back(nk);
-            new_boundaries[1].push_back(b[element_order[3]][nl]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(0);
-
-            new_elements[1].push_back(constrained_edges[2]);
-            new_elements[1].push_back(constrained_edges[6]);
-            new_elements[1].push_back(constrained_edges[4]);
-            new_elements[1].push_back(nk);
-            new_boundaries[1].push_back(b[element_order[2]][nl]);
-            new_boundaries[1].push_back(b[element_order[1]][nl]);
-            new_boundaries[1].push_back(0);
-            new_boundaries[1].push_back(0);
-
-            // Option 3
-            new_elements[2].push_back(constrained_edges[4]);
-            new_elements[2].push_back(constrained_edges[0]);
-            new_elements[2].push_back(constrained_edges[2]);
-            new_elements[2].push_back(nl);
-            new_boundaries[2].push_back(b[element_order[0]][nk]);
-            new_boundaries[2].push_back(b[element_order[1]][nk]);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(0);
-
-            new_elements[2].push_back(constrained_edges[4]);
-            new_elements[2].push_back(constrained_edges[8]);
-            new_elements[2].push_back(constrained_edges[0]);
-            new_elements[2].push_back(nl);
-            new_boundaries[2].push_back(b[element_order[4]][nk]);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(0);
-
-            new_elements[2].push_back(constrained_edges[4]);
-            new_elements[2].push_back(constrained_edges[6]);
-            new_elements[2].push_back(constrained_edges[8]);
-            new_elements[2].push_back(nl);
-            new_boundaries[2].push_back(b[element_order[3]][nk]);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(b[element_order[2]][nk]);
-            new_boundaries[2].push_back(0);
-
-            new_elements[2].push_back(constrained_edges[4]);
-            new_elements[2].push_back(constrained_edges[2]);
-            new_elements[2].push_back(constrained_edges[0]);
-            new_elements[2].push_back(nk);
-            new_boundaries[2].push_back(b[element_order[0]][nl]);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(b[element_order[1]][nl]);
-            new_boundaries[2].push_back(0);
-
-            new_elements[2].push_back(constrained_edges[4]);
-            new_elements[2].push_back(constrained_edges[0]);
-            new_elements[2].push_back(constrained_edges[8]);
-            new_elements[2].push_back(nk);
-            new_boundaries[2].push_back(b[element_order[4]][nl]);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(0);
-
-            new_elements[2].push_back(constrained_edges[4]);
-            new_elements[2].push_back(constrained_edges[8]);
-            new_elements[2].push_back(constrained_edges[6]);
-            new_elements[2].push_back(nk);
-            new_boundaries[2].push_back(b[element_order[3]][nl]);
-            new_boundaries[2].push_back(b[element_order[2]][nl]);
-            new_boundaries[2].push_back(0);
-            new_boundaries[2].push_back(0);
-
-            // Option 4
-            new_elements[3].push_back(constrained_edges[6]);
-            new_elements[3].push_back(constrained_edges[2]);
-            new_elements[3].push_back(constrained_edges[4]);
-            new_elements[3].push_back(nl);
-            new_boundaries[3].push_back(b[element_order[1]][nk]);
-            new_boundaries[3].push_back(b[element_order[2]][nk]);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(0);
-
-            new_elements[3].push_back(constrained_edges[6]);
-            new_elements[3].push_back(constrained_edges[0]);
-            new_elements[3].push_back(constrained_edges[2]);
-            new_elements[3].push_back(nl);
-            new_boundaries[3].push_back(b[element_order[0]][nk]);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(0);
-
-            new_elements[3].push_back(constrained_edges[6]);
-            new_elements[3].push_back(constrained_edges[8]);
-            new_elements[3].push_back(constrained_edges[0]);
-            new_elements[3].push_back(nl);
-            new_boundaries[3].push_back(b[element_order[4]][nk]);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(b[element_order[3]][nk]);
-            new_boundaries[3].push_back(0);
-
-            new_elements[3].push_back(constrained_edges[6]);
-            new_elements[3].push_back(constrained_edges[4]);
-            new_elements[3].push_back(constrained_edges[2]);
-            new_elements[3].push_back(nk);
-            new_boundaries[3].push_back(b[element_order[1]][nl]);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(b[element_order[2]][nl]);
-            new_boundaries[3].push_back(0);
-
-            new_elements[3].push_back(constrained_edges[6]);
-            new_elements[3].push_back(constrained_edges[2]);
-            new_elements[3].push_back(constrained_edges[0]);
-            new_elements[3].push_back(nk);
-            new_boundaries[3].push_back(b[element_order[0]][nl]);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(0);
-
-            new_elements[3].push_back(constrained_edges[6]);
-            new_elements[3].push_back(constrained_edges[0]);
-            new_elements[3].push_back(constrained_edges[8]);
-            new_elements[3].push_back(nk);
-            new_boundaries[3].push_back(b[element_order[4]][nl]);
-            new_boundaries[3].push_back(b[element_order[3]][nl]);
-            new_boundaries[3].push_back(0);
-            new_boundaries[3].push_back(0);
-
-            // Option 5
-            new_elements[4].push_back(constrained_edges[8]);
-            new_elements[4].push_back(constrained_edges[0]);
-            new_elements[4].push_back(constrained_edges[2]);
-            new_elements[4].push_back(nl);
-            new_boundaries[4].push_back(b[element_order[0]][nk]);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(b[element_order[4]][nk]);
-            new_boundaries[4].push_back(0);
-
-            new_elements[4].push_back(constrained_edges[8]);
-            new_elements[4].push_back(constrained_edges[2]);
-            new_elements[4].push_back(constrained_edges[4]);
-            new_elements[4].push_back(nl);
-            new_boundaries[4].push_back(b[element_order[1]][nk]);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(0);
-
-            new_elements[4].push_back(constrained_edges[8]);
-            new_elements[4].push_back(constrained_edges[4]);
-            new_elements[4].push_back(constrained_edges[6]);
-            new_elements[4].push_back(nl);
-            new_boundaries[4].push_back(b[element_order[2]][nk]);
-            new_boundaries[4].push_back(b[element_order[3]][nk]);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(0);
-
-            new_elements[4].push_back(constrained_edges[8]);
-            new_elements[4].push_back(constrained_edges[2]);
-            new_elements[4].push_back(constrained_edges[0]);
-            new_elements[4].push_back(nk);
-            new_boundaries[4].push_back(b[element_order[0]][nl]);
-            new_boundaries[4].push_back(b[element_order[4]][nl]);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(0);
-
-            new_elements[4].push_back(constrained_edges[8]);
-            new_elements[4].push_back(constrained_edges[4]);
-            new_elements[4].push_back(constrained_edges[2]);
-            new_elements[4].push_back(nk);
-            new_boundaries[4].push_back(b[element_order[1]][nl]);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(0);
-
-            new_elements[4].push_back(constrained_edges[8]);
-            new_elements[4].push_back(constrained_edges[6]);
-            new_elements[4].push_back(constrained_edges[4]);
-            new_elements[4].push_back(nk);
-            new_boundaries[4].push_back(b[element_order[2]][nl]);
-            new_boundaries[4].push_back(0);
-            new_boundaries[4].push_back(b[element_order[3]][nl]);
-            new_boundaries[4].push_back(0);
+            templates = &swap4to4[0][0][0];
+            noptions = 2;
+            new_nelements = 4;
         } else {
-            return false;
+            // This is the 5-element to 6-element swap.
+            templates = &swap5to6[0][0][0];
+            noptions = 5;
+            new_nelements = 6;
         }
-        nelements = new_elements[0].size()/4;
 
         // Check new minimum quality.
-        std::vector<double> new_min_quality(new_elements.size());
-        std::vector< std::vector<double> > newq(new_elements.size());
+        index_t new_elements[5][6*4];
+        int new_boundaries[5][6*4];
+        double newq[5][6];
+        double new_min_quality[5];
 
-        for(size_t option=0; option<new_elements.size(); option++) {
-            newq[option].resize(nelements);
+        for(size_t option=0; option<noptions; option++) {
             double new_vol = 0.0;
-            for(size_t j=0; j<nelements; j++) {
-                const index_t* n = &new_elements[option][j*4];
+            for(size_t j=0; j<new_nelements; j++) {
+                const int *t = templates + (option*new_nelements+j)*6;
+                index_t *n = &new_elements[option][j*4];
+                int *bn = &new_boundaries[option][j*4];
+
+                bool nl_cap = (j<new_nelements/2);
+                for(int k=0; k<3; k++) {
+                    n[k] = ring[t[k]];
+                    if(t[3+k]<0)
+                        bn[k] = 0;
+                    else
+                        bn[k] = nl_cap ? bk[t[3+k]] : bl[t[3+k]];
+                }
+                n[3] = nl_cap ? nl : nk;
+                bn[3] = 0;
+
                 double vol = property->volume(_mesh->get_coords(n[0]), _mesh->get_coords(n[1]),
                                               _mesh->get_coords(n[2]), _mesh->get_coords(n[3]));
 
                 if(vol<0) {
                     vol*=-1;
-                    std::swap(new_elements[option][j*4], new_elements[option][j*4+1]);
-                    std::swap(new_boundaries[option][j*4], new_boundaries[option][j*4+1]);
+                    std::swap(n[0], n[1]);
+                    std::swap(bn[0], bn[1]);
                 }
 
                 new_vol += vol;
@@ -1161,13 +862,13 @@ private:
                 new_min_quality[option] = -1;
             } else {
                 new_min_quality[option] = newq[option][0];
-                for(size_t j=0; j<nelements; j++)
+                for(size_t j=0; j<new_nelements; j++)
                     new_min_quality[option] = std::min(newq[option][j], new_min_quality[option]);
             }
         }
 
         int best_option=0;
-        for(size_t option=1; option<new_elements.size(); option++) {
+        for(size_t option=1; option<noptions; option++) {
             if(new_min_quality[option]>new_min_quality[best_option]) {
                 best_option = option;
             }
@@ -1185,17 +886,17 @@ private:
         _mesh->NNList[nl].erase(vit);
 
         // Remove old elements.
-        for(auto& it : neigh_elements)
-            _mesh->erase_element(it);
+        for(size_t e=0; e<nelements; e++)
+            _mesh->erase_element(shell[e]);
 
         // Add new elements and mark edges for propagation.
         // First, recycle element IDs.
-        std::deque<index_t> new_eids;
-        for(auto& ele : neigh_elements)
-            new_eids.push_back(ele);
+        index_t new_eids[6];
+        for(size_t e=0; e<nelements; e++)
+            new_eids[e] = shell[e];
 
         // Next, find how many new elements we have to allocate
-        int extra_elements = nelements - neigh_elements.size();
+        int extra_elements = new_nelements - nelements;
         if(extra_elements > 0) {
             index_t new_eid;
             #pragma omp atomic capture
@@ -1215,12 +916,11 @@ private:
             }
 
             for(int i=0; i<extra_elements; ++i)
-                new_eids.push_back(new_eid++);
+                new_eids[nelements+i] = new_eid++;
         }
 
-        for(size_t j=0; j<nelements; j++) {
-            index_t eid = new_eids[0];
-            new_eids.pop_front();
+        for(size_t j=0; j<new_nelements; j++) {
+            index_t eid = new_eids[j];
             for(size_t i=0; i<nloc; i++) {
                 _mesh->_ENList[eid*nloc+i]=new_elements[best_option][j*4+i];
                 _mesh->boundary[eid*nloc+i]=new_boundaries[best_option][j*4+i];
@@ -1258,6 +958,9 @@ private:
     static const size_t nloc=dim+1;
     static const size_t msize=(dim==2?3:6);
 
+    // Largest edge shell that swap_kernel3d knows how to reconnect.
+    static const size_t max_shell3d=5;
+
     std::vector< std::set<index_t> > marked_edges;
     real_t min_Q;
 };
@@ -67,6 +67,10 @@
 typedef float vtkFloatingPointType;
 #endif
 
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
 #include <vector>
 #include <string>
 #include <cfloat>
@@ -102,6 +106,12 @@ public:
         vtkSmartPointer<vtkUnstructuredGrid> ug = vtkSmartPointer<vtkUnstructuredGrid>::New();
 
         if(filename.substr(filename.find_last_of('.'))==".pvtu") {
+#ifdef HAVE_MPI
+            // Each process reads its own pieces if the partitioning allows it.
+            Mesh<real_t> *mesh = import_pvtu_pieces(filename);
+            if(mesh!=NULL)
+                return mesh;
+#endif
             vtkSmartPointer<vtkXMLPUnstructuredGridReader> reader = vtkSmartPointer<vtkXMLPUnstructuredGridReader>::New();
             reader->SetFileName(filename.c_str());
             reader->Update();
@@ -396,6 +406,309 @@ public:
         return mesh;
     }
 
+#ifdef HAVE_MPI
+    /*! Distributed import of a .pvtu file. The pieces are assigned to
+     * the processes in contiguous blocks and each process only reads its
+     * own pieces. Pieces are stitched together through the GlobalId
+     * point array, so no process ever holds the global mesh. Returns NULL,
+     * on all processes, if there are fewer pieces than processes, the
+     * pieces have no GlobalIds or a process would be left without
+     * elements, in which case the caller should fall back to a serial
+     * read.
+     */
+    static Mesh<real_t>* import_pvtu_pieces(std::string filename)
+    {
+        int rank, nparts;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &nparts);
+
+        if(nparts==1)
+            return NULL;
+
+        // Find the piece files listed in the .pvtu file.
+        std::vector<std::string> pieces;
+        {
+            std::ifstream pvtu(filename.c_str());
+            std::stringstream buffer;
+            buffer<<pvtu.rdbuf();
+            std::string xml = buffer.str();
+
+            std::string dir;
+            size_t slash = filename.find_last_of('/');
+            if(slash!=std::string::npos)
+                dir = filename.substr(0, slash+1);
+
+            for(size_t pos=xml.find("<Piece"); pos!=std::string::npos; pos=xml.find("<Piece", pos+1)) {
+                size_t begin = xml.find("Source=\"", pos);
+                if(begin==std::string::npos)
+                    break;
+                begin += 8;
+                size_t end = xml.find('"', begin);
+                pieces.push_back(dir+xml.substr(begin, end-begin));
+            }
+        }
+
+        int npieces = pieces.size();
+        if(npieces<nparts)
+            return NULL;
+
+        // Read this process' pieces, merging points by their GlobalId.
+        int nloc=0, ndims=0, valid=1;
+        std::vector<index_t> ENList;
+        std::map<index_t, index_t> gnn2lnn;
+        std::vector<index_t> gnns;
+        std::vector<real_t> coords;
+        for(int p=(npieces*rank)/nparts; p<(npieces*(rank+1))/nparts; p++) {
+            vtkSmartPointer<vtkXMLUnstructuredGridReader> reader = vtkSmartPointer<vtkXMLUnstructuredGridReader>::New();
+            reader->SetFileName(pieces[p].c_str());
+            reader->Update();
+            vtkUnstructuredGrid *ug = reader->GetOutput();
+
+            vtkDataArray *gid = ug->GetPointData()->GetArray("GlobalId");
+            if(gid==NULL || ug->GetNumberOfCells()==0) {
+                valid = 0;
+                break;
+            }
+
+            int cell_type = ug->GetCell(0)->GetCellType();
+            nloc = (cell_type==VTK_TRIANGLE)?3:4;
+            ndims = nloc-1;
+
+            // Older writers mark ghost cells with a ghost level, newer
+            // ones with the DUPLICATECELL bit (1) of vtkGhostType.
+            vtkDataArray *ghost_levels = ug->GetCellData()->GetArray("vtkGhostLevels");
+            vtkDataArray *ghost_type = ug->GetCellData()->GetArray("vtkGhostType");
+            index_t NCells = ug->GetNumberOfCells();
+            for(index_t i=0; i<NCells; i++) {
+                if(ghost_levels!=NULL && ghost_levels->GetTuple1(i)>0)
+                    continue;
+                if(ghost_type!=NULL && ((int)ghost_type->GetTuple1(i) & 1))
+                    continue;
+
+                vtkCell *cell = ug->GetCell(i);
+                for(int j=0; j<nloc; j++) {
+                    vtkIdType pid = cell->GetPointId(j);
+                    index_t gnn = gid->GetTuple1(pid);
+                    if(gnn2lnn.find(gnn)==gnn2lnn.end()) {
+                        gnn2lnn[gnn] = gnns.size();
+                        gnns.push_back(gnn);
+
+                        real_t r[3];
+                        ug->GetPoints()->GetPoint(pid, r);
+                        coords.insert(coords.end(), r, r+ndims);
+                    }
+                    ENList.push_back(gnn);
+                }
+            }
+        }
+
+        MPI_Allreduce(MPI_IN_PLACE, &valid, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if(!valid)
+            return NULL;
+        MPI_Allreduce(MPI_IN_PLACE, &ndims, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+        return distribute_pieces(ndims, ENList, gnns, coords, MPI_COMM_WORLD);
+    }
+
+    /*! Create a distributed mesh from arbitrary pieces of a global mesh.
+     * @param ndims number of dimensions.
+     * @param ENList elements of this process' pieces in global vertex ids.
+     * @param gnns global ids of the vertices of this process' pieces.
+     * @param coords coordinates of these vertices.
+     * @param comm MPI communicator.
+     *
+     * A vertex is owned by the lowest ranked process whose pieces
+     * reference it, determined through a directory in which global id g
+     * lives on process g%nparts. Elements are then sent to the owners of
+     * their vertices so that every process holds all the elements
+     * adjacent to its vertices, and owned vertices are renumbered
+     * contiguously by process. Returns NULL, on all processes, if a
+     * process would be left without elements.
+     */
+    static Mesh<real_t>* distribute_pieces(int ndims, const std::vector<index_t> &ENList,
+                                           const std::vector<index_t> &gnns, const std::vector<real_t> &coords,
+                                           MPI_Comm comm)
+    {
+        int rank, nparts;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &nparts);
+
+        int nloc = ndims+1;
+
+        // Vertex table: global id -> (owner, coordinates).
+        std::map<index_t, int> owner;
+        std::map<index_t, std::vector<real_t> > vertex_coords;
+        for(size_t i=0; i<gnns.size(); i++)
+            vertex_coords[gnns[i]] = std::vector<real_t>(&(coords[i*ndims]), &(coords[i*ndims])+ndims);
+
+        // Ask the directory for the owner of every referenced vertex.
+        std::vector< std::vector<index_t> > request(nparts), reply;
+        {
+            std::vector<index_t> referenced(ENList);
+            std::sort(referenced.begin(), referenced.end());
+            referenced.erase(std::unique(referenced.begin(), referenced.end()), referenced.end());
+            for(size_t i=0; i<referenced.size(); i++)
+                request[referenced[i]%nparts].push_back(referenced[i]);
+        }
+        exchange(request, reply, comm);
+
+        std::map<index_t, int> directory;
+        for(int p=0; p<nparts; p++) {
+            for(size_t i=0; i<reply[p].size(); i++) {
+                std::map<index_t, int>::iterator it = directory.find(reply[p][i]);
+                if(it==directory.end())
+                    directory[reply[p][i]] = p;
+                else
+                    it->second = std::min(it->second, p);
+            }
+        }
+        for(int p=0; p<nparts; p++) {
+            for(size_t i=0; i<reply[p].size(); i++)
+                reply[p][i] = directory[reply[p][i]];
+        }
+        std::vector< std::vector<index_t> > owners;
+        exchange(reply, owners, comm);
+        for(int p=0; p<nparts; p++) {
+            for(size_t i=0; i<request[p].size(); i++)
+                owner[request[p][i]] = owners[p][i];
+        }
+
+        // Send each element, with its vertices' owners and coordinates, to
+        // the other owners of its vertices.
+        std::vector< std::vector<index_t> > send_elements(nparts), recv_elements;
+        std::vector< std::vector<real_t> > send_coords(nparts), recv_coords;
+        size_t NElements = ENList.size()/nloc;
+        for(size_t e=0; e<NElements; e++) {
+            const index_t *n = &(ENList[e*nloc]);
+            std::set<int> destinations;
+            for(int j=0; j<nloc; j++)
+                destinations.insert(owner[n[j]]);
+            destinations.erase(rank);
+
+            for(std::set<int>::const_iterator p=destinations.begin(); p!=destinations.end(); ++p) {
+                for(int j=0; j<nloc; j++) {
+                    send_elements[*p].push_back(n[j]);
+                    send_elements[*p].push_back(owner[n[j]]);
+                    const std::vector<real_t> &x = vertex_coords[n[j]];
+                    send_coords[*p].insert(send_coords[*p].end(), x.begin(), x.end());
+                }
+            }
+        }
+        exchange(send_elements, recv_elements, comm);
+        exchange(send_coords, recv_coords, comm);
+
+        std::vector<index_t> all_elements(ENList);
+        for(int p=0; p<nparts; p++) {
+            for(size_t i=0; i<recv_elements[p].size()/2; i++) {
+                index_t gnn = recv_elements[p][2*i];
+                all_elements.push_back(gnn);
+                if(owner.find(gnn)==owner.end()) {
+                    owner[gnn] = recv_elements[p][2*i+1];
+                    vertex_coords[gnn] = std::vector<real_t>(&(recv_coords[p][i*ndims]), &(recv_coords[p][i*ndims])+ndims);
+                }
+            }
+        }
+
+        // Keep the elements with at least one owned vertex.
+        std::vector<index_t> local_elements;
+        std::set<index_t> owned_nodes, halo_nodes;
+        for(size_t e=0; e<all_elements.size()/nloc; e++) {
+            const index_t *n = &(all_elements[e*nloc]);
+            bool local = false;
+            for(int j=0; j<nloc; j++)
+                local = local || owner[n[j]]==rank;
+            if(!local)
+                continue;
+
+            for(int j=0; j<nloc; j++) {
+                local_elements.push_back(n[j]);
+                if(owner[n[j]]==rank)
+                    owned_nodes.insert(n[j]);
+                else
+                    halo_nodes.insert(n[j]);
+            }
+        }
+
+        // A process that owns none of the vertices of its pieces is left
+        // without elements, and a mesh cannot be created without them.
+        int empty = local_elements.empty()?1:0;
+        MPI_Allreduce(MPI_IN_PLACE, &empty, 1, MPI_INT, MPI_MAX, comm);
+        if(empty)
+            return NULL;
+
+        // Contiguous renumbering of the owned vertices.
+        std::vector<index_t> owner_range(nparts+1, 0);
+        index_t NOwned = owned_nodes.size();
+        mpi_type_wrapper<index_t> mpi_index_t_wrapper;
+        MPI_Datatype MPI_INDEX_T = mpi_index_t_wrapper.mpi_type;
+        MPI_Allgather(&NOwned, 1, MPI_INDEX_T, &(owner_range[1]), 1, MPI_INDEX_T, comm);
+        for(int p=0; p<nparts; p++)
+            owner_range[p+1] += owner_range[p];
+
+        std::map<index_t, index_t> renumber;
+        {
+            index_t pos = owner_range[rank];
+            for(std::set<index_t>::const_iterator it=owned_nodes.begin(); it!=owned_nodes.end(); ++it)
+                renumber[*it] = pos++;
+        }
+
+        // Register the new numbers with the directory and look up those of the halo.
+        std::vector< std::vector<index_t> > send_numbers(nparts), recv_numbers;
+        for(std::set<index_t>::const_iterator it=owned_nodes.begin(); it!=owned_nodes.end(); ++it) {
+            send_numbers[*it%nparts].push_back(*it);
+            send_numbers[*it%nparts].push_back(renumber[*it]);
+        }
+        exchange(send_numbers, recv_numbers, comm);
+        directory.clear();
+        for(int p=0; p<nparts; p++) {
+            for(size_t i=0; i<recv_numbers[p].size()/2; i++)
+                directory[recv_numbers[p][2*i]] = recv_numbers[p][2*i+1];
+        }
+
+        for(int p=0; p<nparts; p++)
+            request[p].clear();
+        for(std::set<index_t>::const_iterator it=halo_nodes.begin(); it!=halo_nodes.end(); ++it)
+            request[*it%nparts].push_back(*it);
+        exchange(request, reply, comm);
+        for(int p=0; p<nparts; p++) {
+            for(size_t i=0; i<reply[p].size(); i++)
+                reply[p][i] = directory[reply[p][i]];
+        }
+        std::vector< std::vector<index_t> > halo_numbers;
+        exchange(reply, halo_numbers, comm);
+        for(int p=0; p<nparts; p++) {
+            for(size_t i=0; i<request[p].size(); i++)
+                renumber[request[p][i]] = halo_numbers[p][i];
+        }
+
+        // Owned vertices first, followed by the halo.
+        std::vector<index_t> lnn2gnn;
+        std::vector<real_t> x, y, z;
+        std::set<index_t>::const_iterator sets[] = {owned_nodes.begin(), halo_nodes.begin()};
+        std::set<index_t>::const_iterator ends[] = {owned_nodes.end(), halo_nodes.end()};
+        for(int k=0; k<2; k++) {
+            for(std::set<index_t>::const_iterator it=sets[k]; it!=ends[k]; ++it) {
+                lnn2gnn.push_back(renumber[*it]);
+                const std::vector<real_t> &r = vertex_coords[*it];
+                x.push_back(r[0]);
+                y.push_back(r[1]);
+                if(ndims==3)
+                    z.push_back(r[2]);
+            }
+        }
+
+        for(size_t i=0; i<local_elements.size(); i++)
+            local_elements[i] = renumber[local_elements[i]];
+
+        index_t NNodes = lnn2gnn.size();
+        NElements = local_elements.size()/nloc;
+        if(ndims==2)
+            return new Mesh<real_t>(NNodes, NElements, &(local_elements[0]), &(x[0]), &(y[0]), &(lnn2gnn[0]), &(owner_range[0]), comm);
+        else
+            return new Mesh<real_t>(NNodes, NElements, &(local_elements[0]), &(x[0]), &(y[0]), &(z[0]), &(lnn2gnn[0]), &(owner_range[0]), comm);
+    }
+#endif
+
     static void export_vtu(const char *basename, const Mesh<real_t> *mesh, const real_t *psi=NULL)
     {
         index_t NElements = mesh->get_number_elements();
@@ -678,5 +991,36 @@ public:
         return;
     }
 
+private:
+#ifdef HAVE_MPI
+    /// Personalised all-to-all exchange of variable length messages.
+    template<typename T>
+    static void exchange(const std::vector< std::vector<T> > &send, std::vector< std::vector<T> > &recv, MPI_Comm comm)
+    {
+        int nparts = send.size();
+        mpi_type_wrapper<T> wrapper;
+
+        std::vector<int> send_cnt(nparts), recv_cnt(nparts), send_displ(nparts+1, 0), recv_displ(nparts+1, 0);
+        for(int p=0; p<nparts; p++)
+            send_cnt[p] = send[p].size();
+        MPI_Alltoall(&(send_cnt[0]), 1, MPI_INT, &(recv_cnt[0]), 1, MPI_INT, comm);
+
+        for(int p=0; p<nparts; p++) {
+            send_displ[p+1] = send_displ[p]+send_cnt[p];
+            recv_displ[p+1] = recv_displ[p]+recv_cnt[p];
+        }
+
+        std::vector<T> send_buffer(send_displ[nparts]+1), recv_buffer(recv_displ[nparts]+1);
+        for(int p=0; p<nparts; p++)
+            std::copy(send[p].begin(), send[p].end(), send_buffer.begin()+send_displ[p]);
+
+        MPI_Alltoallv(&(send_buffer[0]), &(send_cnt[0]), &(send_displ[0]), wrapper.mpi_type,
+                      &(recv_buffer[0]), &(recv_cnt[0]), &(recv_displ[0]), wrapper.mpi_type, comm);
+
+        recv.resize(nparts);
+        for(int p=0; p<nparts; p++)
+            recv[p].assign(recv_buffer.begin()+recv_displ[p], recv_buffer.begin()+recv_displ[p+1]);
+    }
+#endif
 };
 #endif
@@ -0,0 +1,488 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#ifndef VTUWRITER_H
+#define VTUWRITER_H
+
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#include "Mesh.h"
+#include "MetricTensor.h"
+#include "ElementProperty.h"
+
+/*! \brief Standalone writer for VTK XML unstructured grid files.
+ *
+ * Writes the same point and cell data as VTKTools::export_vtu without
+ * depending on VTK. Arrays are stored as appended raw binary with
+ * UInt64 headers. If Pragmatic is built with zlib, arrays can be
+ * compressed with vtkZLibDataCompressor's block layout. Fields are
+ * computed in parallel and every array is split into independent
+ * blocks that are compressed in parallel. When run with more than one
+ * MPI process each process writes basename_<rank>.vtu and rank 0 writes
+ * basename.pvtu. Computing the arrays (take_snapshot) and encoding and
+ * writing them (write) are separate steps so that the latter can be
+ * done in the background, see AsyncExporter.
+ */
+template<typename real_t> class VTUWriter
+{
+public:
+
+    struct data_array {
+        std::string name, type;
+        int ncomponents;
+        std::vector<char> data;
+    };
+
+    /// Arrays of one piece, computed from the mesh but not yet encoded.
+    struct snapshot {
+        std::string basename;
+        int rank, nparts;
+        int NNodes, NElements;
+        bool compress;
+        std::vector<data_array> point_data, cell_data, points, cells;
+    };
+
+    /*! Write the mesh.
+     * @param basename name of the output without extension.
+     * @param mesh mesh to be written.
+     * @param psi optional vertex field, written as "psi".
+     * @param compress compress arrays with zlib, if available.
+     */
+    static void export_vtu(const char *basename, const Mesh<real_t> *mesh, const real_t *psi=NULL, bool compress=false)
+    {
+        snapshot piece;
+        take_snapshot(basename, mesh, psi, compress, piece);
+        write(piece);
+    }
+
+    /*! Compute the output arrays of the mesh. The snapshot does not
+     * reference the mesh, so the mesh can be modified while it is
+     * being written.
+     * @param basename name of the output without extension.
+     * @param mesh mesh to be written.
+     * @param psi optional vertex field, written as "psi".
+     * @param compress compress arrays with zlib, if available.
+     * @param piece snapshot to be filled.
+     */
+    static void take_snapshot(const char *basename, const Mesh<real_t> *mesh, const real_t *psi, bool compress, snapshot &piece)
+    {
+#ifndef HAVE_ZLIB
+        compress = false;
+#endif
+
+        int rank=0, nparts=1;
+#ifdef HAVE_MPI
+        MPI_Comm_rank(mesh->get_mpi_comm(), &rank);
+        MPI_Comm_size(mesh->get_mpi_comm(), &nparts);
+#endif
+
+        int NNodes = mesh->get_number_nodes();
+        int NElements = mesh->get_number_elements();
+        int ndims = mesh->get_number_dimensions();
+        int nloc = ndims+1;
+
+        piece.basename = basename;
+        piece.rank = rank;
+        piece.nparts = nparts;
+        piece.NNodes = NNodes;
+        piece.NElements = NElements;
+        piece.compress = compress;
+
+        std::vector<data_array> &point_data=piece.point_data, &cell_data=piece.cell_data,
+                                &points=piece.points, &cells=piece.cells;
+        point_data.clear();
+        cell_data.clear();
+        points.clear();
+        cells.clear();
+
+        // Point data.
+        if(psi!=NULL) {
+            std::vector<double> values(psi, psi+NNodes);
+            add_array(point_data, "psi", "Float64", 1, values);
+        }
+
+        std::vector<int> nid(NNodes), boundary_nodes(NNodes, 0);
+        std::vector<double> metric(NNodes*ndims*ndims), xyz(NNodes*3), edge_length(NNodes),
+            max_desired_length(NNodes), min_desired_length(NNodes);
+        std::vector<int64_t> gnn(nparts>1?NNodes:0);
+        #pragma omp parallel for schedule(static)
+        for(int i=0; i<NNodes; i++) {
+            const real_t *r = mesh->get_coords(i);
+            const double *m = mesh->get_metric(i);
+
+            nid[i] = i;
+            if(nparts>1)
+                gnn[i] = mesh->lnn2gnn[i];
+
+            double maxL, minL;
+            if(ndims==2) {
+                xyz[i*3] = r[0];
+                xyz[i*3+1] = r[1];
+                xyz[i*3+2] = 0.0;
+
+                double M[] = {m[0], m[1],
+                              m[1], m[2]
+                             };
+                std::copy(M, M+4, &(metric[i*4]));
+
+                MetricTensor<double,2> tensor(m, false);
+                maxL = tensor.max_length();
+                minL = tensor.min_length();
+            } else {
+                xyz[i*3] = r[0];
+                xyz[i*3+1] = r[1];
+                xyz[i*3+2] = r[2];
+
+                double M[] = {m[0], m[1], m[2],
+                              m[1], m[3], m[4],
+                              m[2], m[4], m[5]
+                             };
+                std::copy(M, M+9, &(metric[i*9]));
+
+                MetricTensor<double,3> tensor(m, false);
+                maxL = tensor.max_length();
+                minL = tensor.min_length();
+            }
+
+            int nedges = mesh->NNList[i].size();
+            double mean_edge_length=0;
+            double max_desired_edge_length=0;
+            double min_desired_edge_length=DBL_MAX;
+            for(typename std::vector<index_t>::const_iterator it=mesh->NNList[i].begin(); it!=mesh->NNList[i].end(); ++it) {
+                mean_edge_length += mesh->calc_edge_length(i, *it);
+                max_desired_edge_length = std::max(max_desired_edge_length, maxL);
+                min_desired_edge_length = std::min(min_desired_edge_length, minL);
+            }
+            edge_length[i] = mean_edge_length/nedges;
+            max_desired_length[i] = max_desired_edge_length;
+            min_desired_length[i] = min_desired_edge_length;
+
+            // A vertex takes the largest label of the boundary facets it is part of.
+            if(!mesh->boundary.empty()) {
+                for(typename std::set<index_t>::const_iterator it=mesh->NEList[i].begin(); it!=mesh->NEList[i].end(); ++it) {
+                    const index_t *n = mesh->get_element(*it);
+                    for(int j=0; j<nloc; j++) {
+                        if(n[j]!=i)
+                            boundary_nodes[i] = std::max(boundary_nodes[i], mesh->boundary[(*it)*nloc+j]);
+                    }
+                }
+            }
+        }
+
+        add_array(point_data, "nid", "Int32", 1, nid);
+        add_array(point_data, "Metric", "Float64", ndims*ndims, metric);
+        add_array(point_data, "mean_edge_length", "Float64", 1, edge_length);
+        add_array(point_data, "max_desired_edge_length", "Float64", 1, max_desired_length);
+        add_array(point_data, "min_desired_edge_length", "Float64", 1, min_desired_length);
+        add_array(point_data, "BoundaryNodes", "Int32", 1, boundary_nodes);
+        if(nparts>1)
+            add_array(point_data, "GlobalId", "Int64", 1, gnn);
+
+        add_array(points, "Points", "Float64", 3, xyz);
+
+        // Cell data.
+        ElementProperty<real_t> *property = NULL;
+        if(NElements>0) {
+            const index_t *n = mesh->get_element(0);
+            if(ndims==2)
+                property = new ElementProperty<real_t>(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]));
+            else
+                property = new ElementProperty<real_t>(mesh->get_coords(n[0]), mesh->get_coords(n[1]),
+                                                       mesh->get_coords(n[2]), mesh->get_coords(n[3]));
+        }
+
+        std::vector<int> eid(NElements), boundary(NElements*nloc, 0);
+        std::vector<double> quality(NElements);
+        std::vector<unsigned char> ghost(nparts>1?NElements:0), types(NElements, ndims==2?5:10);
+        std::vector<int64_t> connectivity(NElements*nloc), offsets(NElements);
+        #pragma omp parallel for schedule(static)
+        for(int i=0; i<NElements; i++) {
+            const index_t *n = mesh->get_element(i);
+            assert(n[0]>=0);
+
+            eid[i] = i;
+            if(ndims==2)
+                quality[i] = property->lipnikov(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]),
+                                                mesh->get_metric(n[0]), mesh->get_metric(n[1]), mesh->get_metric(n[2]));
+            else
+                quality[i] = property->lipnikov(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2]), mesh->get_coords(n[3]),
+                                                mesh->get_metric(n[0]), mesh->get_metric(n[1]), mesh->get_metric(n[2]), mesh->get_metric(n[3]));
+
+            int owner = rank;
+            for(int j=0; j<nloc; j++) {
+                connectivity[i*nloc+j] = n[j];
+                if(!mesh->boundary.empty())
+                    boundary[i*nloc+j] = mesh->boundary[i*nloc+j];
+                if(nparts>1)
+                    owner = std::min(owner, mesh->node_owner[n[j]]);
+            }
+            offsets[i] = (i+1)*nloc;
+            if(nparts>1)
+                ghost[i] = owner==rank?0:1;
+        }
+        delete property;
+
+        add_array(cell_data, "eid", "Int32", 1, eid);
+        add_array(cell_data, "quality", "Float64", 1, quality);
+        add_array(cell_data, "Boundary", "Int32", nloc, boundary);
+        if(nparts>1)
+            add_array(cell_data, "vtkGhostLevels", "UInt8", 1, ghost);
+
+        add_array(cells, "connectivity", "Int64", 1, connectivity);
+        add_array(cells, "offsets", "Int64", 1, offsets);
+        add_array(cells, "types", "UInt8", 1, types);
+    }
+
+    /*! Encode the arrays of a snapshot and write them. Makes no MPI
+     * calls, so it can run on a thread other than the one that took
+     * the snapshot. The arrays are compressed in place.
+     * @param piece snapshot to be written.
+     */
+    static void write(snapshot &piece)
+    {
+        const char *basename = piece.basename.c_str();
+        int rank = piece.rank, nparts = piece.nparts;
+        bool compress = piece.compress;
+        std::vector<data_array> &point_data=piece.point_data, &cell_data=piece.cell_data,
+                                &points=piece.points, &cells=piece.cells;
+
+        encode(point_data, compress);
+        encode(cell_data, compress);
+        encode(points, compress);
+        encode(cells, compress);
+
+        // Write the piece.
+        std::string filename;
+        if(nparts==1)
+            filename = std::string(basename)+".vtu";
+        else
+            filename = piece_name(basename, rank);
+
+        std::stringstream xml;
+        xml<<"<?xml version=\"1.0\"?>\n"
+           <<"<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\""<<byte_order()<<"\" header_type=\"UInt64\"";
+        if(compress)
+            xml<<" compressor=\"vtkZLibDataCompressor\"";
+        xml<<">\n"
+           <<"  <UnstructuredGrid>\n"
+           <<"    <Piece NumberOfPoints=\""<<piece.NNodes<<"\" NumberOfCells=\""<<piece.NElements<<"\">\n";
+        uint64_t offset = 0;
+        write_header(xml, "PointData", point_data, offset);
+        write_header(xml, "CellData", cell_data, offset);
+        write_header(xml, "Points", points, offset);
+        write_header(xml, "Cells", cells, offset);
+        xml<<"    </Piece>\n"
+           <<"  </UnstructuredGrid>\n"
+           <<"  <AppendedData encoding=\"raw\">\n"
+           <<"   _";
+
+        FILE *file = fopen(filename.c_str(), "wb");
+        if(file==NULL) {
+            fprintf(stderr, "####  ERROR  Cannot write %s\n", filename.c_str());
+            exit(1);
+        }
+        std::string header = xml.str();
+        fwrite(header.data(), 1, header.size(), file);
+        write_data(file, point_data);
+        write_data(file, cell_data);
+        write_data(file, points);
+        write_data(file, cells);
+        fprintf(file, "\n  </AppendedData>\n</VTKFile>\n");
+        fclose(file);
+
+        // Write the parallel index.
+        if(nparts>1 && rank==0) {
+            std::string pfilename = std::string(basename)+".pvtu";
+            file = fopen(pfilename.c_str(), "w");
+            if(file==NULL) {
+                fprintf(stderr, "####  ERROR  Cannot write %s\n", pfilename.c_str());
+                exit(1);
+            }
+
+            std::stringstream pxml;
+            pxml<<"<?xml version=\"1.0\"?>\n"
+                <<"<VTKFile type=\"PUnstructuredGrid\" version=\"1.0\" byte_order=\""<<byte_order()<<"\" header_type=\"UInt64\">\n"
+                <<"  <PUnstructuredGrid GhostLevel=\"1\">\n";
+            write_pheader(pxml, "PPointData", point_data);
+            write_pheader(pxml, "PCellData", cell_data);
+            write_pheader(pxml, "PPoints", points);
+            for(int p=0; p<nparts; p++) {
+                std::string piece = piece_name(basename, p);
+                size_t slash = piece.find_last_of('/');
+                if(slash!=std::string::npos)
+                    piece = piece.substr(slash+1);
+                pxml<<"    <Piece Source=\""<<piece<<"\"/>\n";
+            }
+            pxml<<"  </PUnstructuredGrid>\n"
+                <<"</VTKFile>\n";
+
+            std::string pheader = pxml.str();
+            fwrite(pheader.data(), 1, pheader.size(), file);
+            fclose(file);
+        }
+    }
+
+private:
+
+    // Size of the blocks arrays are split into for compression.
+    static const size_t block_size = 1<<20;
+
+    static const char *byte_order()
+    {
+        const uint16_t one = 1;
+        return *((const char *)&one)==1?"LittleEndian":"BigEndian";
+    }
+
+    static std::string piece_name(const char *basename, int rank)
+    {
+        std::stringstream name;
+        name<<basename<<"_"<<rank<<".vtu";
+        return name.str();
+    }
+
+    /// Store an array with the UInt64 header of the raw encoding.
+    template<typename T>
+    static void add_array(std::vector<data_array> &arrays, const char *name, const char *type, int ncomponents,
+                          const std::vector<T> &values)
+    {
+        arrays.push_back(data_array());
+        data_array &array = arrays.back();
+        array.name = name;
+        array.type = type;
+        array.ncomponents = ncomponents;
+
+        uint64_t nbytes = values.size()*sizeof(T);
+        array.data.resize(sizeof(uint64_t)+nbytes);
+        memcpy(&(array.data[0]), &nbytes, sizeof(uint64_t));
+        if(nbytes>0)
+            memcpy(&(array.data[sizeof(uint64_t)]), values.data(), nbytes);
+    }
+
+    /// Encode arrays as they are stored in the appended section.
+    static void encode(std::vector<data_array> &arrays, bool compress)
+    {
+        if(!compress)
+            return;
+
+#ifdef HAVE_ZLIB
+        for(size_t i=0; i<arrays.size(); i++) {
+            data_array &array = arrays[i];
+            const char *raw = &(array.data[sizeof(uint64_t)]);
+            uint64_t nbytes = array.data.size()-sizeof(uint64_t);
+
+            // Header: number of blocks, block size, size of the last partial
+            // block (0 if it is full) and the compressed size of every block.
+            int nblocks = (nbytes+block_size-1)/block_size;
+            std::vector<uint64_t> header(3+nblocks);
+            header[0] = nblocks;
+            header[1] = block_size;
+            header[2] = nbytes%block_size;
+
+            std::vector< std::vector<char> > blocks(nblocks);
+            #pragma omp parallel for schedule(dynamic)
+            for(int b=0; b<nblocks; b++) {
+                uLong len = std::min((uint64_t)block_size, nbytes-b*block_size);
+                uLongf clen = compressBound(len);
+                blocks[b].resize(clen);
+                compress2((Bytef *)&(blocks[b][0]), &clen, (const Bytef *)(raw+b*block_size), len, Z_BEST_SPEED);
+                blocks[b].resize(clen);
+                header[3+b] = clen;
+            }
+
+            size_t total = header.size()*sizeof(uint64_t);
+            std::vector<size_t> position(nblocks);
+            for(int b=0; b<nblocks; b++) {
+                position[b] = total;
+                total += blocks[b].size();
+            }
+
+            std::vector<char> data(total);
+            memcpy(&(data[0]), &(header[0]), header.size()*sizeof(uint64_t));
+            #pragma omp parallel for schedule(static)
+            for(int b=0; b<nblocks; b++)
+                memcpy(&(data[position[b]]), &(blocks[b][0]), blocks[b].size());
+            array.data.swap(data);
+        }
+#endif
+    }
+
+    static void write_header(std::stringstream &xml, const char *section, const std::vector<data_array> &arrays, uint64_t &offset)
+    {
+        xml<<"      <"<<section<<">\n";
+        for(size_t i=0; i<arrays.size(); i++) {
+            xml<<"        <DataArray type=\""<<arrays[i].type<<"\" Name=\""<<arrays[i].name
+               <<"\" NumberOfComponents=\""<<arrays[i].ncomponents<<"\" format=\"appended\" offset=\""<<offset<<"\"/>\n";
+            offset += arrays[i].data.size();
+        }
+        xml<<"      </"<<section<<">\n";
+    }
+
+    static void write_pheader(std::stringstream &xml, const char *section, const std::vector<data_array> &arrays)
+    {
+        xml<<"    <"<<section<<">\n";
+        for(size_t i=0; i<arrays.size(); i++)
+            xml<<"      <PDataArray type=\""<<arrays[i].type<<"\" Name=\""<<arrays[i].name
+               <<"\" NumberOfComponents=\""<<arrays[i].ncomponents<<"\"/>\n";
+        xml<<"    </"<<section<<">\n";
+    }
+
+    static void write_data(FILE *file, const std::vector<data_array> &arrays)
+    {
+        for(size_t i=0; i<arrays.size(); i++) {
+            if(!arrays[i].data.empty())
+                fwrite(&(arrays[i].data[0]), 1, arrays[i].data.size(), file);
+        }
+    }
+};
+
+#endif
@@ -4,8 +4,46 @@
 #if defined(__cplusplus)
 extern "C" {
 #endif
+/* Opaque handle of a mesh being adapted. Meshes are independent of
+   each other, so several can be adapted at the same time. */
+typedef struct pragmatic_mesh pragmatic_mesh_t;
+
+pragmatic_mesh_t *pragmatic_mesh_2d_create(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y);
+pragmatic_mesh_t *pragmatic_mesh_3d_create(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z);
+#ifdef HAVE_VTK
+pragmatic_mesh_t *pragmatic_mesh_vtk_create(const char *filename);
+#endif
+pragmatic_mesh_t *pragmatic_mesh_checkpoint_create(const char *basename);
+void pragmatic_mesh_destroy(pragmatic_mesh_t *handle);
+void pragmatic_mesh_checkpoint(pragmatic_mesh_t *handle, const char *basename);
+void pragmatic_mesh_dump(pragmatic_mesh_t *handle, const char *filename);
+void pragmatic_mesh_dump_async(pragmatic_mesh_t *handle, const char *filename, int *dump);
+void pragmatic_mesh_dump_test(pragmatic_mesh_t *handle, const int *dump, int *done);
+void pragmatic_mesh_dump_wait(pragmatic_mesh_t *handle, const int *dump);
+void pragmatic_mesh_set_boundary(pragmatic_mesh_t *handle, const int *nfacets, const int *facets, const int *ids);
+void pragmatic_mesh_set_metric(pragmatic_mesh_t *handle, const double *metric);
+void pragmatic_mesh_add_field(pragmatic_mesh_t *handle, const double *psi, const double *error, int *pnorm);
+void pragmatic_mesh_adapt(pragmatic_mesh_t *handle, int coarsen_surface);
+void pragmatic_adapt_batch(const int *nmeshes, pragmatic_mesh_t **handles, int coarsen_surface);
+void pragmatic_mesh_coarsen(pragmatic_mesh_t *handle, int coarsen_surface);
+void pragmatic_mesh_get_info(pragmatic_mesh_t *handle, int *NNodes, int *NElements);
+void pragmatic_mesh_get_coords_2d(pragmatic_mesh_t *handle, double *x, double *y);
+void pragmatic_mesh_get_coords_3d(pragmatic_mesh_t *handle, double *x, double *y, double *z);
+void pragmatic_mesh_get_coords_view(pragmatic_mesh_t *handle, const double **coords);
+void pragmatic_mesh_get_elements_view(pragmatic_mesh_t *handle, const int **elements);
+void pragmatic_mesh_get_elements(pragmatic_mesh_t *handle, int *elements);
+void pragmatic_mesh_get_metric(pragmatic_mesh_t *handle, double *metric);
+void pragmatic_mesh_attach_field(pragmatic_mesh_t *handle, const double *psi, int *id);
+void pragmatic_mesh_get_field(pragmatic_mesh_t *handle, const int *id, double *psi);
+void pragmatic_mesh_get_boundaryTags(pragmatic_mesh_t *handle, int ** tags);
+
 void pragmatic_2d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y);
 void pragmatic_3d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z);
+#ifdef HAVE_VTK
+void pragmatic_vtk_init(const char *filename);
+#endif
+void pragmatic_checkpoint_init(const char *basename);
+void pragmatic_checkpoint(const char *basename);
 void pragmatic_set_boundary(const int *nfacets, const int *facets, const int *ids);
 void pragmatic_set_metric(const double *metric);
 void pragmatic_add_field(const double *psi, const double *error, int *pnorm);
@@ -15,7 +53,15 @@ void pragmatic_get_info(int *NNodes, int *NElements);
 void pragmatic_get_coords_2d(double *x, double *y);
 void pragmatic_get_coords_3d(double *x, double *y, double *z);
 void pragmatic_get_elements(int *elements);
+void pragmatic_get_coords_view(const double **coords);
+void pragmatic_get_elements_view(const int **elements);
+void pragmatic_attach_field(const double *psi, int *id);
+void pragmatic_get_field(const int *id, double *psi);
 void pragmatic_get_boundaryTags(int ** tags);
+void pragmatic_dump(const char *filename);
+void pragmatic_dump_async(const char *filename, int *handle);
+void pragmatic_dump_test(const int *handle, int *done);
+void pragmatic_dump_wait(const int *handle);
 void pragmatic_finalize(void);
 #if defined(__cplusplus)
 }
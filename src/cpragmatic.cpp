@@ -43,52 +43,60 @@
 #include "Refine.h"
 #include "Swapping.h"
 #include "Smooth.h"
+#include "CheckpointTools.h"
+#include "VTUWriter.h"
+#include "AsyncExporter.h"
+#include "cpragmatic.h"
 
 #ifdef HAVE_VTK
 #include "VTKTools.h"
 #endif
 
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
 
-static void *_pragmatic_mesh=NULL;
-static void *_pragmatic_metric_field=NULL;
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
 
-extern "C" {
-#ifdef HAVE_VTK
-    void pragmatic_dump(const char *filename)
-    {
-        VTKTools<double>::export_vtu(filename, (Mesh<double>*)_pragmatic_mesh);
-    }
+/// A mesh being adapted through the C interface, with its metric.
+struct pragmatic_mesh {
+    Mesh<double> *mesh;
+    void *metric_field;
+    AsyncExporter<double> *exporter;
+};
 
-    void pragmatic_dump_debug()
-    {
-        pragmatic_dump("dump\0");
-    }
-#endif
+/// Mesh used by the functions that do not take a handle.
+static pragmatic_mesh_t *_pragmatic_handle=NULL;
 
-    /** Initialise pragmatic with mesh to be adapted. pragmatic_finalize must
-      be called before this can be called again, i.e. cannot adapt
-      multiple meshes at the same time.
+static pragmatic_mesh_t *pragmatic_mesh_wrap(Mesh<double> *mesh)
+{
+    pragmatic_mesh_t *handle = new pragmatic_mesh_t;
+    handle->mesh = mesh;
+    handle->metric_field = NULL;
+    handle->exporter = NULL;
+
+    return handle;
+}
+
+extern "C" {
+    /** Create a 2D mesh to be adapted. Any number of meshes can be
+      adapted at the same time through their handles.
 
       @param [in] NNodes Number of nodes
       @param [in] NElements Number of elements
       @param [in] enlist Element-node list
       @param [in] x x coordinate array
       @param [in] y y coordinate array
+      @return Handle of the mesh, to be released with pragmatic_mesh_destroy
       */
-    void pragmatic_2d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y)
+    pragmatic_mesh_t *pragmatic_mesh_2d_create(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y)
     {
-        if(_pragmatic_mesh!=NULL) {
-            throw new std::string("PRAgMaTIc: only one mesh can be adapted at a time");
-        }
-
-        Mesh<double> *mesh = new Mesh<double>(*NNodes, *NElements, enlist, x, y);
-
-        _pragmatic_mesh = mesh;
+        return pragmatic_mesh_wrap(new Mesh<double>(*NNodes, *NElements, enlist, x, y));
     }
 
-    /** Initialise pragmatic with mesh to be adapted. pragmatic_finalize must
-      be called before this can be called again, i.e. cannot adapt
-      multiple meshes at the same time.
+    /** Create a 3D mesh to be adapted.
 
       @param [in] NNodes Number of nodes
       @param [in] NElements Number of elements
@@ -96,34 +104,134 @@ extern "C" {
       @param [in] x x coordinate array
       @param [in] y y coordinate array
       @param [in] z z coordinate array
+      @return Handle of the mesh, to be released with pragmatic_mesh_destroy
       */
-    void pragmatic_3d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z)
+    pragmatic_mesh_t *pragmatic_mesh_3d_create(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z)
     {
-        assert(_pragmatic_mesh==NULL);
-        assert(_pragmatic_metric_field==NULL);
-
-        Mesh<double> *mesh = new Mesh<double>(*NNodes, *NElements, enlist, x, y, z);
-
-        _pragmatic_mesh = mesh;
+        return pragmatic_mesh_wrap(new Mesh<double>(*NNodes, *NElements, enlist, x, y, z));
     }
 
-    /** Initialise pragmatic with name of VTK file to be adapted.
-    */
 #ifdef HAVE_VTK
-    void pragmatic_vtk_init(const char *filename)
-    {
-        assert(_pragmatic_mesh==NULL);
-        assert(_pragmatic_metric_field==NULL);
+    /** Create a mesh to be adapted from a VTK file.
 
+      @param [in] filename Name of the VTK file
+      @return Handle of the mesh, to be released with pragmatic_mesh_destroy
+      */
+    pragmatic_mesh_t *pragmatic_mesh_vtk_create(const char *filename)
+    {
         Mesh<double> *mesh=VTKTools<double>::import_vtu(filename);
         mesh->create_boundary();
 
-        _pragmatic_mesh = mesh;
+        return pragmatic_mesh_wrap(mesh);
     }
 #endif
 
+    /** Create a mesh to be adapted from a checkpoint written by
+      pragmatic_mesh_checkpoint.
+
+      @param [in] basename Name of the checkpoint without extension
+      @return Handle of the mesh, to be released with pragmatic_mesh_destroy
+      */
+    pragmatic_mesh_t *pragmatic_mesh_checkpoint_create(const char *basename)
+    {
+        return pragmatic_mesh_wrap(CheckpointTools<double>::import_checkpoint(basename));
+    }
+
+    /** Release a mesh and its metric. Outstanding asynchronous dumps are
+      written first.
+
+      @param [in] handle Handle of the mesh
+      */
+    void pragmatic_mesh_destroy(pragmatic_mesh_t *handle)
+    {
+        delete handle->exporter;
+
+        if(handle->mesh->get_number_dimensions()==2) {
+            if(handle->metric_field!=NULL)
+                delete (MetricField<double,2> *)handle->metric_field;
+        } else {
+            if(handle->metric_field!=NULL)
+                delete (MetricField<double,3> *)handle->metric_field;
+        }
+
+        delete handle->mesh;
+        delete handle;
+    }
+
+    /** Write a checkpoint of the mesh, including its metric and attached
+      fields. Each process writes basename_<rank>.pcp and rank 0 writes
+      the index basename.pcp.
+
+      @param [in] handle Handle of the mesh
+      @param [in] basename Name of the checkpoint without extension
+      */
+    void pragmatic_mesh_checkpoint(pragmatic_mesh_t *handle, const char *basename)
+    {
+        CheckpointTools<double>::export_checkpoint(basename, handle->mesh);
+    }
+
+    /** Write the mesh to filename.vtu, or to filename.pvtu and one piece
+      per process when run in parallel. Does not require VTK.
+
+      @param [in] handle Handle of the mesh
+      @param [in] filename Name of the output without extension
+      */
+    void pragmatic_mesh_dump(pragmatic_mesh_t *handle, const char *filename)
+    {
+        VTUWriter<double>::export_vtu(filename, handle->mesh);
+    }
+
+    /** Write the mesh like pragmatic_mesh_dump, but on a background
+      thread. The mesh can be adapted as soon as this returns. Blocks if
+      too many dumps of this mesh are still being written.
+
+      @param [in] handle Handle of the mesh
+      @param [in] filename Name of the output without extension
+      @param [out] dump Handle to pass to pragmatic_mesh_dump_test or pragmatic_mesh_dump_wait
+      */
+    void pragmatic_mesh_dump_async(pragmatic_mesh_t *handle, const char *filename, int *dump)
+    {
+        if(handle->exporter==NULL)
+            handle->exporter = new AsyncExporter<double>();
+
+        *dump = handle->exporter->export_vtu(filename, handle->mesh);
+    }
+
+    /** Test whether an asynchronous dump has been written.
+
+      @param [in] handle Handle of the mesh
+      @param [in] dump Handle returned by pragmatic_mesh_dump_async
+      @param [out] done 1 if it has been written or the handle is unknown, 0 otherwise
+      */
+    void pragmatic_mesh_dump_test(pragmatic_mesh_t *handle, const int *dump, int *done)
+    {
+        if(handle->exporter==NULL || !handle->exporter->is_handle(*dump)) {
+            std::cerr<<"WARNING: PRAgMaTIc: unknown dump handle "<<*dump<<".\n";
+            *done = 1;
+            return;
+        }
+
+        *done = handle->exporter->test(*dump)?1:0;
+    }
+
+    /** Wait for an asynchronous dump to be written.
+
+      @param [in] handle Handle of the mesh
+      @param [in] dump Handle returned by pragmatic_mesh_dump_async
+      */
+    void pragmatic_mesh_dump_wait(pragmatic_mesh_t *handle, const int *dump)
+    {
+        if(handle->exporter==NULL || !handle->exporter->is_handle(*dump)) {
+            std::cerr<<"WARNING: PRAgMaTIc: unknown dump handle "<<*dump<<".\n";
+            return;
+        }
+
+        handle->exporter->wait(*dump);
+    }
+
     /** Add field which should be adapted to.
 
+      @param [in] handle Handle of the mesh
       @param [in] psi Node centred field variable
       @param [in] error Error target
       @param [in] pnorm P-norm value for error measure. Applies the
@@ -131,25 +239,23 @@ extern "C" {
       Mathematics of Computation, Volume 76, Number 257, January
       2007. Set to -1 to default to absolute error measure.
       */
-    void pragmatic_add_field(const double *psi, const double *error, int *pnorm)
+    void pragmatic_mesh_add_field(pragmatic_mesh_t *handle, const double *psi, const double *error, int *pnorm)
     {
-        assert(_pragmatic_mesh!=NULL);
+        Mesh<double> *mesh = handle->mesh;
 
-        Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
-
-        if(_pragmatic_metric_field==NULL) {
-            if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2) {
+        if(handle->metric_field==NULL) {
+            if(mesh->get_number_dimensions()==2) {
                 MetricField<double,2> *metric_field = new MetricField<double,2>(*mesh);
                 metric_field->add_field(psi, *error, *pnorm);
                 metric_field->update_mesh();
 
-                _pragmatic_metric_field = metric_field;
+                handle->metric_field = metric_field;
             } else {
                 MetricField<double,3> *metric_field = new MetricField<double,3>(*mesh);
                 metric_field->add_field(psi, *error, *pnorm);
                 metric_field->update_mesh();
 
-                _pragmatic_metric_field = metric_field;
+                handle->metric_field = metric_field;
             }
         } else {
             std::cerr<<"WARNING: Fortran interface currently only supports adding a single field.\n";
@@ -158,53 +264,50 @@ extern "C" {
 
     /** Set the node centred metric field
 
+      @param [in] handle Handle of the mesh
       @param [in] metric Metric tensor field.
       */
-    void pragmatic_set_metric(const double *metric)
+    void pragmatic_mesh_set_metric(pragmatic_mesh_t *handle, const double *metric)
     {
-        assert(_pragmatic_mesh!=NULL);
-        assert(_pragmatic_metric_field==NULL);
+        assert(handle->metric_field==NULL);
 
-        Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
+        Mesh<double> *mesh = handle->mesh;
 
-        if(_pragmatic_metric_field==NULL) {
-            if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2) {
-                MetricField<double,2> *metric_field = new MetricField<double,2>(*mesh);
-                _pragmatic_metric_field = metric_field;
-            } else {
-                MetricField<double,3> *metric_field = new MetricField<double,3>(*mesh);
-                _pragmatic_metric_field = metric_field;
-            }
-        }
+        if(mesh->get_number_dimensions()==2) {
+            MetricField<double,2> *metric_field = new MetricField<double,2>(*mesh);
+            metric_field->set_metric_full(metric);
+            metric_field->update_mesh();
 
-        if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2) {
-            ((MetricField<double,2> *)_pragmatic_metric_field)->set_metric_full(metric);
-            ((MetricField<double,2> *)_pragmatic_metric_field)->update_mesh();
+            handle->metric_field = metric_field;
         } else {
-            ((MetricField<double,3> *)_pragmatic_metric_field)->set_metric_full(metric);
-            ((MetricField<double,3> *)_pragmatic_metric_field)->update_mesh();
+            MetricField<double,3> *metric_field = new MetricField<double,3>(*mesh);
+            metric_field->set_metric_full(metric);
+            metric_field->update_mesh();
+
+            handle->metric_field = metric_field;
         }
     }
 
     /** Set the domain boundary.
 
+      @param [in] handle Handle of the mesh
       @param [in] nfacets Number of boundary facets
       @param [in] facets Facet list
       @param [in] ids Boundary ids
       */
-    void pragmatic_set_boundary(const int *nfacets, const int *facets, const int *ids)
+    void pragmatic_mesh_set_boundary(pragmatic_mesh_t *handle, const int *nfacets, const int *facets, const int *ids)
     {
-        assert(_pragmatic_mesh!=NULL);
-
-        Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
-        mesh->set_boundary(*nfacets, facets, ids);
+        handle->mesh->set_boundary(*nfacets, facets, ids);
     }
 
     /** Adapt the mesh.
-    */
-    void pragmatic_adapt(int coarsen_surface)
+
+      @param [in] handle Handle of the mesh
+      @param [in] coarsen_surface Allow the surface to be coarsened
+      */
+    void pragmatic_mesh_adapt(pragmatic_mesh_t *handle, int coarsen_surface)
     {
-        Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
+        Mesh<double> *mesh = handle->mesh;
 
         const size_t ndims = mesh->get_number_dimensions();
 
@@ -269,11 +372,61 @@ extern "C" {
         }
     }
 
+    /** Adapt several independent meshes. When built with OpenMP the
+      threads are shared out between the meshes, which are adapted
+      concurrently, each with its share of the threads. Without OpenMP,
+      or if any mesh is distributed over several MPI processes (its
+      adaptation communicates), the meshes are adapted one after
+      another.
+
+      @param [in] nmeshes Number of meshes
+      @param [in] handles Handles of the meshes
+      @param [in] coarsen_surface Allow the surface to be coarsened
+      */
+    void pragmatic_adapt_batch(const int *nmeshes, pragmatic_mesh_t **handles, int coarsen_surface)
+    {
+#ifdef HAVE_OPENMP
+        bool concurrent = true;
+#ifdef HAVE_MPI
+        for(int i=0; i<*nmeshes; i++) {
+            int nparts;
+            MPI_Comm_size(handles[i]->mesh->get_mpi_comm(), &nparts);
+            if(nparts>1)
+                concurrent = false;
+        }
+#endif
+
+        if(concurrent && *nmeshes>1) {
+            int nthreads = omp_get_max_threads();
+            int nteams = std::min(*nmeshes, nthreads);
+            int team_size = std::max(nthreads/nteams, 1);
+
+            int max_active_levels = omp_get_max_active_levels();
+            omp_set_max_active_levels(2);
+
+            #pragma omp parallel for num_threads(nteams) schedule(dynamic)
+            for(int i=0; i<*nmeshes; i++) {
+                omp_set_num_threads(team_size);
+                pragmatic_mesh_adapt(handles[i], coarsen_surface);
+            }
+
+            omp_set_max_active_levels(max_active_levels);
+            return;
+        }
+#endif
+
+        for(int i=0; i<*nmeshes; i++)
+            pragmatic_mesh_adapt(handles[i], coarsen_surface);
+    }
+
     /** Coarsen the mesh.
-    */
-    void pragmatic_coarsen(int coarsen_surface)
+
+      @param [in] handle Handle of the mesh
+      @param [in] coarsen_surface Allow the surface to be coarsened
+      */
+    void pragmatic_mesh_coarsen(pragmatic_mesh_t *handle, int coarsen_surface)
     {
-        Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
+        Mesh<double> *mesh = handle->mesh;
 
         const size_t ndims = mesh->get_number_dimensions();
 
@@ -299,47 +452,79 @@ extern "C" {
         mesh->defragment();
     }
 
-
     /** Get size of mesh.
 
+      @param [in] handle Handle of the mesh
       @param [out] NNodes
       @param [out] NElements
       */
-    void pragmatic_get_info(int *NNodes, int *NElements)
+    void pragmatic_mesh_get_info(pragmatic_mesh_t *handle, int *NNodes, int *NElements)
     {
-        Mesh<double> *mesh = (Mesh<double> *)_pragmatic_mesh;
-
-        *NNodes = mesh->get_number_nodes();
-        *NElements = mesh->get_number_elements();
+        *NNodes = handle->mesh->get_number_nodes();
+        *NElements = handle->mesh->get_number_elements();
     }
 
-    void pragmatic_get_coords_2d(double *x, double *y)
+    void pragmatic_mesh_get_coords_2d(pragmatic_mesh_t *handle, double *x, double *y)
     {
-        size_t NNodes = ((Mesh<double> *)_pragmatic_mesh)->get_number_nodes();
+        const Mesh<double> *mesh = handle->mesh;
+
+        size_t NNodes = mesh->get_number_nodes();
         for(size_t i=0; i<NNodes; i++) {
-            x[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[0];
-            y[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[1];
+            x[i] = mesh->get_coords(i)[0];
+            y[i] = mesh->get_coords(i)[1];
         }
     }
 
-    void pragmatic_get_coords_3d(double *x, double *y, double *z)
+    void pragmatic_mesh_get_coords_3d(pragmatic_mesh_t *handle, double *x, double *y, double *z)
     {
-        size_t NNodes = ((Mesh<double> *)_pragmatic_mesh)->get_number_nodes();
+        const Mesh<double> *mesh = handle->mesh;
+
+        size_t NNodes = mesh->get_number_nodes();
         for(size_t i=0; i<NNodes; i++) {
-            x[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[0];
-            y[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[1];
-            z[i] = ((Mesh<double> *)_pragmatic_mesh)->get_coords(i)[2];
+            x[i] = mesh->get_coords(i)[0];
+            y[i] = mesh->get_coords(i)[1];
+            z[i] = mesh->get_coords(i)[2];
         }
     }
 
-    void pragmatic_get_elements(int *elements)
+    /** Return a pointer to the interleaved vertex coordinates of the
+      mesh, ndims values per vertex, rather than copying them. The mesh
+      is compact after pragmatic_mesh_adapt and pragmatic_mesh_coarsen.
+      The pointer is valid until the mesh is next adapted or destroyed.
+
+      @param [in] handle Handle of the mesh
+      @param [out] coords Pointer to NNodes*ndims coordinates
+      */
+    void pragmatic_mesh_get_coords_view(pragmatic_mesh_t *handle, const double **coords)
+    {
+        const Mesh<double> *mesh = handle->mesh;
+
+        *coords = mesh->get_number_nodes()>0?mesh->get_coords(0):NULL;
+    }
+
+    /** Return a pointer to the element-node list of the mesh rather than
+      copying it. Same lifetime as pragmatic_mesh_get_coords_view.
+
+      @param [in] handle Handle of the mesh
+      @param [out] elements Pointer to NElements*(ndims+1) vertex ids
+      */
+    void pragmatic_mesh_get_elements_view(pragmatic_mesh_t *handle, const int **elements)
+    {
+        const Mesh<double> *mesh = handle->mesh;
+
+        *elements = mesh->get_number_elements()>0?mesh->get_element(0):NULL;
+    }
+
+    void pragmatic_mesh_get_elements(pragmatic_mesh_t *handle, int *elements)
     {
-        const size_t ndims = ((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions();
-        const size_t NElements = ((Mesh<double> *)_pragmatic_mesh)->get_number_elements();
+        const Mesh<double> *mesh = handle->mesh;
+
+        const size_t ndims = mesh->get_number_dimensions();
+        const size_t NElements = mesh->get_number_elements();
         const size_t nloc = (ndims==2)?3:4;
 
         for(size_t i=0; i<NElements; i++) {
-            const int *n=((Mesh<double> *)_pragmatic_mesh)->get_element(i);
+            const int *n=mesh->get_element(i);
 
             for(size_t j=0; j<nloc; j++) {
                 assert(n[j]>=0);
@@ -347,6 +532,257 @@ extern "C" {
             }
         }
     }
+
+    void pragmatic_mesh_get_metric(pragmatic_mesh_t *handle, double *metric)
+    {
+        if(handle->mesh->get_number_dimensions()==2) {
+            ((MetricField<double,2> *)handle->metric_field)->get_metric(metric);
+        } else {
+            ((MetricField<double,3> *)handle->metric_field)->get_metric(metric);
+        }
+    }
+
+    /** Attach a vertex field that is interpolated onto the adapted mesh.
+
+      @param [in] handle Handle of the mesh
+      @param [in] psi Field values, one per vertex
+      @param [out] id Identifier used to retrieve the field with pragmatic_mesh_get_field
+      */
+    void pragmatic_mesh_attach_field(pragmatic_mesh_t *handle, const double *psi, int *id)
+    {
+        *id = handle->mesh->attach_field(psi);
+    }
+
+    /** Retrieve an attached vertex field on the current mesh.
+
+      @param [in] handle Handle of the mesh
+      @param [in] id Identifier returned by pragmatic_mesh_attach_field
+      @param [out] psi Field values, one per vertex
+      */
+    void pragmatic_mesh_get_field(pragmatic_mesh_t *handle, const int *id, double *psi)
+    {
+        handle->mesh->get_field(*id, psi);
+    }
+
+    void pragmatic_mesh_get_boundaryTags(pragmatic_mesh_t *handle, int ** tags)
+    {
+        *tags = handle->mesh->get_boundaryTags();
+    }
+
+    /* The functions below work on a single mesh and are kept for
+       existing callers. pragmatic_finalize must be called before another
+       mesh can be initialised. */
+
+    /** Write the current mesh to filename.vtu, or to filename.pvtu and
+      one piece per process when run in parallel. Does not require VTK.
+      */
+    void pragmatic_dump(const char *filename)
+    {
+        pragmatic_mesh_dump(_pragmatic_handle, filename);
+    }
+
+    /** Write the current mesh like pragmatic_dump, but on a background
+      thread. The mesh can be adapted as soon as this returns. Blocks if
+      too many dumps are still being written.
+
+      @param [in] filename Name of the output without extension
+      @param [out] handle Handle to pass to pragmatic_dump_test or pragmatic_dump_wait
+      */
+    void pragmatic_dump_async(const char *filename, int *handle)
+    {
+        assert(_pragmatic_handle!=NULL);
+
+        pragmatic_mesh_dump_async(_pragmatic_handle, filename, handle);
+    }
+
+    /** Test whether a dump started by pragmatic_dump_async has been written.
+
+      @param [in] handle Handle returned by pragmatic_dump_async
+      @param [out] done 1 if it has been written or the handle is unknown, 0 otherwise
+      */
+    void pragmatic_dump_test(const int *handle, int *done)
+    {
+        pragmatic_mesh_dump_test(_pragmatic_handle, handle, done);
+    }
+
+    /** Wait for a dump started by pragmatic_dump_async to be written.
+
+      @param [in] handle Handle returned by pragmatic_dump_async
+      */
+    void pragmatic_dump_wait(const int *handle)
+    {
+        pragmatic_mesh_dump_wait(_pragmatic_handle, handle);
+    }
+
+    void pragmatic_dump_debug()
+    {
+        pragmatic_dump("dump\0");
+    }
+
+    /** Initialise pragmatic with mesh to be adapted. pragmatic_finalize must
+      be called before this can be called again, i.e. cannot adapt
+      multiple meshes at the same time. Use pragmatic_mesh_2d_create for
+      that.
+
+      @param [in] NNodes Number of nodes
+      @param [in] NElements Number of elements
+      @param [in] enlist Element-node list
+      @param [in] x x coordinate array
+      @param [in] y y coordinate array
+      */
+    void pragmatic_2d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y)
+    {
+        if(_pragmatic_handle!=NULL) {
+            throw new std::string("PRAgMaTIc: only one mesh can be adapted at a time");
+        }
+
+        _pragmatic_handle = pragmatic_mesh_2d_create(NNodes, NElements, enlist, x, y);
+    }
+
+    /** Initialise pragmatic with mesh to be adapted. pragmatic_finalize must
+      be called before this can be called again, i.e. cannot adapt
+      multiple meshes at the same time. Use pragmatic_mesh_3d_create for
+      that.
+
+      @param [in] NNodes Number of nodes
+      @param [in] NElements Number of elements
+      @param [in] enlist Element-node list
+      @param [in] x x coordinate array
+      @param [in] y y coordinate array
+      @param [in] z z coordinate array
+      */
+    void pragmatic_3d_init(const int *NNodes, const int *NElements, const int *enlist, const double *x, const double *y, const double *z)
+    {
+        assert(_pragmatic_handle==NULL);
+
+        _pragmatic_handle = pragmatic_mesh_3d_create(NNodes, NElements, enlist, x, y, z);
+    }
+
+    /** Initialise pragmatic with name of VTK file to be adapted.
+    */
+#ifdef HAVE_VTK
+    void pragmatic_vtk_init(const char *filename)
+    {
+        assert(_pragmatic_handle==NULL);
+
+        _pragmatic_handle = pragmatic_mesh_vtk_create(filename);
+    }
+#endif
+
+    /** Initialise pragmatic from a checkpoint written by pragmatic_checkpoint.
+
+      @param [in] basename Name of the checkpoint without extension
+      */
+    void pragmatic_checkpoint_init(const char *basename)
+    {
+        assert(_pragmatic_handle==NULL);
+
+        _pragmatic_handle = pragmatic_mesh_checkpoint_create(basename);
+    }
+
+    /** Write a checkpoint of the current mesh, including its metric and
+      attached fields. Each process writes basename_<rank>.pcp and rank 0
+      writes the index basename.pcp.
+
+      @param [in] basename Name of the checkpoint without extension
+      */
+    void pragmatic_checkpoint(const char *basename)
+    {
+        assert(_pragmatic_handle!=NULL);
+
+        pragmatic_mesh_checkpoint(_pragmatic_handle, basename);
+    }
+
+    /** Add field which should be adapted to, see pragmatic_mesh_add_field.
+      */
+    void pragmatic_add_field(const double *psi, const double *error, int *pnorm)
+    {
+        assert(_pragmatic_handle!=NULL);
+
+        pragmatic_mesh_add_field(_pragmatic_handle, psi, error, pnorm);
+    }
+
+    /** Set the node centred metric field
+
+      @param [in] metric Metric tensor field.
+      */
+    void pragmatic_set_metric(const double *metric)
+    {
+        assert(_pragmatic_handle!=NULL);
+
+        pragmatic_mesh_set_metric(_pragmatic_handle, metric);
+    }
+
+    /** Set the domain boundary.
+
+      @param [in] nfacets Number of boundary facets
+      @param [in] facets Facet list
+      @param [in] ids Boundary ids
+      */
+    void pragmatic_set_boundary(const int *nfacets, const int *facets, const int *ids)
+    {
+        assert(_pragmatic_handle!=NULL);
+
+        pragmatic_mesh_set_boundary(_pragmatic_handle, nfacets, facets, ids);
+    }
+
+    /** Adapt the mesh.
+    */
+    void pragmatic_adapt(int coarsen_surface)
+    {
+        pragmatic_mesh_adapt(_pragmatic_handle, coarsen_surface);
+    }
+
+    void pragmatic_coarsen(int coarsen_surface)
+    {
+        pragmatic_mesh_coarsen(_pragmatic_handle, coarsen_surface);
+    }
+
+    /** Get size of mesh.
+
+      @param [out] NNodes
+      @param [out] NElements
+      */
+    void pragmatic_get_info(int *NNodes, int *NElements)
+    {
+        pragmatic_mesh_get_info(_pragmatic_handle, NNodes, NElements);
+    }
+
+    void pragmatic_get_coords_2d(double *x, double *y)
+    {
+        pragmatic_mesh_get_coords_2d(_pragmatic_handle, x, y);
+    }
+
+    void pragmatic_get_coords_3d(double *x, double *y, double *z)
+    {
+        pragmatic_mesh_get_coords_3d(_pragmatic_handle, x, y, z);
+    }
+
+    /** Return a pointer to the interleaved vertex coordinates of the
+      mesh, see pragmatic_mesh_get_coords_view. The pointer is valid
+      until the mesh is next adapted or pragmatic_finalize is called.
+
+      @param [out] coords Pointer to NNodes*ndims coordinates
+      */
+    void pragmatic_get_coords_view(const double **coords)
+    {
+        pragmatic_mesh_get_coords_view(_pragmatic_handle, coords);
+    }
+
+    /** Return a pointer to the element-node list of the mesh rather than
+      copying it. Same lifetime as pragmatic_get_coords_view.
+
+      @param [out] elements Pointer to NElements*(ndims+1) vertex ids
+      */
+    void pragmatic_get_elements_view(const int **elements)
+    {
+        pragmatic_mesh_get_elements_view(_pragmatic_handle, elements);
+    }
+
+    void pragmatic_get_elements(int *elements)
+    {
+        pragmatic_mesh_get_elements(_pragmatic_handle, elements);
+    }
     /*
        void pragmatic_get_lnn2gnn(int *nodes_per_partition, int *lnn2gnn){
        std::vector<int> _NPNodes, _lnn2gnn;
@@ -362,30 +798,41 @@ extern "C" {
        */
     void pragmatic_get_metric(double *metric)
     {
-        if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2) {
-            ((MetricField<double,2> *)_pragmatic_metric_field)->get_metric(metric);
-        } else {
-            ((MetricField<double,3> *)_pragmatic_metric_field)->get_metric(metric);
-        }
+        pragmatic_mesh_get_metric(_pragmatic_handle, metric);
+    }
+
+    /** Attach a vertex field that is interpolated onto the adapted mesh.
+
+      @param [in] psi Field values, one per vertex
+      @param [out] id Identifier used to retrieve the field with pragmatic_get_field
+      */
+    void pragmatic_attach_field(const double *psi, int *id)
+    {
+        assert(_pragmatic_handle!=NULL);
+
+        pragmatic_mesh_attach_field(_pragmatic_handle, psi, id);
     }
-    
+
+    /** Retrieve an attached vertex field on the current mesh.
+
+      @param [in] id Identifier returned by pragmatic_attach_field
+      @param [out] psi Field values, one per vertex
+      */
+    void pragmatic_get_field(const int *id, double *psi)
+    {
+        assert(_pragmatic_handle!=NULL);
+
+        pragmatic_mesh_get_field(_pragmatic_handle, id, psi);
+    }
+
     void pragmatic_get_boundaryTags(int ** tags)
     {
-      *tags = ((Mesh<double> *)_pragmatic_mesh)->get_boundaryTags();
+        pragmatic_mesh_get_boundaryTags(_pragmatic_handle, tags);
     }
 
     void pragmatic_finalize()
     {
-        if(((Mesh<double> *)_pragmatic_mesh)->get_number_dimensions()==2) {
-            if(_pragmatic_metric_field!=NULL)
-                delete (MetricField<double,2> *)_pragmatic_metric_field;
-        } else {
-            if(_pragmatic_metric_field!=NULL)
-                delete (MetricField<double,3> *)_pragmatic_metric_field;
-        }
-        _pragmatic_metric_field=NULL;
-
-        delete (Mesh<double> *)_pragmatic_mesh;
-        _pragmatic_mesh=NULL;
+        pragmatic_mesh_destroy(_pragmatic_handle);
+        _pragmatic_handle=NULL;
     }
 }
@@ -0,0 +1,163 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cfloat>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#include "MetricField.h"
+#include "Smooth.h"
+#include "ticker.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#ifdef HAVE_VTK
+Mesh<double> *init_mesh()
+{
+    Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box50x50.vtu");
+    mesh->create_boundary();
+
+    MetricField<double,2> metric_field(*mesh);
+
+    size_t NNodes = mesh->get_number_nodes();
+
+    double h1 = 1.0/50;
+    double h0 = 10.0/50;
+    for(size_t i=0; i<NNodes; i++) {
+        // Want x,y ranging from -1, 1
+        double x = 2*mesh->get_coords(i)[0] - 1;
+        double y = 2*mesh->get_coords(i)[1] - 1;
+        double d = std::min(1-std::abs(x), 1-std::abs(y));
+
+        double hx = h0 - (h1-h0)*(d-1);
+        double m[] = {1.0/pow(hx, 2), 0, 1.0/pow(hx, 2)};
+
+        metric_field.set_metric(m, i);
+    }
+    metric_field.update_mesh();
+
+    return mesh;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int rank=0;
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+#ifdef HAVE_VTK
+    if(rank==0)
+        std::cout<<"BENCHMARK: method sweeps time qmin qmean\n";
+
+    // Reference: Linf optimisation.
+    double ref_qmin;
+    {
+        Mesh<double> *mesh=init_mesh();
+        Smooth<double, 2> smooth(*mesh);
+
+        double tic = get_wtime();
+        smooth.optimisation_linf(10);
+        double toc = get_wtime();
+
+        ref_qmin = mesh->get_qmin();
+        if(rank==0)
+            std::cout<<"BENCHMARK: optimisation_linf 10 "<<toc-tic<<" "<<ref_qmin<<" "<<mesh->get_qmean()<<std::endl;
+
+        delete mesh;
+    }
+
+    int newton_sweeps[] = {1, 2, 5, 10};
+    for(int i=0; i<4; i++) {
+        Mesh<double> *mesh=init_mesh();
+        Smooth<double, 2> smooth(*mesh);
+
+        double tic = get_wtime();
+        smooth.optimisation_newton(newton_sweeps[i]);
+        double toc = get_wtime();
+
+        double qmin = mesh->get_qmin();
+        if(rank==0) {
+            std::cout<<"BENCHMARK: optimisation_newton "<<newton_sweeps[i]<<" "<<toc-tic<<" "<<qmin<<" "<<mesh->get_qmean()<<std::endl;
+
+            if(newton_sweeps[i]==10) {
+                std::cout<<"Checking optimisation_newton(10) qmin >= optimisation_linf(10) qmin: ";
+                if(qmin>=ref_qmin)
+                    std::cout<<"pass"<<std::endl;
+                else
+                    std::cout<<"fail (qmin="<<qmin<<", reference="<<ref_qmin<<")"<<std::endl;
+
+                long double area = mesh->calculate_area();
+                long double ideal_area(1);
+                std::cout<<"Checking area == 1: ";
+                if(std::abs(area-ideal_area)/std::max(area, ideal_area)<DBL_EPSILON)
+                    std::cout<<"pass"<<std::endl;
+                else
+                    std::cout<<"fail (area="<<area<<")"<<std::endl;
+            }
+        }
+
+        delete mesh;
+    }
+#else
+    std::cerr<<"Pragmatic was configured without VTK"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
@@ -98,6 +98,63 @@ int main()
             std::cout<<"pass\n";
         else
             std::cout<<"fail\n";
+
+        std::cout<<"Test ElementProperty<double>::lipnikov_hessian 2D:"<<std::endl;
+        {
+            double y0[] = {0.2, 0.3}, y1[] = {1.1, 0.1}, y2[] = {0.4, 1.3};
+            double m[] = {2.0, 0.3, 1.5};
+            double grad[2], hess[4];
+            double q = triangle.lipnikov_hessian(y0, y1, y2, m, grad, hess);
+
+            // Compare with central differences.
+            double h = 1.0e-5, err = fabs(q-triangle.lipnikov(y0, y1, y2, m[0], m[1], m[2]));
+            for(int i=0; i<2; i++) {
+                double yp[] = {y0[0], y0[1]}, yn[] = {y0[0], y0[1]};
+                yp[i] += h;
+                yn[i] -= h;
+
+                double gp[2], gn[2], hd[4];
+                double qp = triangle.lipnikov_hessian(yp, y1, y2, m, gp, hd);
+                double qn = triangle.lipnikov_hessian(yn, y1, y2, m, gn, hd);
+
+                err = std::max(err, fabs(grad[i]-(qp-qn)/(2*h)));
+                for(int j=0; j<2; j++)
+                    err = std::max(err, fabs(hess[i*2+j]-(gp[j]-gn[j])/(2*h)));
+            }
+            if(err<1.0e-6)
+                std::cout<<"pass\n";
+            else
+                std::cout<<"fail (error="<<err<<")\n";
+        }
+
+        std::cout<<"Test ElementProperty<double>::lipnikov_block2d:"<<std::endl;
+        {
+            const int block = ElementProperty<double>::lipnikov_block;
+            double X[6][block], M[3][block], q[block];
+            double qmin = DBL_MAX, err = 0;
+            int n = 5;
+            for(int e=0; e<n; e++) {
+                double y0[] = {x0[0], x0[1]+0.1*e};
+                double m0[] = {1.0+e, 0.1*e, 2.0};
+                for(int d=0; d<2; d++) {
+                    X[d][e] = y0[d];
+                    X[2+d][e] = x1[d];
+                    X[4+d][e] = x2[d];
+                }
+                triangle.lipnikov_block_metric(M, e, m0, fm, fm);
+                qmin = std::min(qmin, triangle.lipnikov(y0, x1, x2, m0, fm, fm));
+            }
+            double bmin = triangle.lipnikov_block2d(n, X, M, q);
+            for(int e=0; e<n; e++) {
+                double y0[] = {x0[0], x0[1]+0.1*e};
+                double m0[] = {1.0+e, 0.1*e, 2.0};
+                err = std::max(err, fabs(q[e]-triangle.lipnikov(y0, x1, x2, m0, fm, fm)));
+            }
+            if(err<1e-12 && fabs(bmin-qmin)<1e-12)
+                std::cout<<"pass\n";
+            else
+                std::cout<<"fail\n";
+        }
     }
 
     // Check tetrahedra
@@ -165,6 +222,64 @@ int main()
             std::cout<<"pass\n";
         else
             std::cout<<"fail\n";
+
+        std::cout<<"Test ElementProperty<double>::lipnikov_hessian 3D:"<<std::endl;
+        {
+            double y0[] = {0.1, 0.2, 0.1}, y1[] = {1.2, 0.1, 0.0}, y2[] = {0.1, 0.9, 0.2}, y3[] = {0.2, 0.3, 1.1};
+            double m[] = {2.0, 0.3, 0.1, 1.5, 0.2, 1.8};
+            double grad[3], hess[9];
+            double q = tetrahedron.lipnikov_hessian(y0, y1, y2, y3, m, grad, hess);
+
+            // Compare with central differences.
+            double h = 1.0e-5, err = fabs(q-tetrahedron.lipnikov(y0, y1, y2, y3, m));
+            for(int i=0; i<3; i++) {
+                double yp[] = {y0[0], y0[1], y0[2]}, yn[] = {y0[0], y0[1], y0[2]};
+                yp[i] += h;
+                yn[i] -= h;
+
+                double gp[3], gn[3], hd[9];
+                double qp = tetrahedron.lipnikov_hessian(yp, y1, y2, y3, m, gp, hd);
+                double qn = tetrahedron.lipnikov_hessian(yn, y1, y2, y3, m, gn, hd);
+
+                err = std::max(err, fabs(grad[i]-(qp-qn)/(2*h)));
+                for(int j=0; j<3; j++)
+                    err = std::max(err, fabs(hess[i*3+j]-(gp[j]-gn[j])/(2*h)));
+            }
+            if(err<1.0e-6)
+                std::cout<<"pass\n";
+            else
+                std::cout<<"fail (error="<<err<<")\n";
+        }
+
+        std::cout<<"Test ElementProperty<double>::lipnikov_block3d:"<<std::endl;
+        {
+            const int block = ElementProperty<double>::lipnikov_block;
+            double X[12][block], M[6][block], q[block];
+            double qmin = DBL_MAX, err = 0;
+            int n = 5;
+            for(int e=0; e<n; e++) {
+                double y0[] = {x0[0], x0[1], x0[2]-0.1*e};
+                double m0[] = {1.0+e, 0.1*e, 0.0, 2.0, 0.0, 1.0};
+                for(int d=0; d<3; d++) {
+                    X[d][e] = y0[d];
+                    X[3+d][e] = x1[d];
+                    X[6+d][e] = x2[d];
+                    X[9+d][e] = x3[d];
+                }
+                tetrahedron.lipnikov_block_metric(M, e, m0, fm, fm, fm);
+                qmin = std::min(qmin, tetrahedron.lipnikov(y0, x1, x2, x3, m0, fm, fm, fm));
+            }
+            double bmin = tetrahedron.lipnikov_block3d(n, X, M, q);
+            for(int e=0; e<n; e++) {
+                double y0[] = {x0[0], x0[1], x0[2]-0.1*e};
+                double m0[] = {1.0+e, 0.1*e, 0.0, 2.0, 0.0, 1.0};
+                err = std::max(err, fabs(q[e]-tetrahedron.lipnikov(y0, x1, x2, x3, m0, fm, fm, fm)));
+            }
+            if(err<1e-12 && fabs(bmin-qmin)<1e-12)
+                std::cout<<"pass\n";
+            else
+                std::cout<<"fail\n";
+        }
     }
 
     return 0;
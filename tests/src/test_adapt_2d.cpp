@@ -97,8 +97,15 @@ int main(int argc, char **argv)
     }
 
     metric_field.add_field(&(psi[0]), eta, 2);
+    double predicted = metric_field.predict_nelements();
     metric_field.update_mesh();
 
+    // A linear field should be carried through adaptation exactly.
+    std::vector<double> linear(NNodes);
+    for(size_t i=0; i<NNodes; i++)
+        linear[i] = 1.0 + mesh->get_coords(i)[0] - 3.0*mesh->get_coords(i)[1];
+    int linear_id = mesh->attach_field(&(linear[0]));
+
     if(verbose) {
         std::cout<<"Initial quality:\n";
         mesh->verify();
@@ -186,12 +193,26 @@ int main(int argc, char **argv)
 
     VTKTools<double>::export_vtu("../data/test_adapt_2d", mesh, &(psi[0]));
 
+    linear.resize(NNodes);
+    mesh->get_field(linear_id, &(linear[0]));
+    double linear_error = 0;
+    for(size_t i=0; i<NNodes; i++)
+        linear_error = std::max(linear_error, std::abs(linear[i] - (1.0 + mesh->get_coords(i)[0] - 3.0*mesh->get_coords(i)[1])));
+#ifdef HAVE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &linear_error, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
     double qmean = mesh->get_qmean();
     double qmin = mesh->get_qmin();
 
     long double perimeter = mesh->calculate_perimeter();
     long double area = mesh->calculate_area();
 
+    double NElements = mesh->get_number_elements();
+#ifdef HAVE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &NElements, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+
     delete mesh;
 
     if(rank==0) {
@@ -223,6 +244,18 @@ int main(int argc, char **argv)
             std::cout<<"pass"<<std::endl;
         else
             std::cout<<"fail (area="<<area<<")"<<std::endl;
+
+        std::cout<<"Expecting predicted number of elements within 25%: ";
+        if(std::abs(NElements-predicted)<0.25*NElements)
+            std::cout<<"pass"<<std::endl;
+        else
+            std::cout<<"fail (predicted="<<predicted<<", NElements="<<NElements<<")"<<std::endl;
+
+        std::cout<<"Expecting attached linear field to be interpolated exactly: ";
+        if(linear_error<1.0e-10)
+            std::cout<<"pass"<<std::endl;
+        else
+            std::cout<<"fail (error="<<linear_error<<")"<<std::endl;
     }
 #else
     std::cerr<<"Pragmatic was configured without VTK"<<std::endl;
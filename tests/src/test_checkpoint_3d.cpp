@@ -0,0 +1,156 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#include "MetricField.h"
+#include "Refine.h"
+#include "CheckpointTools.h"
+#include "ticker.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+#endif
+
+#ifdef HAVE_VTK
+    double tic = get_wtime();
+    Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box20x20x20.vtu");
+    mesh->create_boundary();
+    double time_vtu = get_wtime()-tic;
+
+    MetricField<double,3> metric_field(*mesh);
+
+    size_t NNodes = mesh->get_number_nodes();
+    std::vector<double> psi(NNodes);
+    for(size_t i=0; i<NNodes; i++)
+        psi[i] =
+            pow(mesh->get_coords(i)[0], 4) +
+            pow(mesh->get_coords(i)[1], 4) +
+            pow(mesh->get_coords(i)[2], 4);
+
+    metric_field.add_field(&(psi[0]), 0.001);
+    metric_field.update_mesh();
+    mesh->attach_field(&(psi[0]));
+
+    tic = get_wtime();
+    CheckpointTools<double>::export_checkpoint("../data/test_checkpoint_3d", mesh);
+    double time_write = get_wtime()-tic;
+
+    tic = get_wtime();
+    Mesh<double> *restart=CheckpointTools<double>::import_checkpoint("../data/test_checkpoint_3d");
+    double time_read = get_wtime()-tic;
+
+    MetricField<double,3> *restart_metric=CheckpointTools<double>::import_checkpoint_metric<3>(*restart);
+
+    // The restored mesh must be identical to the original.
+    bool identical = restart->get_number_nodes()==mesh->get_number_nodes() &&
+                     restart->get_number_elements()==mesh->get_number_elements() &&
+                     restart->get_number_fields()==1;
+    for(size_t i=0; identical && i<mesh->get_number_elements(); i++) {
+        const index_t *n = mesh->get_element(i);
+        const index_t *rn = restart->get_element(i);
+        const int *b = mesh->get_boundaryTags()+i*4;
+        const int *rb = restart->get_boundaryTags()+i*4;
+        for(size_t j=0; j<4; j++)
+            identical = identical && n[j]==rn[j] && b[j]==rb[j];
+    }
+    identical = identical && mesh->get_qmean()==restart->get_qmean() && mesh->get_qmin()==restart->get_qmin();
+    for(size_t i=0; identical && i<NNodes; i++) {
+        for(size_t j=0; j<3; j++)
+            identical = identical && mesh->get_coords(i)[j]==restart->get_coords(i)[j];
+        for(size_t j=0; j<6; j++)
+            identical = identical && mesh->get_metric(i)[j]==restart->get_metric(i)[j] &&
+                        std::abs(restart->get_metric(i)[j]-restart_metric->get_metric(i)[j])<=1.0e-10*std::abs(restart->get_metric(i)[j]);
+        identical = identical && mesh->get_node_patch(i)==restart->get_node_patch(i) &&
+                    mesh->get_fields(i)[0]==restart->get_fields(i)[0];
+    }
+
+    identical = identical && restart->verify();
+
+    // Adapting the restored mesh gives the same result.
+    Refine<double,3> adapt(*mesh), restart_adapt(*restart);
+    adapt.refine(sqrt(2.0));
+    restart_adapt.refine(sqrt(2.0));
+
+    std::cout<<"CheckpointTools :: VTU import = "<<time_vtu<<", checkpoint write = "<<time_write
+             <<", checkpoint read = "<<time_read<<std::endl;
+
+    std::cout<<"Expecting restored mesh to be identical: ";
+    if(identical)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail"<<std::endl;
+
+    std::cout<<"Expecting restored mesh to adapt identically: ";
+    if(restart->get_number_elements()==mesh->get_number_elements() &&
+            restart->get_number_nodes()==mesh->get_number_nodes())
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail"<<std::endl;
+
+    delete restart_metric;
+    delete restart;
+    delete mesh;
+#else
+    std::cerr<<"Pragmatic was configured without VTK"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
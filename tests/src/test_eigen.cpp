@@ -38,6 +38,226 @@
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <iostream>
+#include <vector>
+#include <cstdlib>
+
+#include "MetricTensor.h"
+#include "ticker.h"
+
+/* Random symmetric matrix, as the upper triangle, with the given eigenvalues.
+ */
+template<int dim>
+void random_symmetric(const double *D, double *m)
+{
+    Eigen::Matrix<double, dim, dim> R;
+    for(int i=0; i<dim; i++)
+        for(int j=0; j<dim; j++)
+            R(i,j) = rand()/(double)RAND_MAX-0.5;
+
+    Eigen::HouseholderQR< Eigen::Matrix<double, dim, dim> > qr(R);
+    Eigen::Matrix<double, dim, dim> Q = qr.householderQ();
+
+    Eigen::Matrix<double, dim, 1> d;
+    for(int i=0; i<dim; i++)
+        d[i] = D[i];
+    Eigen::Matrix<double, dim, dim> A = Q*d.asDiagonal()*Q.transpose();
+
+    for(int i=0, k=0; i<dim; i++)
+        for(int j=i; j<dim; j++, k++)
+            m[k] = A(i,j);
+}
+
+/* Check MetricTensor::eigen_solve on random matrices, including repeated,
+ * nearly repeated, zero and badly scaled eigenvalues, against
+ * Eigen::SelfAdjointEigenSolver. Returns the worst relative error in the
+ * eigenvalues, the residual ||A v - lambda v|| and the orthonormality of
+ * the eigenvectors.
+ */
+template<int dim>
+double check_eigen_solve()
+{
+    const int msize = dim==2?3:6;
+    const double spectra[][3] = {{1.0, 2.0, 3.0}, {1.0, 1.0, 2.0}, {1.0, 2.0, 2.0}, {2.0, 2.0, 2.0},
+        {1.0, 1.0+1.0e-10, 2.0}, {0.0, 0.0, 1.0}, {-1.0, 0.5, 3.0}, {1.0e-8, 1.0, 1.0e8}, {1.0e-12, 1.0e-12, 1.0e-6}
+    };
+    const int nspectra = sizeof(spectra)/sizeof(spectra[0]);
+
+    double worst=0.0;
+    for(int n=0; n<1000; n++) {
+        double D[3], m[6], Dc[dim], Vc[dim*dim];
+        for(int i=0; i<dim; i++)
+            D[i] = n<10*nspectra ? spectra[n%nspectra][i] : 10.0*rand()/(double)RAND_MAX-2.0;
+
+        random_symmetric<dim>(D, m);
+        MetricTensor<double, dim>::eigen_solve(m, Dc, Vc);
+
+        Eigen::Matrix<double, dim, dim> A;
+        for(int i=0, k=0; i<dim; i++)
+            for(int j=i; j<dim; j++, k++)
+                A(i,j) = A(j,i) = m[k];
+        double norm = std::max(A.norm(), 1.0e-300);
+
+        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<double, dim, dim> > solver(A);
+        for(int i=0; i<dim; i++)
+            worst = std::max(worst, fabs(Dc[i]-solver.eigenvalues()[i])/norm);
+
+        Eigen::Matrix<double, dim, dim> V;
+        for(int i=0; i<dim; i++)
+            for(int j=0; j<dim; j++)
+                V(i,j) = Vc[i*dim+j];
+
+        for(int i=0; i<dim; i++)
+            worst = std::max(worst, (A*V.row(i).transpose()-Dc[i]*V.row(i).transpose()).norm()/norm);
+        worst = std::max(worst, (V*V.transpose()-Eigen::Matrix<double, dim, dim>::Identity()).norm());
+    }
+
+    // Throughput against Eigen.
+    const int nbatch = 100000;
+    std::vector<double> m(nbatch*msize), ms(nbatch*msize), D(nbatch*dim), V(nbatch*dim*dim);
+    for(int n=0; n<nbatch; n++) {
+        double d[3];
+        for(int i=0; i<dim; i++)
+            d[i] = 10.0*rand()/(double)RAND_MAX;
+        random_symmetric<dim>(d, &(m[n*msize]));
+        for(int k=0; k<msize; k++)
+            ms[k*nbatch+n] = m[n*msize+k];
+    }
+
+    double checksum=0.0;
+    double tic = get_wtime();
+    for(int n=0; n<nbatch; n++) {
+        Eigen::Matrix<double, dim, dim> A;
+        for(int i=0, k=0; i<dim; i++)
+            for(int j=i; j<dim; j++, k++)
+                A(i,j) = A(j,i) = m[n*msize+k];
+        Eigen::SelfAdjointEigenSolver< Eigen::Matrix<double, dim, dim> > solver(A);
+        checksum += solver.eigenvalues()[0];
+    }
+    double time_eigen = get_wtime()-tic;
+
+    tic = get_wtime();
+    for(int n=0; n<nbatch; n++) {
+        MetricTensor<double, dim>::eigen_solve(&(m[n*msize]), &(D[n*dim]), &(V[n*dim*dim]));
+        checksum += D[n*dim];
+    }
+    double time_closed = get_wtime()-tic;
+
+    tic = get_wtime();
+    MetricTensor<double, dim>::eigen_solve_batch(nbatch, &(ms[0]), &(D[0]), &(V[0]));
+    double time_batch = get_wtime()-tic;
+
+    std::cout<<dim<<"D eigen-decompositions/sec :: Eigen = "<<nbatch/time_eigen
+             <<", eigen_solve = "<<nbatch/time_closed
+             <<", eigen_solve_batch = "<<nbatch/time_batch<<" ("<<checksum<<")"<<std::endl;
+
+    return worst;
+}
+
+/* Check MetricTensor::log_interpolate on random metrics with widely
+ * spread eigenvalues: the end points must be recovered, and since
+ * det(exp(X)) = exp(tr(X)) the determinant must be interpolated
+ * geometrically. Returns the worst relative error.
+ */
+template<int dim>
+double check_log_interpolate()
+{
+    const int msize = dim==2?3:6;
+
+    double worst=0.0;
+    for(int n=0; n<1000; n++) {
+        double D0[3], D1[3], m0[6], m1[6], l0[6], l1[6], m[6];
+        for(int i=0; i<dim; i++) {
+            D0[i] = pow(10.0, 8.0*rand()/(double)RAND_MAX-4.0);
+            D1[i] = pow(10.0, 8.0*rand()/(double)RAND_MAX-4.0);
+        }
+        random_symmetric<dim>(D0, m0);
+        random_symmetric<dim>(D1, m1);
+
+        MetricTensor<double, dim>::log_metric(m0, l0);
+        MetricTensor<double, dim>::log_metric(m1, l1);
+
+        double norm0=0.0, norm1=0.0;
+        for(int k=0; k<msize; k++) {
+            norm0 = std::max(norm0, fabs(m0[k]));
+            norm1 = std::max(norm1, fabs(m1[k]));
+        }
+
+        MetricTensor<double, dim>::log_interpolate(l0, l1, 0.0, m);
+        for(int k=0; k<msize; k++)
+            worst = std::max(worst, fabs(m[k]-m0[k])/norm0);
+
+        MetricTensor<double, dim>::log_interpolate(l0, l1, 1.0, m);
+        for(int k=0; k<msize; k++)
+            worst = std::max(worst, fabs(m[k]-m1[k])/norm1);
+
+        double w = rand()/(double)RAND_MAX;
+        MetricTensor<double, dim>::log_interpolate(l0, l1, w, m);
+
+        double D[dim], V[dim*dim], det=1.0, det0=1.0, det1=1.0;
+        MetricTensor<double, dim>::eigen_solve(m, D, V);
+        for(int i=0; i<dim; i++) {
+            det *= D[i];
+            det0 *= D0[i];
+            det1 *= D1[i];
+        }
+        double det_ref = pow(det0, 1.0-w)*pow(det1, w);
+        worst = std::max(worst, fabs(det-det_ref)/det_ref);
+    }
+
+    return worst;
+}
+
+/* Check that the cached eigen-decomposition of a MetricTensor stays
+ * consistent with the metric through the operations that modify it.
+ * Returns the worst residual ||M v - lambda v||/||M||.
+ */
+template<int dim>
+double check_cached_decomposition()
+{
+    double worst=0.0;
+    for(int n=0; n<1000; n++) {
+        double D[3], m[6], h[6];
+        for(int i=0; i<dim; i++)
+            D[i] = pow(10.0, 4.0*rand()/(double)RAND_MAX-2.0);
+        random_symmetric<dim>(D, m);
+        for(int i=0; i<dim; i++)
+            D[i] = pow(10.0, 4.0*rand()/(double)RAND_MAX-2.0);
+        random_symmetric<dim>(D, h);
+
+        MetricTensor<double, dim> M(m);
+        switch(n%4) {
+        case 0:
+            M.scale(2.5);
+            break;
+        case 1:
+            M.limit_aspect_ratio(3.0);
+            break;
+        case 2:
+            M.constrain(h);
+            break;
+        default:
+            M.constrain(MetricTensor<double, dim>(h), false);
+        }
+
+        const double *Dc = M.get_eigenvalues();
+        const double *Vc = M.get_eigenvectors();
+        const double *mc = M.get_metric();
+
+        Eigen::Matrix<double, dim, dim> A;
+        for(int i=0, k=0; i<dim; i++)
+            for(int j=i; j<dim; j++, k++)
+                A(i,j) = A(j,i) = mc[k];
+
+        for(int i=0; i<dim; i++) {
+            Eigen::Matrix<double, dim, 1> v;
+            for(int j=0; j<dim; j++)
+                v[j] = Vc[i*dim+j];
+            worst = std::max(worst, (A*v-Dc[i]*v).norm()/A.norm());
+        }
+    }
+
+    return worst;
+}
 
 int main()
 {
@@ -112,6 +332,24 @@ int main()
         if(fabs(a[i] - ref_a[i])>1.0e-4)
             pass = false;
 
+    double error_2d = check_eigen_solve<2>();
+    double error_3d = check_eigen_solve<3>();
+    std::cout<<"Closed form eigen-decomposition error :: 2D = "<<error_2d<<", 3D = "<<error_3d<<std::endl;
+    if(error_2d>1.0e-12 || error_3d>1.0e-12)
+        pass = false;
+
+    double log_error_2d = check_log_interpolate<2>();
+    double log_error_3d = check_log_interpolate<3>();
+    std::cout<<"Log-Euclidean interpolation error :: 2D = "<<log_error_2d<<", 3D = "<<log_error_3d<<std::endl;
+    if(log_error_2d>1.0e-6 || log_error_3d>1.0e-6)
+        pass = false;
+
+    double cache_error_2d = check_cached_decomposition<2>();
+    double cache_error_3d = check_cached_decomposition<3>();
+    std::cout<<"Cached eigen-decomposition residual :: 2D = "<<cache_error_2d<<", 3D = "<<cache_error_3d<<std::endl;
+    if(cache_error_2d>1.0e-12 || cache_error_3d>1.0e-12)
+        pass = false;
+
     if(pass)
         std::cout<<"pass\n";
     else
@@ -33,20 +33,31 @@ int main(int argc, char **argv)
     printf("pass\n");
 
 
+    double tic = get_wtime();
     Mesh<double> *mesh3 = GMFTools<double>::import_gmf_mesh("../data/mesh3d");
+    double time_import_mesh = get_wtime()-tic;
     Nnodes = mesh3->get_number_nodes();
     Nelements = mesh3->get_number_elements();
     printf("DEBUG  Number of vertices: %d   Number of elements: %d\n", Nnodes, Nelements);
     printf("pass\n");
 
+    tic = get_wtime();
     MetricField<double,3> *metric3 = GMFTools<double>::import_gmf_metric3d("../data/mesh3d", *mesh3);
+    double time_import_metric = get_wtime()-tic;
     printf("pass\n");
 
+    tic = get_wtime();
     GMFTools<double>::export_gmf_mesh("../data/test_gmf_3d", mesh3);
+    double time_export_mesh = get_wtime()-tic;
     printf("pass\n");
 
+    tic = get_wtime();
     GMFTools<double>::export_gmf_metric3d("../data/test_gmf_3d", metric3, mesh3);
+    double time_export_metric = get_wtime()-tic;
     printf("pass\n");
+
+    printf("GMFTools :: mesh3d import mesh = %g, import metric = %g, export mesh = %g, export metric = %g\n",
+           time_import_mesh, time_import_metric, time_export_mesh, time_export_metric);
 #else
     std::cerr<<"Pragmatic was configured without libMeshb"<<std::endl;
 #endif
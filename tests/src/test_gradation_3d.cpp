@@ -100,12 +100,25 @@ int main(int argc, char **argv)
 
         metric_field.set_metric(m, i);
     }
-    metric_field.gradation(1.2, 1.0);
+    double tic = get_wtime();
+    int passes = metric_field.gradation(1.2, 1.0);
+    double toc = get_wtime();
+
+    if(verbose)
+        std::cout<<"Gradation converged in "<<passes<<" passes, "<<toc-tic<<" seconds"<<std::endl;
+
+    // A graded metric field must be left unchanged by another gradation.
+    int repasses = metric_field.gradation(1.2, 1.0);
+
     metric_field.update_mesh();
 
     VTKTools<double>::export_vtu("../data/test_gradation_3d", mesh);
 
-    std::cout<<"pass"<<std::endl;
+    std::cout<<"Checking gradation converged: ";
+    if(passes<100 && repasses==1)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (passes="<<passes<<", repasses="<<repasses<<")"<<std::endl;
 
     delete mesh;
 #else
@@ -101,10 +101,77 @@ int main(int argc, char **argv)
         max_rms = std::max(max_rms, rms[i]);
     }
 
+    // Adding several fields at once must give the same metric as adding
+    // them one at a time.
+    std::vector<double> psi2(NNodes), psi3(NNodes);
+    for(size_t i=0; i<NNodes; i++) {
+        const double *x = mesh->get_coords(i);
+        psi2[i] = 3*x[0]*x[0] + x[0]*x[1];
+        psi3[i] = sin(3*x[0])*cos(2*x[1]);
+    }
+    const double *psis[] = {&(psi[0]), &(psi2[0]), &(psi3[0])};
+    const double errors[] = {1.0, 0.5, 0.1};
+
+    MetricField<double,2> sequential(*mesh), fused(*mesh);
+
+    double tic_fields = get_wtime();
+    for(int f=0; f<3; f++)
+        sequential.add_field(psis[f], errors[f], 2);
+    double time_sequential = get_wtime()-tic_fields;
+
+    tic_fields = get_wtime();
+    fused.add_fields(psis, 3, errors, 2);
+    double time_fused = get_wtime()-tic_fields;
+
+    double max_diff=0;
+    for(size_t i=0; i<NNodes; i++) {
+        const double *m0=sequential.get_metric(i), *m1=fused.get_metric(i);
+        double mmax=0, dmax=0;
+        for(int j=0; j<3; j++) {
+            mmax = std::max(mmax, std::abs(m0[j]));
+            dmax = std::max(dmax, std::abs(m1[j]-m0[j]));
+        }
+        max_diff = std::max(max_diff, dmax/mmax);
+    }
+
+    std::cout<<"Hessian of 3 fields :: add_field time = "<<time_sequential<<", add_fields time = "<<time_fused<<std::endl;
+    std::cout<<"Checking add_fields matches add_field: ";
+    if(max_diff<1.0e-10)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (max relative difference = "<<max_diff<<")"<<std::endl;
+
+    // Compare with recovering the Hessian by double L2 projection.
+    MetricField<double,2> projected(*mesh);
+
+    tic_fields = get_wtime();
+    projected.add_field(&(psi[0]), 1.0, -1, MetricField<double,2>::L2_PROJECTION);
+    double time_projected = get_wtime()-tic_fields;
+
+    double rms_projected=0;
+    for(size_t i=0; i<NNodes; i++) {
+        const double *m=projected.get_metric(i);
+        rms_projected += pow(2.0-m[0], 2) + pow(m[1], 2) + pow(2.0-m[2], 2);
+    }
+    rms_projected = sqrt(rms_projected/(3*NNodes));
+
+    std::cout<<"Hessian :: QLS time = "<<toc-tic<<", L2 projection time = "<<time_projected<<", L2 projection RMS = "<<rms_projected<<std::endl;
+    std::cout<<"Checking L2 projection Hessian: ";
+    if(rms_projected<0.01)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail"<<std::endl;
+
     std::string vtu_filename("../data/test_hessian_2d");
     VTKTools<double>::export_vtu(vtu_filename.c_str(), mesh, &(psi[0]));
 
+    int nthreads=1;
+#ifdef HAVE_OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+
     std::cout<<"Hessian :: loop time = "<<toc-tic<<std::endl
+             <<"Hessians/sec/core = "<<NNodes/((toc-tic)*nthreads)<<std::endl
              <<"RMS = "<<rms[0]<<", "<<rms[1]<<", "<<rms[2]<<std::endl;
     if(max_rms>0.01)
         std::cout<<"fail\n";
@@ -77,10 +77,17 @@ int main(int argc, char **argv)
             pow(mesh->get_coords(i)[1]+0.1, 2) +
             pow(mesh->get_coords(i)[2]+0.1, 2);
 
+    int nthreads=1;
+#ifdef HAVE_OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+
     double start_tic = get_wtime();
     metric_field.add_field(&(psi[0]), 1.0);
+    double hessian_time = get_wtime()-start_tic;
     metric_field.update_mesh();
-    std::cout<<"Hessian loop time = "<<get_wtime()-start_tic<<std::endl;
+    std::cout<<"Hessian loop time = "<<get_wtime()-start_tic<<std::endl
+             <<"Hessians/sec/core = "<<NNodes/(hessian_time*nthreads)<<std::endl;
 
     std::vector<double> metric(NNodes*6);
     metric_field.get_metric(&(metric[0]));
@@ -104,6 +111,109 @@ int main(int argc, char **argv)
         max_rms = std::max(max_rms, rms[i]);
     }
 
+    // Adding several fields at once must give the same metric as adding
+    // them one at a time.
+    std::vector<double> psi2(NNodes), psi3(NNodes);
+    for(size_t i=0; i<NNodes; i++) {
+        const double *x = mesh->get_coords(i);
+        psi2[i] = 3*x[0]*x[0] + x[1]*x[2];
+        psi3[i] = sin(3*x[0])*cos(2*x[1]) + x[2]*x[2]*x[2];
+    }
+    const double *psis[] = {&(psi[0]), &(psi2[0]), &(psi3[0])};
+    const double errors[] = {1.0, 0.5, 0.1};
+
+    MetricField<double,3> sequential(*mesh), fused(*mesh);
+
+    double tic_fields = get_wtime();
+    for(int f=0; f<3; f++)
+        sequential.add_field(psis[f], errors[f], 2);
+    double time_sequential = get_wtime()-tic_fields;
+
+    tic_fields = get_wtime();
+    fused.add_fields(psis, 3, errors, 2);
+    double time_fused = get_wtime()-tic_fields;
+
+    double max_diff=0;
+    for(size_t i=0; i<NNodes; i++) {
+        const double *m0=sequential.get_metric(i), *m1=fused.get_metric(i);
+        double mmax=0, dmax=0;
+        for(int j=0; j<6; j++) {
+            mmax = std::max(mmax, std::abs(m0[j]));
+            dmax = std::max(dmax, std::abs(m1[j]-m0[j]));
+        }
+        max_diff = std::max(max_diff, dmax/mmax);
+    }
+
+    std::cout<<"Hessian of 3 fields :: add_field time = "<<time_sequential<<", add_fields time = "<<time_fused<<std::endl;
+    std::cout<<"Checking add_fields matches add_field: ";
+    if(max_diff<1.0e-10)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (max relative difference = "<<max_diff<<")"<<std::endl;
+
+    // Compare with recovering the Hessian by double L2 projection.
+    MetricField<double,3> projected(*mesh);
+
+    tic_fields = get_wtime();
+    projected.add_field(&(psi[0]), 1.0, -1, MetricField<double,3>::L2_PROJECTION);
+    double time_projected = get_wtime()-tic_fields;
+
+    double rms_projected=0;
+    for(size_t i=0; i<NNodes; i++) {
+        const double *m=projected.get_metric(i);
+        rms_projected += pow(2.0-m[0], 2) + pow(m[1], 2) + pow(m[2], 2) + pow(2.0-m[3], 2) + pow(m[4], 2) + pow(2.0-m[5], 2);
+    }
+    rms_projected = sqrt(rms_projected/(6*NNodes));
+
+    std::cout<<"Hessian :: QLS time = "<<hessian_time<<", L2 projection time = "<<time_projected<<", L2 projection RMS = "<<rms_projected<<std::endl;
+    // The lumped projection is not exact for quadratics on this perturbed
+    // mesh; its RMS error is about 0.13.
+    std::cout<<"Checking L2 projection Hessian: ";
+    if(rms_projected<0.3)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail"<<std::endl;
+
+    // Applying constraints together must match applying them in turn.
+    MetricField<double,3> one_by_one(*mesh), together(*mesh);
+    one_by_one.add_field(&(psi3[0]), 0.1, 2);
+    together.add_field(&(psi3[0]), 0.1, 2);
+
+    tic_fields = get_wtime();
+    one_by_one.apply_max_edge_length(0.3);
+    one_by_one.apply_min_edge_length(0.01);
+    one_by_one.apply_max_aspect_ratio(5.0);
+    one_by_one.apply_nelements(3*NNodes);
+    double time_one_by_one = get_wtime()-tic_fields;
+
+    MetricConstraints<double> constraints;
+    constraints.set_max_edge_length(0.3);
+    constraints.set_min_edge_length(0.01);
+    constraints.set_max_aspect_ratio(5.0);
+    constraints.set_nelements(3*NNodes);
+
+    tic_fields = get_wtime();
+    together.apply_constraints(constraints);
+    double time_together = get_wtime()-tic_fields;
+
+    max_diff=0;
+    for(size_t i=0; i<NNodes; i++) {
+        const double *m0=one_by_one.get_metric(i), *m1=together.get_metric(i);
+        double mmax=0, dmax=0;
+        for(int j=0; j<6; j++) {
+            mmax = std::max(mmax, std::abs(m0[j]));
+            dmax = std::max(dmax, std::abs(m1[j]-m0[j]));
+        }
+        max_diff = std::max(max_diff, dmax/mmax);
+    }
+
+    std::cout<<"Metric constraints :: one at a time = "<<time_one_by_one<<", apply_constraints = "<<time_together<<std::endl;
+    std::cout<<"Checking apply_constraints matches apply_*: ";
+    if(max_diff<1.0e-10)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (max relative difference = "<<max_diff<<")"<<std::endl;
+
     for(size_t i=0; i<NNodes; i++)
         psi[i] =
             pow(mesh->get_coords(i)[0]+0.1, 2) +
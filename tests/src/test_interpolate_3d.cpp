@@ -0,0 +1,133 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#include "ElementLocator.h"
+#include "ticker.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+#endif
+
+#ifdef HAVE_VTK
+    Mesh<double> *old_mesh=VTKTools<double>::import_vtu("../data/box10x10x10.vtu");
+    Mesh<double> *new_mesh=VTKTools<double>::import_vtu("../data/box20x20x20.vtu");
+
+    // P1 interpolation reproduces a linear field exactly.
+    size_t NNodes = old_mesh->get_number_nodes();
+    std::vector<double> psi(2*NNodes);
+    for(size_t i=0; i<NNodes; i++) {
+        const double *x = old_mesh->get_coords(i);
+        psi[2*i] = 1.0 + x[0] - 3.0*x[1] + 2.0*x[2];
+        psi[2*i+1] = -psi[2*i];
+    }
+
+    double tic = get_wtime();
+    ElementLocator<double, 3> locator(*old_mesh);
+    double time_build = get_wtime()-tic;
+
+    size_t new_NNodes = new_mesh->get_number_nodes();
+    std::vector<double> new_psi(2*new_NNodes);
+
+    tic = get_wtime();
+    locator.interpolate(*new_mesh, &(psi[0]), &(new_psi[0]), 2);
+    double time_interpolate = get_wtime()-tic;
+
+    double max_error = 0;
+    for(size_t i=0; i<new_NNodes; i++) {
+        const double *x = new_mesh->get_coords(i);
+        double exact = 1.0 + x[0] - 3.0*x[1] + 2.0*x[2];
+        max_error = std::max(max_error, std::abs(new_psi[2*i]-exact));
+        max_error = std::max(max_error, std::abs(new_psi[2*i+1]+exact));
+    }
+
+    // Locating without a guess must search the tree.
+    size_t misses = 0;
+    for(size_t i=0; i<new_NNodes; i++) {
+        double l[3+1];
+        int eid = locator.locate(new_mesh->get_coords(i), l);
+        if(eid<0 || *std::min_element(l, l+3+1)<-1.0e-10)
+            misses++;
+    }
+
+    std::cout<<"ElementLocator :: build time = "<<time_build<<", interpolation time = "<<time_interpolate<<std::endl
+             <<"Points/sec = "<<new_NNodes/time_interpolate<<std::endl;
+
+    std::cout<<"Expecting linear field to be interpolated exactly: ";
+    if(max_error<1.0e-10)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (error="<<max_error<<")"<<std::endl;
+
+    std::cout<<"Expecting every point to be located: ";
+    if(misses==0)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (misses="<<misses<<")"<<std::endl;
+
+    delete old_mesh;
+    delete new_mesh;
+#else
+    std::cerr<<"Pragmatic was configured without VTK"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#include "MetricField.h"
+#include "Refine.h"
+#include "Coarsen.h"
+#ifdef HAVE_MPI
+#include "HaloExchange.h"
+#endif
+
+#if defined(HAVE_VTK) && defined(HAVE_MPI)
+// Anisotropic metric that differs from vertex to vertex.
+void metric_value(const double *x, double scale, double *m)
+{
+    m[0] = scale*(20.0+x[0]);
+    m[1] = x[1];
+    m[2] = x[2];
+    m[3] = scale*(20.0+x[1]);
+    m[4] = x[0]*x[2];
+    m[5] = scale*(20.0+x[2]);
+}
+
+// Set the metric on the owned vertices only, push it to the mesh and
+// count the vertices whose metric differs from the one of the owner.
+int check_metric_halo(Mesh<double> *mesh, double scale)
+{
+    MetricField<double,3> metric_field(*mesh);
+
+    size_t NNodes = mesh->get_number_nodes();
+    double m[6];
+    for(size_t i=0; i<NNodes; i++) {
+        if(mesh->is_owned_node(i)) {
+            metric_value(mesh->get_coords(i), scale, m);
+        } else {
+            double garbage[] = {7.0, 0.0, 0.0, 7.0, 0.0, 7.0};
+            std::copy(garbage, garbage+6, m);
+        }
+        metric_field.set_metric(m, i);
+    }
+    metric_field.update_mesh();
+
+    // Vertices left without elements by adaptivity are in no receive
+    // list until the mesh is defragmented, so only the owned and the
+    // received vertices are checked.
+    std::vector<bool> checked(NNodes, false);
+    for(size_t i=0; i<NNodes; i++)
+        checked[i] = mesh->is_owned_node(i);
+    for(size_t p=0; p<mesh->get_halo_recv().size(); p++) {
+        for(size_t k=0; k<mesh->get_halo_recv()[p].size(); k++)
+            checked[mesh->get_halo_recv()[p][k]] = true;
+    }
+
+    int errors=0;
+    for(size_t i=0; i<NNodes; i++) {
+        if(!checked[i])
+            continue;
+
+        MetricTensor<double,3> expected;
+        metric_value(mesh->get_coords(i), scale, m);
+        expected.set_metric(m);
+        for(int j=0; j<6; j++) {
+            if(mesh->get_metric(i)[j]!=expected.get_metric()[j]) {
+                errors++;
+                break;
+            }
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_INT, MPI_SUM, mesh->get_mpi_comm());
+
+    return errors;
+}
+
+// Uniform isotropic metric for edge length h.
+void set_uniform_metric(Mesh<double> *mesh, double h)
+{
+    MetricField<double,3> metric_field(*mesh);
+
+    double m[] = {1.0/(h*h), 0.0, 0.0, 1.0/(h*h), 0.0, 1.0/(h*h)};
+    size_t NNodes = mesh->get_number_nodes();
+    for(size_t i=0; i<NNodes; i++)
+        metric_field.set_metric(m, i);
+    metric_field.update_mesh();
+}
+
+// Exchange two fields of 4 values per vertex with a single plan and
+// compare the result with a halo_update of each field.
+int check_multiple_fields(Mesh<double> *mesh)
+{
+    const int block=4;
+    size_t NNodes = mesh->get_number_nodes();
+
+    std::vector<double> u(NNodes*block, -1.0), v(NNodes*block, -1.0);
+    for(size_t i=0; i<NNodes; i++) {
+        if(mesh->is_owned_node(i)) {
+            for(int j=0; j<block; j++) {
+                u[i*block+j] = mesh->get_coords(i)[j%3]+j;
+                v[i*block+j] = mesh->get_coords(i)[j%3]*(j+1);
+            }
+        }
+    }
+    std::vector<double> u_ref(u), v_ref(v);
+
+    HaloPlan<double> plan(mesh->get_mpi_comm(), mesh->get_halo_send(), mesh->get_halo_recv(),
+                          mesh->get_topology_version(), block, 2);
+    double *fields[] = {&(u[0]), &(v[0])};
+    plan.update(fields);
+
+    halo_update<double, block>(mesh->get_mpi_comm(), mesh->get_halo_send(), mesh->get_halo_recv(), u_ref);
+    halo_update<double, block>(mesh->get_mpi_comm(), mesh->get_halo_send(), mesh->get_halo_recv(), v_ref);
+
+    int errors=0;
+    for(size_t i=0; i<NNodes; i++) {
+        for(int j=0; j<block; j++) {
+            if(u[i*block+j]!=u_ref[i*block+j] || v[i*block+j]!=v_ref[i*block+j] ||
+                    u[i*block+j]!=mesh->get_coords(i)[j%3]+j) {
+                errors++;
+                break;
+            }
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_INT, MPI_SUM, mesh->get_mpi_comm());
+
+    return errors;
+}
+
+void report(int rank, const char *check, bool pass)
+{
+    if(rank==0) {
+        std::cout<<"Checking "<<check<<": ";
+        if(pass)
+            std::cout<<"pass"<<std::endl;
+        else
+            std::cout<<"fail"<<std::endl;
+    }
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int rank=0;
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+#if defined(HAVE_VTK) && defined(HAVE_MPI)
+    Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box10x10x10.vtu");
+    mesh->create_boundary();
+
+    report(rank, "metric halo matches the owners", check_metric_halo(mesh, 1.0)==0);
+
+    // A plan built now stays valid for as long as the topology does.
+    size_t version = mesh->get_topology_version();
+    HaloPlan<double> plan(mesh->get_mpi_comm(), mesh->get_halo_send(), mesh->get_halo_recv(), version, 6);
+
+    int errors = check_metric_halo(mesh, 2.0);
+    report(rank, "halo plan is reused while the topology is unchanged",
+           mesh->get_topology_version()==version && plan.is_valid(mesh->get_topology_version()) && errors==0);
+
+    set_uniform_metric(mesh, 0.05);
+    Refine<double,3> refine(*mesh);
+    refine.refine(sqrt(2.0));
+    report(rank, "halo plan is rebuilt after refinement",
+           !plan.is_valid(mesh->get_topology_version()) && check_metric_halo(mesh, 1.0)==0);
+
+    version = mesh->get_topology_version();
+    set_uniform_metric(mesh, 0.2);
+    Coarsen<double,3> coarsen(*mesh);
+    coarsen.coarsen(0.4, sqrt(2.0));
+    report(rank, "halo plan is rebuilt after coarsening",
+           mesh->get_topology_version()!=version && check_metric_halo(mesh, 1.0)==0);
+
+    version = mesh->get_topology_version();
+    mesh->defragment();
+    report(rank, "halo plan is rebuilt after defragmentation",
+           mesh->get_topology_version()!=version && check_metric_halo(mesh, 1.0)==0);
+
+    report(rank, "two fields of block 4 match halo_update", check_multiple_fields(mesh)==0);
+
+    delete mesh;
+#else
+    std::cerr<<"Pragmatic was configured without VTK or MPI"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
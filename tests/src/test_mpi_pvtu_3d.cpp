@@ -0,0 +1,158 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#ifdef HAVE_MPI
+#include "HaloExchange.h"
+#endif
+
+#if defined(HAVE_VTK) && defined(HAVE_MPI)
+long owned_nodes(const Mesh<double> *mesh)
+{
+    long NOwned=0;
+    for(size_t i=0; i<mesh->get_number_nodes(); i++) {
+        if(mesh->is_owned_node(i))
+            NOwned++;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &NOwned, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+    return NOwned;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int rank=0;
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+#if defined(HAVE_VTK) && defined(HAVE_MPI)
+    // Partition the box and write it as a .pvtu with GlobalIds and ghost cells.
+    Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box20x20x20.vtu");
+    mesh->create_boundary();
+
+    long NGlobal = owned_nodes(mesh);
+    long double volume = mesh->calculate_volume();
+
+    VTKTools<double>::export_vtu("../data/test_mpi_pvtu_3d", mesh);
+    MPI_Barrier(MPI_COMM_WORLD);
+    delete mesh;
+
+    // Each process reads back its own piece.
+    Mesh<double> *pieces=VTKTools<double>::import_pvtu_pieces("../data/test_mpi_pvtu_3d.pvtu");
+
+    if(rank==0) {
+        std::cout<<"Checking the pieces are read in parallel: ";
+        if(pieces!=NULL)
+            std::cout<<"pass"<<std::endl;
+        else
+            std::cout<<"fail"<<std::endl;
+    }
+
+    if(pieces!=NULL) {
+        long NOwned = owned_nodes(pieces);
+        long double pieces_volume = pieces->calculate_volume();
+
+        // Fill the halo with the coordinates of the owners.
+        size_t NNodes = pieces->get_number_nodes();
+        std::vector<double> coords(NNodes*3, -1.0);
+        for(size_t i=0; i<NNodes; i++) {
+            if(pieces->is_owned_node(i)) {
+                for(int j=0; j<3; j++)
+                    coords[i*3+j] = pieces->get_coords(i)[j];
+            }
+        }
+        halo_update<double, 3>(MPI_COMM_WORLD, pieces->get_halo_send(), pieces->get_halo_recv(), coords);
+
+        int halo_errors=0;
+        for(size_t i=0; i<NNodes; i++) {
+            for(int j=0; j<3; j++) {
+                if(coords[i*3+j]!=pieces->get_coords(i)[j])
+                    halo_errors++;
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &halo_errors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+        if(rank==0) {
+            std::cout<<"Checking owned vertices sum to "<<NGlobal<<": ";
+            if(NOwned==NGlobal)
+                std::cout<<"pass"<<std::endl;
+            else
+                std::cout<<"fail (sum="<<NOwned<<")"<<std::endl;
+
+            std::cout<<"Checking volume matches the serial mesh: ";
+            if(std::abs(pieces_volume-volume)<1.0e-12*volume)
+                std::cout<<"pass"<<std::endl;
+            else
+                std::cout<<"fail (volume="<<pieces_volume<<", expected "<<volume<<")"<<std::endl;
+
+            std::cout<<"Checking coordinate halo update: ";
+            if(halo_errors==0)
+                std::cout<<"pass"<<std::endl;
+            else
+                std::cout<<"fail ("<<halo_errors<<" wrong values)"<<std::endl;
+        }
+
+        delete pieces;
+    }
+#else
+    std::cerr<<"Pragmatic was configured without VTK or MPI"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
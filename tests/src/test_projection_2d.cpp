@@ -0,0 +1,179 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#include "GalerkinProjection.h"
+#include "ticker.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+double element_volume(const Mesh<double> *mesh, size_t e)
+{
+    const int *n=mesh->get_element(e);
+    return std::abs(ElementLocator<double, 2>::orient(mesh->get_coords(n[0]), mesh->get_coords(n[1]), mesh->get_coords(n[2])))/2;
+}
+
+// Integral of a P1 field, using the integral of each basis function.
+double integrate_p1(const Mesh<double> *mesh, const std::vector<double> &psi)
+{
+    double integral = 0;
+    for(size_t e=0; e<mesh->get_number_elements(); e++) {
+        const int *n=mesh->get_element(e);
+        double volume = element_volume(mesh, e);
+        for(int i=0; i<2+1; i++)
+            integral += volume*psi[n[i]]/(2+1);
+    }
+    return integral;
+}
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+#endif
+
+#ifdef HAVE_VTK
+    Mesh<double> *old_mesh=VTKTools<double>::import_vtu("../data/box50x50.vtu");
+    Mesh<double> *new_mesh=VTKTools<double>::import_vtu("../data/box200x200.vtu");
+
+    double tic = get_wtime();
+    GalerkinProjection<double, 2> projection(*old_mesh, *new_mesh);
+    double time_supermesh = get_wtime()-tic;
+
+    size_t nintersections = projection.get_number_intersections();
+    double volume = projection.get_supermesh_volume();
+
+    // P0: integral of an element-wise constant field is conserved.
+    size_t NElements = old_mesh->get_number_elements();
+    std::vector<double> psi0(NElements);
+    double integral0 = 0;
+    for(size_t e=0; e<NElements; e++) {
+        const int *n=old_mesh->get_element(e);
+        psi0[e] = sin(10*old_mesh->get_coords(n[0])[0]) + 2;
+        integral0 += element_volume(old_mesh, e)*psi0[e];
+    }
+
+    size_t new_NElements = new_mesh->get_number_elements();
+    std::vector<double> new_psi0(new_NElements);
+    projection.project_p0(&(psi0[0]), &(new_psi0[0]));
+
+    double new_integral0 = 0;
+    for(size_t e=0; e<new_NElements; e++)
+        new_integral0 += element_volume(new_mesh, e)*new_psi0[e];
+
+    // P1: linear fields are reproduced and integrals are conserved.
+    size_t NNodes = old_mesh->get_number_nodes();
+    std::vector<double> psi1(2*NNodes), linear(NNodes), wave(NNodes);
+    for(size_t i=0; i<NNodes; i++) {
+        const double *x = old_mesh->get_coords(i);
+        psi1[2*i] = linear[i] = 1.0 + x[0] - 3.0*x[1];
+        psi1[2*i+1] = wave[i] = sin(10*x[0])*cos(7*x[1]) + 2;
+    }
+
+    size_t new_NNodes = new_mesh->get_number_nodes();
+    std::vector<double> new_psi1(2*new_NNodes), new_wave(new_NNodes);
+
+    tic = get_wtime();
+    int iterations = projection.project_p1(&(psi1[0]), &(new_psi1[0]), 2);
+    double time_p1 = get_wtime()-tic;
+
+    double linear_error = 0;
+    for(size_t i=0; i<new_NNodes; i++) {
+        const double *x = new_mesh->get_coords(i);
+        linear_error = std::max(linear_error, std::abs(new_psi1[2*i] - (1.0 + x[0] - 3.0*x[1])));
+        new_wave[i] = new_psi1[2*i+1];
+    }
+
+    double integral1 = integrate_p1(old_mesh, wave);
+    double new_integral1 = integrate_p1(new_mesh, new_wave);
+
+    std::cout<<"GalerkinProjection :: supermesh time = "<<time_supermesh<<", intersections = "<<nintersections<<std::endl
+             <<"Intersections/sec = "<<nintersections/time_supermesh<<std::endl
+             <<"P1 projection time = "<<time_p1<<", CG iterations = "<<iterations<<std::endl;
+
+    std::cout<<"Expecting supermesh volume == 1: ";
+    if(std::abs(volume-1)<1.0e-12)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (volume="<<volume<<")"<<std::endl;
+
+    std::cout<<"Expecting P0 projection to conserve the integral: ";
+    if(std::abs(new_integral0-integral0)<1.0e-12*std::abs(integral0))
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (integral="<<integral0<<", projected="<<new_integral0<<")"<<std::endl;
+
+    std::cout<<"Expecting P1 projection to reproduce a linear field: ";
+    if(linear_error<1.0e-8)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (error="<<linear_error<<")"<<std::endl;
+
+    std::cout<<"Expecting P1 projection to conserve the integral: ";
+    if(std::abs(new_integral1-integral1)<1.0e-10*std::abs(integral1))
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail (integral="<<integral1<<", projected="<<new_integral1<<")"<<std::endl;
+
+    delete old_mesh;
+    delete new_mesh;
+#else
+    std::cerr<<"Pragmatic was configured without VTK"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
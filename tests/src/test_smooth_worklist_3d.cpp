@@ -0,0 +1,147 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cfloat>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#include "MetricField.h"
+#include "Smooth.h"
+#include "ticker.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+#ifdef HAVE_VTK
+Mesh<double> *init_mesh()
+{
+    Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box20x20x20.vtu");
+    mesh->create_boundary();
+
+    MetricField<double,3> metric_field(*mesh);
+
+    size_t NNodes = mesh->get_number_nodes();
+
+    double h1 = 1.0/20;
+    double h0 = 10.0/20;
+    for(size_t i=0; i<NNodes; i++) {
+        // Want x,y,z ranging from -1, 1
+        double x = 2*mesh->get_coords(i)[0] - 1;
+        double y = 2*mesh->get_coords(i)[1] - 1;
+        double z = 2*mesh->get_coords(i)[2] - 1;
+        double d = std::min(1-std::abs(x), std::min(1-std::abs(y), 1-std::abs(z)));
+
+        double hx = h0 - (h1-h0)*(d-1);
+        double m[] = {1.0/pow(hx, 2), 0,              0,
+                      1.0/pow(hx, 2), 0,
+                      1.0/pow(hx, 2)
+                     };
+
+        metric_field.set_metric(m, i);
+    }
+    metric_field.update_mesh();
+
+    return mesh;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int rank=0;
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+#ifdef HAVE_VTK
+    // With the default quality tolerance the worklist must not cost qmin,
+    // up to the variation between threaded runs. The optimisation kernels
+    // skip vertices whose patch is already good; smart_laplacian queues
+    // every vertex.
+    const char *kernel_name[] = {"smart_laplacian", "optimisation_linf", "optimisation_newton"};
+    const Smooth<double,3>::Schedule schedule[] = {Smooth<double,3>::LOCKING, Smooth<double,3>::WORKLIST};
+
+    for(int k=0; k<3; k++) {
+        double qmin[2];
+        for(int s=0; s<2; s++) {
+            Mesh<double> *mesh=init_mesh();
+            Smooth<double, 3> smooth(*mesh);
+
+            if(k==0)
+                smooth.smart_laplacian(10, -1.0, schedule[s]);
+            else if(k==1)
+                smooth.optimisation_linf(10, -1.0, schedule[s]);
+            else
+                smooth.optimisation_newton(10, -1.0, schedule[s]);
+
+            qmin[s] = mesh->get_qmin();
+            delete mesh;
+        }
+
+        if(rank==0) {
+            std::cout<<"Checking "<<kernel_name[k]<<" worklist qmin >= 0.95*locking qmin: ";
+            if(qmin[1]>=0.95*qmin[0])
+                std::cout<<"pass"<<std::endl;
+            else
+                std::cout<<"fail (locking qmin="<<qmin[0]<<", worklist qmin="<<qmin[1]<<")"<<std::endl;
+        }
+    }
+#else
+    std::cerr<<"Pragmatic was configured without VTK"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,318 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "Mesh.h"
+#include "MetricField.h"
+#include "VTUWriter.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+/* Reads the appended arrays of a VTU file written by VTUWriter, without
+ * VTK, so that the writer is checked in builds without VTK.
+ */
+class AppendedReader
+{
+public:
+    AppendedReader(const std::string &filename)
+    {
+        std::ifstream file(filename.c_str(), std::ios::binary);
+        std::stringstream buffer;
+        buffer<<file.rdbuf();
+        contents = buffer.str();
+
+        size_t appended = contents.find("<AppendedData encoding=\"raw\">");
+        data = (appended==std::string::npos)?std::string::npos:contents.find('_', appended)+1;
+        compressed = contents.find("compressor=\"vtkZLibDataCompressor\"")<appended;
+    }
+
+    /// Value of an attribute of the Piece element, e.g. NumberOfPoints.
+    long piece_attribute(const char *attribute) const
+    {
+        size_t piece = contents.find("<Piece ");
+        if(piece==std::string::npos)
+            return -1;
+        size_t pos = contents.find(std::string(attribute)+"=\"", piece);
+        if(pos==std::string::npos)
+            return -1;
+        return atol(contents.c_str()+pos+strlen(attribute)+2);
+    }
+
+    /// Decode the named array. Returns false if it is missing or corrupt.
+    bool read(const char *name, std::vector<char> &values) const
+    {
+        values.clear();
+        if(data==std::string::npos)
+            return false;
+
+        size_t pos = contents.find(std::string("Name=\"")+name+"\"");
+        if(pos==std::string::npos || pos>data)
+            return false;
+        pos = contents.find("offset=\"", pos);
+        if(pos==std::string::npos || pos>data)
+            return false;
+        size_t start = data+atol(contents.c_str()+pos+8);
+
+        if(!compressed) {
+            uint64_t nbytes;
+            if(start+sizeof(uint64_t)>contents.size())
+                return false;
+            memcpy(&nbytes, contents.data()+start, sizeof(uint64_t));
+            start += sizeof(uint64_t);
+            if(start+nbytes>contents.size())
+                return false;
+            values.assign(contents.begin()+start, contents.begin()+start+nbytes);
+            return true;
+        }
+
+#ifdef HAVE_ZLIB
+        // Header: number of blocks, block size, size of the last partial
+        // block (0 if it is full) and the compressed size of every block.
+        uint64_t header[3];
+        if(start+sizeof(header)>contents.size())
+            return false;
+        memcpy(header, contents.data()+start, sizeof(header));
+        uint64_t nblocks=header[0], block_size=header[1], last_size=header[2];
+        std::vector<uint64_t> csize(nblocks);
+        if(nblocks>0)
+            memcpy(&(csize[0]), contents.data()+start+sizeof(header), nblocks*sizeof(uint64_t));
+        start += sizeof(header)+nblocks*sizeof(uint64_t);
+
+        for(uint64_t b=0; b<nblocks; b++) {
+            uLongf len = (b==nblocks-1 && last_size>0)?last_size:block_size;
+            if(start+csize[b]>contents.size())
+                return false;
+            std::vector<char> block(len);
+            if(uncompress((Bytef *)&(block[0]), &len, (const Bytef *)contents.data()+start, csize[b])!=Z_OK)
+                return false;
+            values.insert(values.end(), block.begin(), block.begin()+len);
+            start += csize[b];
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+    std::string contents;
+    size_t data;
+    bool compressed;
+};
+
+void check(const char *what, bool passed)
+{
+    std::cout<<"Checking "<<what<<": "<<(passed?"pass":"fail")<<std::endl;
+}
+
+template<int dim>
+void test_roundtrip(Mesh<double> *mesh, const char *basename)
+{
+    int NNodes = mesh->get_number_nodes();
+    int NElements = mesh->get_number_elements();
+    int nloc = dim+1;
+
+    MetricField<double,dim> metric_field(*mesh);
+    for(int i=0; i<NNodes; i++) {
+        const double *x = mesh->get_coords(i);
+        double h = 0.05+0.1*x[0];
+        double m2[] = {1.0/(h*h), 0.0, 4.0/(h*h)};
+        double m3[] = {1.0/(h*h), 0.0, 0.0, 4.0/(h*h), 0.0, 1.0/(h*h)};
+        metric_field.set_metric(dim==2?m2:m3, i);
+    }
+    metric_field.update_mesh();
+
+    std::vector<double> psi(NNodes);
+    for(int i=0; i<NNodes; i++)
+        psi[i] = sin(mesh->get_coords(i)[0])+cos(mesh->get_coords(i)[1]);
+
+    std::string raw_name = std::string(basename)+"_raw";
+    VTUWriter<double>::export_vtu(raw_name.c_str(), mesh, &(psi[0]));
+    AppendedReader raw(raw_name+".vtu");
+
+    std::stringstream label;
+    label<<dim<<"D";
+
+    check((label.str()+" piece size").c_str(),
+          raw.piece_attribute("NumberOfPoints")==NNodes && raw.piece_attribute("NumberOfCells")==NElements);
+
+    std::vector<char> values;
+    bool points = raw.read("Points", values) && values.size()==NNodes*3*sizeof(double);
+    for(int i=0; points && i<NNodes; i++) {
+        const double *p = (const double *)&(values[i*3*sizeof(double)]);
+        for(int j=0; j<dim; j++)
+            points = points && p[j]==mesh->get_coords(i)[j];
+    }
+    check((label.str()+" Points").c_str(), points);
+
+    bool connectivity = raw.read("connectivity", values) && values.size()==NElements*nloc*sizeof(int64_t);
+    for(int i=0; connectivity && i<NElements; i++) {
+        const int64_t *n = (const int64_t *)&(values[i*nloc*sizeof(int64_t)]);
+        for(int j=0; j<nloc; j++)
+            connectivity = connectivity && n[j]==mesh->get_element(i)[j];
+    }
+    check((label.str()+" connectivity").c_str(), connectivity);
+
+    bool field = raw.read("psi", values) && values.size()==NNodes*sizeof(double) &&
+                 memcmp(&(values[0]), &(psi[0]), NNodes*sizeof(double))==0;
+    check((label.str()+" psi").c_str(), field);
+
+    bool quality = raw.read("quality", values) && values.size()==NElements*sizeof(double);
+    if(quality) {
+        const double *q = (const double *)&(values[0]);
+        double qmin=q[0], qsum=0;
+        for(int i=0; i<NElements; i++) {
+            qmin = std::min(qmin, q[i]);
+            qsum += q[i];
+        }
+        quality = std::abs(qmin-mesh->get_qmin())<1.0e-12 && std::abs(qsum/NElements-mesh->get_qmean())<1.0e-12;
+    }
+    check((label.str()+" quality").c_str(), quality);
+
+#ifdef HAVE_ZLIB
+    // The compressed file must decode to the same arrays.
+    std::string zlib_name = std::string(basename)+"_zlib";
+    VTUWriter<double>::export_vtu(zlib_name.c_str(), mesh, &(psi[0]), true);
+    AppendedReader zlib(zlib_name+".vtu");
+
+    const char *names[] = {"psi", "nid", "Metric", "mean_edge_length", "max_desired_edge_length", "min_desired_edge_length",
+                           "BoundaryNodes", "eid", "quality", "Boundary", "Points", "connectivity", "offsets", "types"
+                          };
+    bool same = true;
+    for(size_t i=0; i<sizeof(names)/sizeof(names[0]); i++) {
+        std::vector<char> raw_values, zlib_values;
+        same = same && raw.read(names[i], raw_values) && zlib.read(names[i], zlib_values) && raw_values==zlib_values;
+    }
+    check((label.str()+" zlib arrays match raw arrays").c_str(), same);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+#endif
+
+    // 2D: a unit square of 200x200 cells, each split into two triangles.
+    // Some arrays are larger than the block size used for compression.
+    {
+        const int n=200;
+        std::vector<double> x, y;
+        std::vector<int> ENList;
+        for(int j=0; j<=n; j++) {
+            for(int i=0; i<=n; i++) {
+                x.push_back((double)i/n);
+                y.push_back((double)j/n);
+            }
+        }
+        for(int j=0; j<n; j++) {
+            for(int i=0; i<n; i++) {
+                int v0=j*(n+1)+i, v1=v0+1, v2=v0+n+1, v3=v2+1;
+                int tri[] = {v0, v1, v3, v0, v3, v2};
+                ENList.insert(ENList.end(), tri, tri+6);
+            }
+        }
+
+        Mesh<double> *mesh = new Mesh<double>(x.size(), ENList.size()/3, &(ENList[0]), &(x[0]), &(y[0]));
+        mesh->create_boundary();
+        test_roundtrip<2>(mesh, "../data/test_vtu_roundtrip_2d");
+        delete mesh;
+    }
+
+    // 3D: a unit cube of 8x8x8 cells, each split into six tetrahedra.
+    {
+        const int n=8;
+        std::vector<double> x, y, z;
+        std::vector<int> ENList;
+        for(int k=0; k<=n; k++) {
+            for(int j=0; j<=n; j++) {
+                for(int i=0; i<=n; i++) {
+                    x.push_back((double)i/n);
+                    y.push_back((double)j/n);
+                    z.push_back((double)k/n);
+                }
+            }
+        }
+        for(int k=0; k<n; k++) {
+            for(int j=0; j<n; j++) {
+                for(int i=0; i<n; i++) {
+                    int v[8];
+                    for(int c=0; c<8; c++)
+                        v[c] = ((k+(c>>2))*(n+1)+j+((c>>1)&1))*(n+1)+i+(c&1);
+                    // Positively oriented tetrahedra around the diagonal v[0]-v[7].
+                    int tets[] = {v[0], v[1], v[3], v[7],
+                                  v[0], v[3], v[2], v[7],
+                                  v[0], v[2], v[6], v[7],
+                                  v[0], v[6], v[4], v[7],
+                                  v[0], v[4], v[5], v[7],
+                                  v[0], v[5], v[1], v[7]
+                                 };
+                    ENList.insert(ENList.end(), tets, tets+24);
+                }
+            }
+        }
+
+        Mesh<double> *mesh = new Mesh<double>(x.size(), ENList.size()/4, &(ENList[0]), &(x[0]), &(y[0]), &(z[0]));
+        mesh->create_boundary();
+        test_roundtrip<3>(mesh, "../data/test_vtu_roundtrip_3d");
+        delete mesh;
+    }
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}
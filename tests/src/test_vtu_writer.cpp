@@ -0,0 +1,169 @@
+/*  Copyright (C) 2010 Imperial College London and others.
+ *
+ *  Please see the AUTHORS file in the main source directory for a
+ *  full list of copyright holders.
+ *
+ *  Gerard Gorman
+ *  Applied Modelling and Computation Group
+ *  Department of Earth Science and Engineering
+ *  Imperial College London
+ *
+ *  g.gorman@imperial.ac.uk
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following
+ *  disclaimer in the documentation and/or other materials provided
+ *  with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ *  CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ *  INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ *  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ *  BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *  TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ *  ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ *  TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+ *  THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ *  SUCH DAMAGE.
+ */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
+#include "Mesh.h"
+#ifdef HAVE_VTK
+#include "VTKTools.h"
+#endif
+#include "MetricField.h"
+#include "VTUWriter.h"
+#include "AsyncExporter.h"
+#include "Smooth.h"
+#include "ticker.h"
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef HAVE_MPI
+    int required_thread_support=MPI_THREAD_SINGLE;
+    int provided_thread_support;
+    MPI_Init_thread(&argc, &argv, required_thread_support, &provided_thread_support);
+    assert(required_thread_support==provided_thread_support);
+#endif
+
+#ifdef HAVE_VTK
+    Mesh<double> *mesh=VTKTools<double>::import_vtu("../data/box200x200.vtu");
+    mesh->create_boundary();
+
+    MetricField<double,2> metric_field(*mesh);
+
+    size_t NNodes = mesh->get_number_nodes();
+    std::vector<double> psi(NNodes);
+    for(size_t i=0; i<NNodes; i++)
+        psi[i] = pow(mesh->get_coords(i)[0], 4) + pow(mesh->get_coords(i)[1], 4);
+
+    metric_field.add_field(&(psi[0]), 0.001);
+    metric_field.update_mesh();
+
+    double tic = get_wtime();
+    VTKTools<double>::export_vtu("../data/test_vtu_writer-vtk", mesh, &(psi[0]));
+    double time_vtk = get_wtime()-tic;
+
+    tic = get_wtime();
+    VTUWriter<double>::export_vtu("../data/test_vtu_writer-raw", mesh, &(psi[0]));
+    double time_raw = get_wtime()-tic;
+
+    tic = get_wtime();
+    VTUWriter<double>::export_vtu("../data/test_vtu_writer-zlib", mesh, &(psi[0]), true);
+    double time_zlib = get_wtime()-tic;
+
+    std::cout<<"VTUWriter :: VTK = "<<time_vtk<<", raw = "<<time_raw<<", zlib = "<<time_zlib<<std::endl;
+
+    // Both files must be read back by VTK as the original mesh.
+    const char *names[] = {"../data/test_vtu_writer-raw.vtu", "../data/test_vtu_writer-zlib.vtu"};
+    for(int k=0; k<2; k++) {
+        Mesh<double> *copy=VTKTools<double>::import_vtu(names[k]);
+
+        bool identical = copy->get_number_nodes()==NNodes &&
+                         copy->get_number_elements()==mesh->get_number_elements() &&
+                         std::abs(copy->calculate_area()-mesh->calculate_area())<1.0e-12;
+        for(size_t i=0; identical && i<NNodes; i++) {
+            for(int j=0; j<2; j++)
+                identical = identical && copy->get_coords(i)[j]==mesh->get_coords(i)[j];
+        }
+
+        std::cout<<"Expecting "<<names[k]<<" to be read back: ";
+        if(identical)
+            std::cout<<"pass"<<std::endl;
+        else
+            std::cout<<"fail"<<std::endl;
+
+        delete copy;
+    }
+
+    // The background export must write the mesh as it was when the
+    // export was started, while the mesh is smoothed.
+    std::vector<double> xy(NNodes*2);
+    for(size_t i=0; i<NNodes; i++) {
+        xy[i*2] = mesh->get_coords(i)[0];
+        xy[i*2+1] = mesh->get_coords(i)[1];
+    }
+
+    double time_async, time_smooth;
+    {
+        AsyncExporter<double> exporter;
+
+        tic = get_wtime();
+        int handle = exporter.export_vtu("../data/test_vtu_writer-async", mesh, &(psi[0]), true);
+        time_async = get_wtime()-tic;
+
+        tic = get_wtime();
+        Smooth<double,2> smooth(*mesh);
+        smooth.smart_laplacian(5);
+        time_smooth = get_wtime()-tic;
+
+        exporter.wait(handle);
+    }
+
+    std::cout<<"AsyncExporter :: snapshot = "<<time_async<<", overlapped smooth = "<<time_smooth<<std::endl;
+
+    Mesh<double> *copy=VTKTools<double>::import_vtu("../data/test_vtu_writer-async.vtu");
+    bool identical = copy->get_number_nodes()==NNodes;
+    for(size_t i=0; identical && i<NNodes; i++) {
+        for(int j=0; j<2; j++)
+            identical = identical && copy->get_coords(i)[j]==xy[i*2+j];
+    }
+    delete copy;
+
+    std::cout<<"Expecting background export to write the snapshot: ";
+    if(identical)
+        std::cout<<"pass"<<std::endl;
+    else
+        std::cout<<"fail"<<std::endl;
+
+    delete mesh;
+#else
+    std::cerr<<"Pragmatic was configured without VTK"<<std::endl;
+#endif
+
+#ifdef HAVE_MPI
+    MPI_Finalize();
+#endif
+
+    return 0;
+}